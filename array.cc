@@ -0,0 +1,251 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite3.h>
+#include <string_view>
+#include <span>
+#include <stdexcept>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite array parameter implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+/*
+	The carray table-valued function, an equivalent of the sqlite carray extension for arrays bound with
+	Req::bind_array(). The array is passed as a pointer value, which can only be set by sqlite3_bind_pointer()
+	with the same type name, so sql cannot forge it.
+
+	    SELECT value FROM carray(?);
+*/
+namespace
+{
+
+const char* ptr_type = "scc_array";
+
+enum class Type
+{
+	integer,
+	real,
+	text,
+};
+
+struct Array
+{
+	Type type;
+	const void* data;		// not owned
+	size_t size;
+};
+
+struct Cursor
+{
+	sqlite3_vtab_cursor base;	// must be first
+	const Array* arr;
+	size_t pos;
+};
+
+int x_connect(sqlite3* db, void*, int, const char* const*, sqlite3_vtab** pp, char**)
+{
+	int r = sqlite3_declare_vtab(db, "CREATE TABLE x(value, ptr HIDDEN);");
+	if (r != SQLITE_OK)
+	{
+		return r;
+	}
+	*pp = new sqlite3_vtab();
+	return SQLITE_OK;
+}
+
+int x_disconnect(sqlite3_vtab* p)
+{
+	delete p;
+	return SQLITE_OK;
+}
+
+int x_best_index(sqlite3_vtab*, sqlite3_index_info* info)
+{
+	int arg = -1;
+	for (int i = 0; i < info->nConstraint; i++)
+	{
+		auto& c = info->aConstraint[i];
+		if (c.iColumn != 1 || c.op != SQLITE_INDEX_CONSTRAINT_EQ)
+		{
+			continue;
+		}
+		if (!c.usable)
+		{
+			return SQLITE_CONSTRAINT;		// the planner must find another order, with the array available
+		}
+		arg = i;
+		break;
+	}
+	if (arg < 0)
+	{
+		info->idxNum = 0;					// no array, no rows
+		info->estimatedCost = 1;
+		info->estimatedRows = 1;
+		return SQLITE_OK;
+	}
+	info->aConstraintUsage[arg].argvIndex = 1;
+	info->aConstraintUsage[arg].omit = 1;
+	info->idxNum = 1;
+	info->estimatedCost = 100;
+	info->estimatedRows = 100;
+	return SQLITE_OK;
+}
+
+int x_open(sqlite3_vtab*, sqlite3_vtab_cursor** pp)
+{
+	auto c = new Cursor();
+	*pp = &c->base;
+	return SQLITE_OK;
+}
+
+int x_close(sqlite3_vtab_cursor* p)
+{
+	delete reinterpret_cast<Cursor*>(p);
+	return SQLITE_OK;
+}
+
+int x_filter(sqlite3_vtab_cursor* p, int plan, const char*, int, sqlite3_value** argv)
+{
+	auto c = reinterpret_cast<Cursor*>(p);
+	c->arr = plan ? static_cast<const Array*>(sqlite3_value_pointer(argv[0], ptr_type)) : nullptr;
+	c->pos = 0;
+	return SQLITE_OK;
+}
+
+int x_next(sqlite3_vtab_cursor* p)
+{
+	reinterpret_cast<Cursor*>(p)->pos++;
+	return SQLITE_OK;
+}
+
+int x_eof(sqlite3_vtab_cursor* p)
+{
+	auto c = reinterpret_cast<Cursor*>(p);
+	return !c->arr || c->pos >= c->arr->size;
+}
+
+int x_column(sqlite3_vtab_cursor* p, sqlite3_context* ctx, int col)
+{
+	auto c = reinterpret_cast<Cursor*>(p);
+	if (col != 0)
+	{
+		return SQLITE_OK;				// the hidden pointer column reads as NULL
+	}
+	switch (c->arr->type)
+	{
+	case Type::integer:
+		sqlite3_result_int64(ctx, static_cast<const int64_t*>(c->arr->data)[c->pos]);
+		break;
+	case Type::real:
+		sqlite3_result_double(ctx, static_cast<const double*>(c->arr->data)[c->pos]);
+		break;
+	case Type::text:
+		{
+			auto& s = static_cast<const std::string_view*>(c->arr->data)[c->pos];
+			sqlite3_result_text64(ctx, s.data(), s.size(), SQLITE_STATIC, SQLITE_UTF8);	// valid while bound
+		}
+		break;
+	}
+	return SQLITE_OK;
+}
+
+int x_rowid(sqlite3_vtab_cursor* p, sqlite3_int64* rowid)
+{
+	*rowid = reinterpret_cast<Cursor*>(p)->pos+1;
+	return SQLITE_OK;
+}
+
+sqlite3_module make_module()
+{
+	sqlite3_module m{};
+	m.xConnect = x_connect;				// no xCreate, the table is eponymous only
+	m.xBestIndex = x_best_index;
+	m.xDisconnect = x_disconnect;
+	m.xDestroy = x_disconnect;
+	m.xOpen = x_open;
+	m.xClose = x_close;
+	m.xFilter = x_filter;
+	m.xNext = x_next;
+	m.xEof = x_eof;
+	m.xColumn = x_column;
+	m.xRowid = x_rowid;
+	return m;
+}
+
+const sqlite3_module array_module = make_module();
+
+void array_free(void* p)
+{
+	delete static_cast<Array*>(p);
+}
+
+}	// namespace
+
+void Conn::create_array_module()
+{
+	int r = sqlite3_create_module_v2(m_db, "carray", &array_module, nullptr, nullptr);
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+}
+
+static Error bind_ptr(sqlite3_stmt* stmt, int idx, Array* arr)
+{
+	int r = sqlite3_bind_pointer(stmt, idx, arr, ptr_type, array_free);	// frees the array on failure
+	if (r != SQLITE_OK)
+	{
+		return Error{r, r, sqlite3_errstr(r)};
+	}
+	return Error{0, 0, {}};
+}
+
+void Req::bind_array(int idx, std::span<const int64_t> v)
+{
+	check(bind_stmt());
+	check(bind_ptr(m_stmt, idx, new Array{Type::integer, v.data(), v.size()}));
+}
+
+void Req::bind_array(int idx, std::span<const double> v)
+{
+	check(bind_stmt());
+	check(bind_ptr(m_stmt, idx, new Array{Type::real, v.data(), v.size()}));
+}
+
+void Req::bind_array(int idx, std::span<const std::string_view> v)
+{
+	check(bind_stmt());
+	check(bind_ptr(m_stmt, idx, new Array{Type::text, v.data(), v.size()}));
+}
@@ -0,0 +1,88 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/async.h>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite asynchronous connection implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+AsyncConn::AsyncConn(const std::string& uri) : m_conn(uri), m_stop(false)
+{
+	m_thread = std::thread(&AsyncConn::run, this);
+}
+
+AsyncConn::AsyncConn(const std::string& uri, const Conn::Options& opts) : m_conn(uri, opts), m_stop(false)
+{
+	m_thread = std::thread(&AsyncConn::run, this);
+}
+
+AsyncConn::~AsyncConn()
+{
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_stop = true;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+}
+
+void AsyncConn::push(std::unique_ptr<Job> job)
+{
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_queue.push_back(std::move(job));
+	}
+	m_cv.notify_one();
+}
+
+void AsyncConn::run()
+{
+	std::unique_lock<std::mutex> lk(m_mx);
+	for (;;)
+	{
+		m_cv.wait(lk, [this] { return m_stop || !m_queue.empty(); });
+		if (m_queue.empty())
+		{
+			return;						// stopped, and all queued operations have run
+		}
+
+		auto job = std::move(m_queue.front());
+		m_queue.pop_front();
+
+		lk.unlock();
+		job->run(m_conn);
+		job.reset();
+		lk.lock();
+	}
+}
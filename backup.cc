@@ -0,0 +1,145 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite3.h>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite online backup implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+/*
+	The destination is written in one transaction, which is rolled back if the backup does not complete,
+	so a cancelled or failed backup leaves the destination unchanged.
+*/
+static bool backup(sqlite3* dst, sqlite3* src, const BackupOptions& opts)
+{
+	if (!dst || !src)
+	{
+		throw std::runtime_error("backup called with a closed connection");
+	}
+
+	sqlite3_backup* b = sqlite3_backup_init(dst, "main", src, "main");
+	if (!b)
+	{
+		throw std::runtime_error(sqlite3_errmsg(dst));
+	}
+
+	auto last_step = std::chrono::steady_clock::now();		// last step which was not busy
+	for (;;)
+	{
+		int r = sqlite3_backup_step(b, opts.pages_per_step);
+		if (r == SQLITE_DONE)
+		{
+			break;
+		}
+		if (r == SQLITE_OK)
+		{
+			last_step = std::chrono::steady_clock::now();
+		}
+		else if (r == SQLITE_BUSY || r == SQLITE_LOCKED)
+		{
+			if (std::chrono::steady_clock::now()-last_step >= opts.busy_timeout)
+			{
+				sqlite3_backup_finish(b);
+				throw std::runtime_error("backup timed out waiting for a lock");
+			}
+		}
+		else
+		{
+			sqlite3_backup_finish(b);
+			throw std::runtime_error(sqlite3_errstr(r));
+		}
+
+		if (opts.progress && !opts.progress(sqlite3_backup_remaining(b), sqlite3_backup_pagecount(b)))
+		{
+			sqlite3_backup_finish(b);
+			return false;
+		}
+
+		if (opts.pause.count() > 0)
+		{
+			std::this_thread::sleep_for(opts.pause);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	if (opts.progress)
+	{
+		opts.progress(0, sqlite3_backup_pagecount(b));
+	}
+
+	int r = sqlite3_backup_finish(b);
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+	return true;
+}
+
+bool Conn::backup_to(Conn& dst, const BackupOptions& opts)
+{
+	bool done = backup(dst.m_db, m_db, opts);
+	dst.result_cache_reset();
+	return done;
+}
+
+bool Conn::backup_to(const std::string& uri, const BackupOptions& opts)
+{
+	Conn dst(uri);
+	return backup(dst.m_db, m_db, opts);
+}
+
+bool Conn::restore_from(Conn& src, const BackupOptions& opts)
+{
+	bool done = backup(m_db, src.m_db, opts);
+	result_cache_reset();
+	return done;
+}
+
+bool Conn::restore_from(const std::string& uri, const BackupOptions& opts)
+{
+	Options o;
+	o.flags = SQLITE_OPEN_READONLY;
+	Conn src(uri, o);
+	bool done = backup(m_db, src.m_db, opts);
+	result_cache_reset();
+	return done;
+}
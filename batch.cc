@@ -0,0 +1,241 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/batch.h>
+#include <sqlite3.h>
+#include <string>
+#include <system_error>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite columnar batch implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+/*
+	Storage type from a declared type, using the sqlite affinity rules. Columns with NUMERIC affinity, for
+	example NUMERIC, DECIMAL, BOOLEAN or DATE, may hold integers, reals or text, so have no storage type, and
+	neither do expressions and columns without a declared type.
+*/
+static bool decl_type(const char* decl, ColType& type)
+{
+	if (!decl)
+	{
+		return false;
+	}
+
+	std::string d(decl);
+	for (auto& c : d)
+	{
+		c = toupper(c);
+	}
+	if (d.find("INT") != std::string::npos)
+	{
+		type = ColType::integer;
+	}
+	else if (d.find("CHAR") != std::string::npos || d.find("CLOB") != std::string::npos || d.find("TEXT") != std::string::npos)
+	{
+		type = ColType::text;
+	}
+	else if (d.find("BLOB") != std::string::npos || d.empty())
+	{
+		type = ColType::blob;
+	}
+	else if (d.find("REAL") != std::string::npos || d.find("FLOA") != std::string::npos || d.find("DOUB") != std::string::npos)
+	{
+		type = ColType::real;
+	}
+	else
+	{
+		return false;			// NUMERIC
+	}
+	return true;
+}
+
+ColumnBatch::ColumnBatch() : m_rows(0), m_inferred(false)
+{
+}
+
+ColumnBatch::~ColumnBatch()
+{
+}
+
+void ColumnBatch::types(const std::vector<ColType>& types)
+{
+	reset();
+	m_inferred = false;
+
+	m_cols.resize(types.size());
+	for (size_t i = 0; i < types.size(); i++)
+	{
+		m_cols[i].type = types[i];
+	}
+}
+
+void ColumnBatch::clear()
+{
+	for (auto& c : m_cols)
+	{
+		c.ints.clear();
+		c.reals.clear();
+		c.offsets.clear();
+		c.arena.clear();
+		c.valid.clear();
+	}
+	m_rows = 0;
+}
+
+void ColumnBatch::reset()
+{
+	clear();
+	m_cols.clear();
+}
+
+void ColumnBatch::init(sqlite3_stmt* stmt)
+{
+	int n = sqlite3_column_count(stmt);
+
+	if (m_cols.empty())
+	{
+		m_inferred = true;
+		m_cols.resize(n);
+		for (int i = 0; i < n; i++)
+		{
+			if (decl_type(sqlite3_column_decltype(stmt, i), m_cols[i].type))
+			{
+				continue;
+			}
+			switch (sqlite3_column_type(stmt, i))			// from the first value, widened by append() if needed
+			{
+			case SQLITE_INTEGER: m_cols[i].type = ColType::integer; break;
+			case SQLITE_FLOAT: m_cols[i].type = ColType::real; break;
+			case SQLITE_BLOB: m_cols[i].type = ColType::blob; break;
+			default: m_cols[i].type = ColType::text;
+			}
+		}
+	}
+	else if (static_cast<int>(m_cols.size()) != n)
+	{
+		throw std::runtime_error("fetch_batch() called with wrong number of batch columns");
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		if (m_cols[i].name.empty())
+		{
+			m_cols[i].name = sqlite3_column_name(stmt, i);
+		}
+		if ((m_cols[i].type == ColType::text || m_cols[i].type == ColType::blob) && m_cols[i].offsets.empty())
+		{
+			m_cols[i].offsets.push_back(0);
+		}
+	}
+}
+
+void ColumnBatch::append(sqlite3_stmt* stmt)
+{
+	size_t bit = m_rows%8;
+
+	for (size_t i = 0; i < m_cols.size(); i++)
+	{
+		auto& c = m_cols[i];
+
+		int t = sqlite3_column_type(stmt, i);
+		bool null = t == SQLITE_NULL;
+
+		if (bit == 0)
+		{
+			c.valid.push_back(0);
+		}
+		if (!null)
+		{
+			c.valid.back() |= 1 << bit;
+		}
+
+		switch (c.type)
+		{
+		case ColType::integer:
+			if (t == SQLITE_FLOAT && m_inferred)			// a real in an integer column, keep the fraction
+			{
+				c.reals.assign(c.ints.begin(), c.ints.end());
+				c.ints.clear();
+				c.type = ColType::real;
+				c.reals.push_back(sqlite3_column_double(stmt, i));
+				break;
+			}
+			c.ints.push_back(null ? 0 : sqlite3_column_int64(stmt, i));
+			break;
+		case ColType::real:
+			c.reals.push_back(null ? 0 : sqlite3_column_double(stmt, i));
+			break;
+		case ColType::text:
+			if (!null)
+			{
+				const char* v = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));		// call before bytes
+				c.arena.insert(c.arena.end(), v, v+sqlite3_column_bytes(stmt, i));
+			}
+			c.offsets.push_back(c.arena.size());
+			break;
+		case ColType::blob:
+			if (!null)
+			{
+				const char* v = reinterpret_cast<const char*>(sqlite3_column_blob(stmt, i));
+				if (v)
+				{
+					c.arena.insert(c.arena.end(), v, v+sqlite3_column_bytes(stmt, i));
+				}
+			}
+			c.offsets.push_back(c.arena.size());
+			break;
+		}
+	}
+	m_rows++;
+}
+
+size_t Req::fetch_batch(ColumnBatch& batch, size_t max_rows)
+{
+	batch.clear();
+
+	if (!m_cols && !exec_select())
+	{
+		return 0;
+	}
+
+	batch.init(m_stmt);
+
+	while (m_cols && batch.m_rows < max_rows)
+	{
+		batch.append(m_stmt);
+		next_row();
+	}
+
+	return batch.m_rows;
+}
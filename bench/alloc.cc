@@ -0,0 +1,148 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite/config.h>
+#include <benchmark/benchmark.h>
+#include <string>
+
+/** \addtogroup sqlite
+	@{ */
+/** Allocator benchmarks for \ref sqlite \file */
+/** @} */
+
+/*
+	Run with:
+
+	    bazel run -c opt //bench:alloc
+
+	The argument selects the allocator: 0 for system malloc, 1 for the per-thread pool. The sys_allocs counter
+	is the number of allocations passed to the system allocator per iteration, allocs the number requested by sqlite.
+
+	This is a separate binary, since the allocator can only be changed while no connections are open.
+*/
+
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::Config;
+
+static Config::Allocator allocator(const benchmark::State& state)
+{
+	return state.range(0) ? Config::Allocator::pool : Config::Allocator::system;
+}
+
+static void setup(const benchmark::State& state)
+{
+	Config cfg;
+	cfg.allocator = allocator(state);
+	cfg.memstatus = false;
+	cfg.init();
+}
+
+static void teardown(const benchmark::State&)
+{
+	Config().init();
+}
+
+static void report(benchmark::State& state, const scc::sqld::AllocStats& start)
+{
+	if (state.thread_index() != 0)
+	{
+		return;
+	}
+	auto end = Config::alloc_stats();		// includes all threads
+	state.counters["allocs"] = benchmark::Counter(end.allocs-start.allocs, benchmark::Counter::kAvgIterations);
+	state.counters["sys_allocs"] = benchmark::Counter(end.system_allocs-start.system_allocs, benchmark::Counter::kAvgIterations);
+	state.SetLabel(allocator(state) == Config::Allocator::pool ? "pool" : "system");
+}
+
+/*
+	Statements compiled for each iteration, which allocates for parsing and code generation.
+*/
+static void compile(benchmark::State& state)
+{
+	Conn c(":memory:");
+	Req req(c);
+	req.sql() << "create table t(id INTEGER PRIMARY KEY, name TEXT);";
+	req.exec();
+
+	auto start = Config::alloc_stats();
+	int id = 0;
+	for (auto _ : state)
+	{
+		req.clear();
+		req.sql() << "insert or replace into t values(" << id << ", 'name " << id << "');";
+		req.exec();
+		req.clear();
+		req.sql() << "select name from t where id = " << id << ";";
+		req.exec_select();
+		benchmark::DoNotOptimize(req.col_text_view(0));
+		id = (id+1) % 1000;
+	}
+	req.clear();
+	report(state, start);
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(compile)->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime()->Setup(setup)->Teardown(teardown);
+
+/*
+	Cached statements, where allocations are mostly for row values and the page cache.
+*/
+static void cached(benchmark::State& state)
+{
+	Conn c(":memory:");
+	Req req(c);
+	req.sql() << "create table t(id INTEGER PRIMARY KEY, name TEXT);";
+	req.exec();
+	Req ins(c), sel(c);
+	ins.sql() << "insert or replace into t values(?, ?);";
+	sel.sql() << "select name from t where id = ?;";
+
+	auto start = Config::alloc_stats();
+	int id = 0;
+	std::string name;
+	for (auto _ : state)
+	{
+		name = "name " + std::to_string(id);
+		ins.reset();
+		ins.bind(id, name);
+		ins.exec();
+		sel.reset();
+		sel.bind(id);
+		sel.exec_select();
+		benchmark::DoNotOptimize(sel.col_text_view(0));
+		id = (id+1) % 1000;
+	}
+	ins.clear();
+	sel.clear();
+	report(state, start);
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(cached)->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime()->Setup(setup)->Teardown(teardown);
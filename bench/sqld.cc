@@ -0,0 +1,358 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite/batch.h>
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <filesystem>
+
+/** \addtogroup sqlite
+	@{ */
+/** Benchmarks for \ref sqlite \file */
+/** @} */
+
+/*
+	Run all benchmarks with:
+
+	    bazel run -c opt //bench
+
+	Arguments select the database uri, see uris below.
+*/
+
+using std::string;
+using std::vector;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::Trans;
+using scc::sqld::ColumnBatch;
+
+static const vector<string> uris =
+{
+	"file:mem?mode=memory&cache=shared",
+	":memory:",
+	"file:bench.db?mode=rwc",
+};
+
+static const int table_rows = 10000;
+
+/*
+	Connection to each uri with a populated table, created once and shared by all benchmarks.
+*/
+static Conn& db(int uri)
+{
+	static std::mutex mx;
+	static std::unique_ptr<Conn> conns[3];
+
+	std::lock_guard<std::mutex> lk(mx);
+
+	if (!conns[uri])
+	{
+		if (uris[uri].starts_with("file:bench.db"))
+		{
+			std::filesystem::remove("bench.db");		// from an earlier run
+		}
+
+		conns[uri].reset(new Conn(uris[uri]));
+
+		Req req(*conns[uri]);
+		req.sql() << "create table t(id INTEGER PRIMARY KEY, name TEXT, score REAL, b BLOB);";
+		req.exec();
+
+		Trans x(*conns[uri]);
+		x.begin();
+		req.clear();
+		req.sql() << "insert into t values(?, ?, ?, ?);";
+		vector<char> blob(100, 'x');
+		for (int i = 0; i < table_rows; i++)
+		{
+			req.reset();
+			req.bind(i, "name " + std::to_string(i), i*0.5, blob);
+			req.exec();
+		}
+		req.clear();
+		x.commit();
+	}
+	return *conns[uri];
+}
+
+static void point_select(benchmark::State& state)
+{
+	Conn& c = db(state.range(0));
+	Req req(c);
+	req.sql() << "select name, score from t where id = ?;";
+
+	int id = 0;
+	for (auto _ : state)
+	{
+		req.reset();
+		req.bind_int(1, id);
+		req.exec_select();
+		benchmark::DoNotOptimize(req.col_real(1));
+		id = (id+7919) % table_rows;
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.SetLabel(uris[state.range(0)]);
+}
+BENCHMARK(point_select)->DenseRange(0, 2);
+
+static void point_select_format(benchmark::State& state)
+{
+	Conn& c = db(state.range(0));
+	Req req(c);
+
+	int id = 0;
+	for (auto _ : state)
+	{
+		req.clear();
+		req.sql() << "select name, score from t where id = " << id << ";";		// sql differs, so it is compiled each time
+		req.exec_select();
+		benchmark::DoNotOptimize(req.col_real(1));
+		id = (id+7919) % table_rows;
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.SetLabel(uris[state.range(0)]);
+}
+BENCHMARK(point_select_format)->DenseRange(0, 2);
+
+static void scan_text(benchmark::State& state)
+{
+	Conn& c = db(state.range(0));
+	Req req(c);
+	req.sql() << "select name, b from t where id < 1000;";
+
+	string name;
+	vector<char> b;
+	for (auto _ : state)
+	{
+		req.reset();
+		for (int r = req.exec_select(); r; r = req.next_row())
+		{
+			req.col_text(0, name);
+			req.col_blob(1, b);
+		}
+		benchmark::DoNotOptimize(name);
+		benchmark::DoNotOptimize(b);
+	}
+	state.SetItemsProcessed(state.iterations()*1000);
+	state.SetLabel(uris[state.range(0)]);
+}
+BENCHMARK(scan_text)->DenseRange(0, 2);
+
+static void scan_view(benchmark::State& state)
+{
+	Conn& c = db(state.range(0));
+	Req req(c);
+	req.sql() << "select name, b from t where id < 1000;";
+
+	size_t sz = 0;
+	for (auto _ : state)
+	{
+		req.reset();
+		for (int r = req.exec_select(); r; r = req.next_row())
+		{
+			sz += req.col_text_view(0).size();
+			sz += req.col_blob_view(1).size();
+		}
+	}
+	benchmark::DoNotOptimize(sz);
+	state.SetItemsProcessed(state.iterations()*1000);
+	state.SetLabel(uris[state.range(0)]);
+}
+BENCHMARK(scan_view)->DenseRange(0, 2);
+
+static void scan_rows(benchmark::State& state)
+{
+	Conn& c = db(state.range(0));
+	Req req(c);
+	req.sql() << "select id, name, score from t where id < 1000;";
+
+	double sum = 0;
+	for (auto _ : state)
+	{
+		req.reset();
+		for (auto [id, name, score] : req.rows<int64_t, std::string_view, double>())
+		{
+			sum += id+name.size()+score;
+		}
+	}
+	benchmark::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations()*1000);
+	state.SetLabel(uris[state.range(0)]);
+}
+BENCHMARK(scan_rows)->DenseRange(0, 2);
+
+static void scan_batch(benchmark::State& state)
+{
+	Conn& c = db(state.range(0));
+	Req req(c);
+	req.sql() << "select id, name, score from t where id < 1000;";
+
+	ColumnBatch batch;
+	double sum = 0;
+	for (auto _ : state)
+	{
+		req.reset();
+		while (size_t n = req.fetch_batch(batch, 256))
+		{
+			auto& score = batch.col(2).reals;
+			for (size_t i = 0; i < n; i++)
+			{
+				sum += score[i];
+			}
+		}
+	}
+	benchmark::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations()*1000);
+	state.SetLabel(uris[state.range(0)]);
+}
+BENCHMARK(scan_batch)->DenseRange(0, 2);
+
+static void insert(benchmark::State& state)
+{
+	Conn c(uris[state.range(0)]);
+	Req req(c);
+	req.sql() << "create table if not exists ins(a INT, b TEXT);" << "delete from ins;";
+	req.exec();
+	req.clear();
+	req.sql() << "insert into ins values(?, ?);";
+
+	int i = 0;
+	for (auto _ : state)
+	{
+		req.reset();
+		req.bind(i++, "value");
+		req.exec();
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.SetLabel(uris[state.range(0)]);
+}
+BENCHMARK(insert)->DenseRange(0, 2);
+
+static void insert_trans(benchmark::State& state)
+{
+	Conn c(uris[state.range(0)]);
+	Req req(c);
+	req.sql() << "create table if not exists ins(a INT, b TEXT);" << "delete from ins;";
+	req.exec();
+	req.clear();
+	req.sql() << "insert into ins values(?, ?);";
+
+	Trans x(c);
+	x.begin();
+	int i = 0;
+	for (auto _ : state)
+	{
+		req.reset();
+		req.bind(i++, "value");
+		req.exec();
+	}
+	req.clear();
+	x.commit();
+	state.SetItemsProcessed(state.iterations());
+	state.SetLabel(uris[state.range(0)]);
+}
+BENCHMARK(insert_trans)->DenseRange(0, 2);
+
+static void script(benchmark::State& state, bool compile)
+{
+	Conn c(uris[state.range(0)]);
+	Req req(c);
+	req.sql() << "create table if not exists scr(a INT, b TEXT);" << "delete from scr;";
+	req.exec();
+	req.clear();
+
+	req.sql() << "begin;";
+	for (int i = 0; i < 100; i++)
+	{
+		req.sql() << "insert into scr values(" << i << ", 'value " << i << "');";
+	}
+	req.sql() << "delete from scr;" << "commit;";
+	if (compile)
+	{
+		req.compile();
+	}
+
+	for (auto _ : state)
+	{
+		req.reset();
+		req.exec();
+	}
+	state.SetItemsProcessed(state.iterations()*103);
+	state.SetLabel(uris[state.range(0)]);
+}
+BENCHMARK_CAPTURE(script, stream, false)->DenseRange(0, 2);
+BENCHMARK_CAPTURE(script, compiled, true)->DenseRange(0, 2);
+
+static void readers_shared(benchmark::State& state)
+{
+	Conn& c = db(state.range(0));		// all threads use one connection
+	Req req(c);
+	req.sql() << "select name, score from t where id = ?;";
+
+	int id = 0;
+	for (auto _ : state)
+	{
+		req.reset();
+		req.bind_int(1, id);
+		req.exec_select();
+		benchmark::DoNotOptimize(req.col_text_view(0));
+		id = (id+7919) % table_rows;
+	}
+	req.clear();
+	state.SetItemsProcessed(state.iterations());
+	state.SetLabel(uris[state.range(0)]);
+}
+BENCHMARK(readers_shared)->Arg(0)->Arg(2)->ThreadRange(1, 8)->UseRealTime();
+
+static void readers_separate(benchmark::State& state)
+{
+	db(state.range(0));					// make sure the table exists
+	Conn c(uris[state.range(0)]);		// each thread has its own connection
+	Req req(c);
+	req.sql() << "select name, score from t where id = ?;";
+
+	int id = 0;
+	for (auto _ : state)
+	{
+		req.reset();
+		req.bind_int(1, id);
+		req.exec_select();
+		benchmark::DoNotOptimize(req.col_text_view(0));
+		id = (id+7919) % table_rows;
+	}
+	req.clear();
+	state.SetItemsProcessed(state.iterations());
+	state.SetLabel(uris[state.range(0)]);
+}
+BENCHMARK(readers_separate)->Arg(0)->Arg(2)->ThreadRange(1, 8)->UseRealTime();	// :memory: connections do not share a database
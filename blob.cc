@@ -0,0 +1,109 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/blob.h>
+#include <sqlite/sqld.h>
+#include <sqlite3.h>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite incremental blob i/o implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+BlobStream::BlobStream(Conn& conn, const std::string& table, const std::string& col, int64_t rowid, bool write,
+	const std::string& db) : m_conn(conn), m_blob(nullptr), m_rowid(rowid), m_size(0)
+{
+	int r = sqlite3_blob_open(m_conn.m_db, db.c_str(), table.c_str(), col.c_str(), rowid, write ? 1 : 0, &m_blob);
+	if (r != SQLITE_OK)
+	{
+		sqlite3_blob_close(m_blob);		// a handle may be returned on error
+		throw std::runtime_error(sqlite3_errmsg(m_conn.m_db));
+	}
+	m_size = sqlite3_blob_bytes(m_blob);
+}
+
+BlobStream::~BlobStream()
+{
+	sqlite3_blob_close(m_blob);
+}
+
+void BlobStream::reopen(int64_t rowid)
+{
+	int r = sqlite3_blob_reopen(m_blob, rowid);
+	if (r != SQLITE_OK)
+	{
+		m_size = 0;				// the stream is aborted, reads and writes will fail
+		throw std::runtime_error(sqlite3_errmsg(m_conn.m_db));
+	}
+	m_rowid = rowid;
+	m_size = sqlite3_blob_bytes(m_blob);
+}
+
+void BlobStream::read(void* buf, size_t len, size_t off)
+{
+	if (off > m_size || len > m_size-off)
+	{
+		throw std::runtime_error("blob read past end");
+	}
+	int r = sqlite3_blob_read(m_blob, buf, len, off);
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+}
+
+size_t BlobStream::read(std::span<std::byte> buf, size_t off)
+{
+	if (off >= m_size)
+	{
+		return 0;
+	}
+	size_t len = std::min(buf.size(), m_size-off);
+	read(buf.data(), len, off);
+	return len;
+}
+
+void BlobStream::write(const void* buf, size_t len, size_t off)
+{
+	if (off > m_size || len > m_size-off)
+	{
+		throw std::runtime_error("blob write past end");
+	}
+	int r = sqlite3_blob_write(m_blob, buf, len, off);
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+}
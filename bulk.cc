@@ -0,0 +1,225 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/bulk.h>
+#include <string>
+#include <system_error>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite bulk inserter implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+using std::chrono::steady_clock;
+
+static const int max_variables = 32766;		// default SQLITE_MAX_VARIABLE_NUMBER
+
+static std::string quote(const std::string& name)
+{
+	std::string q("\"");
+	for (char c : name)
+	{
+		if (c == '"')
+		{
+			q += '"';
+		}
+		q += c;
+	}
+	q += '"';
+	return q;
+}
+
+BulkInserter::BulkInserter(Conn& conn, const std::string& table, const std::vector<std::string>& columns, const BulkOptions& opts)
+	: m_conn(conn), m_opts(opts), m_ncols(columns.size()), m_multi(conn), m_trans(conn), m_count(0),
+	  m_trans_rows(0), m_trans_bytes(0), m_stats{0, 0, 0, 0, std::chrono::nanoseconds(0)}
+{
+	if (m_ncols == 0)
+	{
+		throw std::runtime_error("bulk inserter requires at least one column");
+	}
+	if (m_opts.rows_per_stmt < 1)
+	{
+		m_opts.rows_per_stmt = 1;
+	}
+	if (m_opts.rows_per_stmt*m_ncols > max_variables)
+	{
+		m_opts.rows_per_stmt = max_variables/m_ncols;
+	}
+
+	m_head = "INSERT INTO " + quote(table) + "(";
+	for (size_t i = 0; i < m_ncols; i++)
+	{
+		m_head += (i ? "," : "") + quote(columns[i]);
+	}
+	m_head += ") VALUES ";
+
+	m_buf.resize(m_opts.rows_per_stmt*m_ncols);
+}
+
+BulkInserter::~BulkInserter()
+{
+}
+
+BulkInserter::Value* BulkInserter::next_row(size_t ncols)
+{
+	if (ncols != m_ncols)
+	{
+		throw std::runtime_error("bulk insert row has wrong number of values");
+	}
+	if (m_stats.rows == 0 && m_count == 0)
+	{
+		m_start = steady_clock::now();
+	}
+	return &m_buf[m_count*m_ncols];
+}
+
+void BulkInserter::row_added()
+{
+	uint64_t bytes = 0;
+	for (size_t i = m_count*m_ncols; i < (m_count+1)*m_ncols; i++)
+	{
+		switch (m_buf[i].index())
+		{
+		case 1: case 2: bytes += 8; break;
+		case 3: bytes += std::get<std::string>(m_buf[i]).size(); break;
+		case 4: bytes += std::get<std::vector<char>>(m_buf[i]).size(); break;
+		}
+	}
+	m_trans_bytes += bytes;
+	m_stats.bytes += bytes;
+
+	if (++m_count < m_opts.rows_per_stmt)
+	{
+		return;
+	}
+
+	if (m_multi.sql().view().empty())
+	{
+		statement(m_multi, m_count);
+	}
+
+	insert(m_multi, m_count);
+
+	if (m_trans_rows >= m_opts.commit_rows || m_trans_bytes >= m_opts.commit_bytes)
+	{
+		m_trans.commit();
+		m_stats.commits++;
+		m_trans_rows = 0;
+		m_trans_bytes = 0;
+	}
+}
+
+void BulkInserter::statement(Req& req, int rows)
+{
+	req.sql() << m_head;
+	for (int r = 0; r < rows; r++)
+	{
+		req.sql() << (r ? ",(" : "(");
+		for (size_t c = 0; c < m_ncols; c++)
+		{
+			req.sql() << (c ? ",?" : "?");
+		}
+		req.sql() << ")";
+	}
+	req.sql() << ";";
+}
+
+void BulkInserter::insert(Req& req, int rows)
+{
+	if (!m_trans.is_active())
+	{
+		m_trans.begin();
+	}
+
+	try
+	{
+		req.reset();
+		for (size_t i = 0; i < rows*m_ncols; i++)
+		{
+			int idx = i+1;
+			Value& v = m_buf[i];
+			switch (v.index())
+			{
+			case 0: req.bind_null(idx); break;
+			case 1: req.bind_int64(idx, std::get<int64_t>(v)); break;
+			case 2: req.bind_real(idx, std::get<double>(v)); break;
+			case 3: req.bind_text(idx, std::get<std::string>(v)); break;
+			case 4: req.bind_blob(idx, std::get<std::vector<char>>(v)); break;
+			}
+		}
+		req.exec();
+	}
+	catch (...)
+	{
+		m_count = 0;				// drop the failed batch, so the buffer can be reused
+		throw;
+	}
+
+	m_count = 0;
+	m_trans_rows += rows;
+	m_stats.rows += rows;
+	m_stats.statements++;
+	m_stats.elapsed = steady_clock::now()-m_start;
+}
+
+void BulkInserter::add_row(std::span<const Value> vals)
+{
+	Value* row = next_row(vals.size());
+	for (size_t i = 0; i < vals.size(); i++)
+	{
+		row[i] = vals[i];
+	}
+	row_added();
+}
+
+void BulkInserter::finish()
+{
+	if (m_count)
+	{
+		Req req(m_conn);			// partial batch statement, cached by the connection
+		statement(req, m_count);
+
+		insert(req, m_count);
+	}
+
+	if (m_trans.is_active())
+	{
+		m_trans.commit();
+		m_stats.commits++;
+	}
+	m_trans_rows = 0;
+	m_trans_bytes = 0;
+}
+
+BulkStats BulkInserter::stats() const
+{
+	return m_stats;
+}
@@ -0,0 +1,229 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/change.h>
+#include <sqlite/sqld.h>
+#include <sqlite3.h>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite change stream implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+ChangeStream::ChangeStream(Conn& conn, const std::vector<std::string>& tables, const std::string& schema, bool patchset)
+	: m_conn(conn), m_tables(tables), m_schema(schema), m_patchset(patchset), m_session(nullptr), m_bytes(0)
+{
+	create();
+	std::lock_guard<std::mutex> lk(m_conn.m_streams_mx);
+	m_conn.m_streams.push_back(this);
+}
+
+ChangeStream::~ChangeStream()
+{
+	std::lock_guard<std::mutex> lk(m_conn.m_streams_mx);
+	auto& v = m_conn.m_streams;
+	v.erase(std::remove(v.begin(), v.end(), this), v.end());
+	if (m_session)
+	{
+		sqlite3session_delete(m_session);
+	}
+}
+
+void ChangeStream::create()
+{
+	sqlite3_session* s;
+	int r = sqlite3session_create(m_conn.m_db, m_schema.c_str(), &s);
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+	if (m_tables.empty())
+	{
+		r = sqlite3session_attach(s, nullptr);
+	}
+	for (auto& t : m_tables)
+	{
+		r = sqlite3session_attach(s, t.c_str());
+		if (r != SQLITE_OK)
+		{
+			break;
+		}
+	}
+	if (r != SQLITE_OK)
+	{
+		sqlite3session_delete(s);
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+	m_session = s;
+}
+
+void ChangeStream::capture()
+{
+	m_staged.clear();
+	if (!m_session || sqlite3session_isempty(m_session))
+	{
+		return;
+	}
+	int sz = 0;
+	void* p = nullptr;
+	int r = m_patchset ? sqlite3session_patchset(m_session, &sz, &p) : sqlite3session_changeset(m_session, &sz, &p);
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+	m_staged.assign(static_cast<char*>(p), static_cast<char*>(p)+sz);
+	sqlite3_free(p);
+}
+
+void ChangeStream::publish()
+{
+	if (!m_staged.empty())
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_bytes += m_staged.size();
+		m_sets.push_back(std::move(m_staged));
+	}
+	m_staged.clear();
+
+	if (!m_session)
+	{
+		return;
+	}
+
+	// there is no way to reset a session, so start a new one for the next transaction; the changes are
+	// committed, so a failure stops the stream rather than throwing
+	sqlite3session_delete(m_session);
+	m_session = nullptr;
+	try
+	{
+		create();
+	}
+	catch (const std::exception& e)
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_error = e.what();
+	}
+}
+
+void ChangeStream::detach(const std::string& why)
+{
+	if (m_session)
+	{
+		sqlite3session_delete(m_session);
+		m_session = nullptr;
+	}
+	m_staged.clear();
+	std::lock_guard<std::mutex> lk(m_mx);
+	if (m_error.empty())
+	{
+		m_error = why;
+	}
+}
+
+void ChangeStream::flush()
+{
+	if (!m_session)
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		throw std::runtime_error("flush() change stream stopped: " + m_error);
+	}
+	if (!sqlite3_get_autocommit(m_conn.m_db))
+	{
+		throw std::runtime_error("flush() change stream in a transaction");
+	}
+	capture();
+	publish();
+}
+
+bool ChangeStream::next(std::vector<char>& buf)
+{
+	std::lock_guard<std::mutex> lk(m_mx);
+	if (m_sets.empty())
+	{
+		if (!m_error.empty())
+		{
+			throw std::runtime_error("change stream stopped: " + m_error);
+		}
+		return false;
+	}
+	buf = std::move(m_sets.front());
+	m_sets.pop_front();
+	m_bytes -= buf.size();
+	return true;
+}
+
+size_t ChangeStream::pending() const
+{
+	std::lock_guard<std::mutex> lk(m_mx);
+	return m_sets.size();
+}
+
+size_t ChangeStream::pending_bytes() const
+{
+	std::lock_guard<std::mutex> lk(m_mx);
+	return m_bytes;
+}
+
+static int on_conflict(void* ctx, int type, sqlite3_changeset_iter*)
+{
+	switch (*static_cast<Conflict*>(ctx))
+	{
+	case Conflict::omit:
+		return SQLITE_CHANGESET_OMIT;
+	case Conflict::replace:
+		// only changes to a row which exists with other values can replace it
+		if (type == SQLITE_CHANGESET_DATA || type == SQLITE_CHANGESET_CONFLICT)
+		{
+			return SQLITE_CHANGESET_REPLACE;
+		}
+		return SQLITE_CHANGESET_OMIT;
+	default:
+		return SQLITE_CHANGESET_ABORT;
+	}
+}
+
+void ChangeStream::apply(Conn& conn, const std::vector<char>& changes, Conflict conflict)
+{
+	int r = sqlite3changeset_apply(conn.m_db, changes.size(), const_cast<char*>(changes.data()), nullptr,
+		&on_conflict, &conflict);
+	if (r == SQLITE_ABORT)
+	{
+		throw std::runtime_error("changeset conflict");
+	}
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errmsg(conn.m_db));
+	}
+}
@@ -0,0 +1,410 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/config.h>
+#include <sqlite/sqld.h>
+#include <sqlite3.h>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite process-level configuration implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+/*
+	Allocator counters, one set per thread, written only by the owning thread so that counting does not
+	share cache lines between threads. Counts of exited threads are added to the retired set.
+*/
+enum { c_allocs, c_frees, c_sys_allocs, c_sys_frees, c_count };
+
+struct Counters
+{
+	std::atomic<uint64_t> v[c_count];
+};
+
+static std::mutex reg_mx;
+static std::vector<Counters*> reg;
+static Counters retired;
+
+/*
+	Pool blocks have an 8 byte header with the usable size, so the user pointer keeps the 8 byte alignment
+	sqlite requires. Small sizes are rounded up to 16 byte steps, larger sizes to powers of two, and
+	blocks larger than the biggest class go directly to the system allocator.
+*/
+static const size_t header = 8;
+static const int nclasses = 16+5;						// 16 to 256 by 16, 512 to 8192
+static const size_t max_class = 8192;
+static const size_t cache_bytes = 64*1024;				// per class, per thread
+
+struct ThreadCache										// trivially destructible, usable while the thread exits
+{
+	void* free[nclasses];
+	uint32_t count[nclasses];
+};
+
+static thread_local ThreadCache tcache;
+static thread_local Counters* tcount;
+static thread_local bool tdead;
+
+static size_t class_size(int k)
+{
+	return k < 16 ? (k+1)*16 : size_t(256) << (k-15);
+}
+
+static int size_class(size_t n)
+{
+	if (n <= 256)
+	{
+		return n == 0 ? 0 : (n+15)/16-1;
+	}
+	if (n > max_class)
+	{
+		return -1;
+	}
+	return 16 + (64-__builtin_clzll(n-1)) - 9;
+}
+
+static uint32_t max_cached(int k)
+{
+	return std::max(size_t(16), cache_bytes/class_size(k));
+}
+
+static void bump(Counters* c, int i)
+{
+	if (c == &retired)
+	{
+		c->v[i].fetch_add(1, std::memory_order_relaxed);
+	}
+	else
+	{
+		c->v[i].store(c->v[i].load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+	}
+}
+
+static void drain(Counters* c)
+{
+	for (int k = 0; k < nclasses; k++)
+	{
+		while (void* b = tcache.free[k])
+		{
+			tcache.free[k] = *reinterpret_cast<void**>(static_cast<char*>(b)+header);
+			free(b);
+			bump(c, c_sys_frees);
+		}
+		tcache.count[k] = 0;
+	}
+}
+
+struct Reaper
+{
+	~Reaper()
+	{
+		drain(tcount);
+
+		std::lock_guard<std::mutex> lk(reg_mx);
+		for (int i = 0; i < c_count; i++)
+		{
+			retired.v[i].fetch_add(tcount->v[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+		reg.erase(std::find(reg.begin(), reg.end(), tcount));
+		delete tcount;
+		tcount = nullptr;
+		tdead = true;
+	}
+};
+
+static Counters* counters()
+{
+	if (tcount)
+	{
+		return tcount;
+	}
+	if (tdead)
+	{
+		return &retired;
+	}
+
+	static thread_local Reaper reaper;		// drains the cache and retires the counters at thread exit
+	(void)reaper;
+
+	tcount = new Counters();
+	std::lock_guard<std::mutex> lk(reg_mx);
+	reg.push_back(tcount);
+	return tcount;
+}
+
+static size_t block_size(void* p)
+{
+	return *reinterpret_cast<uint64_t*>(static_cast<char*>(p)-header);
+}
+
+template <bool Pool>
+static void* block_alloc(Counters* c, size_t n)
+{
+	int k = size_class(n);
+	size_t sz = k >= 0 ? class_size(k) : (n+7) & ~size_t(7);
+
+	if (Pool && k >= 0 && !tdead)
+	{
+		if (void* b = tcache.free[k])
+		{
+			tcache.free[k] = *reinterpret_cast<void**>(static_cast<char*>(b)+header);
+			tcache.count[k]--;
+			return static_cast<char*>(b)+header;
+		}
+	}
+
+	bump(c, c_sys_allocs);
+	char* b = static_cast<char*>(malloc(header+sz));
+	if (!b)
+	{
+		return nullptr;
+	}
+	*reinterpret_cast<uint64_t*>(b) = sz;
+	return b+header;
+}
+
+template <bool Pool>
+static void block_free(Counters* c, void* p)
+{
+	char* b = static_cast<char*>(p)-header;
+	int k = size_class(block_size(p));
+
+	if (Pool && k >= 0 && !tdead && tcache.count[k] < max_cached(k))
+	{
+		*reinterpret_cast<void**>(p) = tcache.free[k];
+		tcache.free[k] = b;
+		tcache.count[k]++;
+		return;
+	}
+
+	bump(c, c_sys_frees);
+	free(b);
+}
+
+template <bool Pool>
+static void* mem_malloc(int n)
+{
+	Counters* c = counters();
+	bump(c, c_allocs);
+	return block_alloc<Pool>(c, n);
+}
+
+template <bool Pool>
+static void mem_free(void* p)
+{
+	Counters* c = counters();
+	bump(c, c_frees);
+	block_free<Pool>(c, p);
+}
+
+template <bool Pool>
+static void* mem_realloc(void* p, int n)
+{
+	Counters* c = counters();
+	bump(c, c_allocs);
+
+	size_t old = block_size(p);
+	int k = size_class(n);
+	if (k >= 0 ? class_size(k) == old : old > max_class && old >= size_t(n))
+	{
+		return p;							// fits in the same block
+	}
+
+	if (k < 0 && old > max_class)			// both too large for the pool
+	{
+		size_t sz = (n+7) & ~size_t(7);
+		bump(c, c_sys_allocs);
+		char* b = static_cast<char*>(realloc(static_cast<char*>(p)-header, header+sz));
+		if (!b)
+		{
+			return nullptr;
+		}
+		*reinterpret_cast<uint64_t*>(b) = sz;
+		return b+header;
+	}
+
+	void* np = block_alloc<Pool>(c, n);
+	if (!np)
+	{
+		return nullptr;
+	}
+	memcpy(np, p, std::min(old, size_t(n)));
+	block_free<Pool>(c, p);
+	return np;
+}
+
+static int mem_size(void* p)
+{
+	return block_size(p);
+}
+
+static int mem_roundup(int n)
+{
+	int k = size_class(n);
+	return k >= 0 ? class_size(k) : (n+7) & ~7;
+}
+
+static int mem_init(void*)
+{
+	return SQLITE_OK;
+}
+
+template <bool Pool>
+static void mem_shutdown(void*)
+{
+	if (Pool && !tdead)
+	{
+		drain(counters());					// only the calling thread's cache can be reached
+	}
+}
+
+template <bool Pool>
+static const sqlite3_mem_methods methods =
+{
+	&mem_malloc<Pool>,
+	&mem_free<Pool>,
+	&mem_realloc<Pool>,
+	&mem_size,
+	&mem_roundup,
+	&mem_init,
+	&mem_shutdown<Pool>,
+	nullptr
+};
+
+static int default_pcache_pages = 20;				// SQLITE_DEFAULT_PCACHE_INITSZ
+
+void Config::init() const
+{
+	static std::mutex mx;
+	static sqlite3_mem_methods defaults;
+	static std::unique_ptr<uint64_t[]> pagecache;
+
+	std::lock_guard<std::mutex> lk(mx);
+
+	if (Conn::open_conns() > 0)
+	{
+		throw std::runtime_error("configuration changed while connections are open");
+	}
+
+	int r = sqlite3_shutdown();
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+
+	sqlite3_mem_methods cur;
+	sqlite3_config(SQLITE_CONFIG_GETMALLOC, &cur);
+	if (cur.xMalloc != methods<true>.xMalloc && cur.xMalloc != methods<false>.xMalloc)
+	{
+		defaults = cur;								// may be empty before the first initialization
+	}
+
+	auto config = [](int r)
+	{
+		if (r != SQLITE_OK)
+		{
+			throw std::runtime_error(sqlite3_errstr(r));
+		}
+	};
+
+	switch (allocator)
+	{
+	case Allocator::sqlite:
+		config(sqlite3_config(SQLITE_CONFIG_MALLOC, &defaults));
+		break;
+	case Allocator::system:
+		config(sqlite3_config(SQLITE_CONFIG_MALLOC, &methods<false>));
+		break;
+	case Allocator::pool:
+		config(sqlite3_config(SQLITE_CONFIG_MALLOC, &methods<true>));
+		break;
+	}
+
+	config(sqlite3_config(SQLITE_CONFIG_MEMSTATUS, memstatus ? 1 : 0));
+
+	if (pagecache_pages > 0)
+	{
+		int hdr = 0;
+		config(sqlite3_config(SQLITE_CONFIG_PCACHE_HDRSZ, &hdr));
+		int sz = (page_size+hdr+7) & ~7;
+		pagecache.reset(new uint64_t[size_t(sz)/8*pagecache_pages]);
+		config(sqlite3_config(SQLITE_CONFIG_PAGECACHE, pagecache.get(), sz, pagecache_pages));
+	}
+	else
+	{
+		config(sqlite3_config(SQLITE_CONFIG_PAGECACHE, nullptr, 0, default_pcache_pages));
+		pagecache.reset();
+	}
+
+	config(sqlite3_config(SQLITE_CONFIG_LOOKASIDE, lookaside_slot_size, lookaside_slots));
+
+	config(sqlite3_initialize());
+}
+
+AllocStats Config::alloc_stats()
+{
+	std::lock_guard<std::mutex> lk(reg_mx);
+
+	uint64_t v[c_count];
+	for (int i = 0; i < c_count; i++)
+	{
+		v[i] = retired.v[i].load(std::memory_order_relaxed);
+		for (auto c : reg)
+		{
+			v[i] += c->v[i].load(std::memory_order_relaxed);
+		}
+	}
+	return AllocStats{v[c_allocs], v[c_frees], v[c_sys_allocs], v[c_sys_frees]};
+}
+
+void Config::reset_alloc_stats()
+{
+	std::lock_guard<std::mutex> lk(reg_mx);
+
+	// counts made concurrently by other threads may survive the reset
+	for (int i = 0; i < c_count; i++)
+	{
+		retired.v[i].store(0, std::memory_order_relaxed);
+		for (auto c : reg)
+		{
+			c->v[i].store(0, std::memory_order_relaxed);
+		}
+	}
+}
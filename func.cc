@@ -0,0 +1,208 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite3.h>
+#include <string>
+#include <memory>
+#include <stdexcept>
+#include <new>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite user-defined function implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+void FuncCall::check_arg(int i) const
+{
+	if (i < 0 || i >= m_argc)
+	{
+		throw std::runtime_error("function argument out of range");
+	}
+}
+
+bool FuncCall::is_null(int i) const
+{
+	check_arg(i);
+	return sqlite3_value_type(m_argv[i]) == SQLITE_NULL;
+}
+
+int FuncCall::get_int(int i) const
+{
+	check_arg(i);
+	return sqlite3_value_int(m_argv[i]);
+}
+
+int64_t FuncCall::get_int64(int i) const
+{
+	check_arg(i);
+	return sqlite3_value_int64(m_argv[i]);
+}
+
+double FuncCall::get_real(int i) const
+{
+	check_arg(i);
+	return sqlite3_value_double(m_argv[i]);
+}
+
+std::string_view FuncCall::get_text(int i) const
+{
+	check_arg(i);
+	auto p = reinterpret_cast<const char*>(sqlite3_value_text(m_argv[i]));		// text first, then size
+	return std::string_view(p ? p : "", sqlite3_value_bytes(m_argv[i]));
+}
+
+std::span<const std::byte> FuncCall::get_blob(int i) const
+{
+	check_arg(i);
+	auto p = static_cast<const std::byte*>(sqlite3_value_blob(m_argv[i]));
+	return std::span<const std::byte>(p, p ? sqlite3_value_bytes(m_argv[i]) : 0);
+}
+
+void FuncCall::result_int(int v)
+{
+	sqlite3_result_int(m_ctx, v);
+}
+
+void FuncCall::result_int64(int64_t v)
+{
+	sqlite3_result_int64(m_ctx, v);
+}
+
+void FuncCall::result_real(double v)
+{
+	sqlite3_result_double(m_ctx, v);
+}
+
+void FuncCall::result_text(std::string_view v)
+{
+	sqlite3_result_text64(m_ctx, v.data(), v.size(), SQLITE_TRANSIENT, SQLITE_UTF8);
+}
+
+void FuncCall::result_blob(const void* v, size_t sz)
+{
+	sqlite3_result_blob64(m_ctx, v, sz, SQLITE_TRANSIENT);
+}
+
+void FuncCall::result_null()
+{
+	sqlite3_result_null(m_ctx);
+}
+
+void FuncCall::result_error(const char* msg)
+{
+	sqlite3_result_error(m_ctx, msg, -1);
+}
+
+void** FuncCall::state(bool create)
+{
+	return static_cast<void**>(sqlite3_aggregate_context(m_ctx, create ? sizeof(void*) : 0));
+}
+
+/*
+	Callbacks from sqlite. Exceptions must not propagate into sqlite, they are returned as function errors.
+*/
+static void call(std::function<void(FuncCall&)> FuncDef::* cb, sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+	auto def = static_cast<FuncDef*>(sqlite3_user_data(ctx));
+	FuncCall c(ctx, argc, argv);
+	try
+	{
+		(def->*cb)(c);
+	}
+	catch (const std::bad_alloc&)
+	{
+		sqlite3_result_error_nomem(ctx);
+	}
+	catch (const std::exception& e)
+	{
+		c.result_error(e.what());
+	}
+	catch (...)
+	{
+		c.result_error("unknown exception in user-defined function");
+	}
+}
+
+static void x_func(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+	call(&FuncDef::func, ctx, argc, argv);
+}
+
+static void x_step(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+	call(&FuncDef::step, ctx, argc, argv);
+}
+
+static void x_inverse(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+	call(&FuncDef::inverse, ctx, argc, argv);
+}
+
+static void x_final(sqlite3_context* ctx)
+{
+	call(&FuncDef::final, ctx, 0, nullptr);
+}
+
+static void x_value(sqlite3_context* ctx)
+{
+	call(&FuncDef::value, ctx, 0, nullptr);
+}
+
+static void x_destroy(void* p)
+{
+	delete static_cast<FuncDef*>(p);
+}
+
+void Conn::register_function(const std::string& name, int nargs, bool deterministic, std::unique_ptr<FuncDef> def)
+{
+	int flags = SQLITE_UTF8 | (deterministic ? SQLITE_DETERMINISTIC : 0);
+
+	FuncDef* p = def.release();		// owned by sqlite, which calls x_destroy when the function is replaced or fails to register
+	int r;
+	if (p->func)
+	{
+		r = sqlite3_create_function_v2(m_db, name.c_str(), nargs, flags, p, x_func, nullptr, nullptr, x_destroy);
+	}
+	else if (p->inverse)
+	{
+		r = sqlite3_create_window_function(m_db, name.c_str(), nargs, flags, p, x_step, x_final, x_value, x_inverse, x_destroy);
+	}
+	else
+	{
+		r = sqlite3_create_function_v2(m_db, name.c_str(), nargs, flags, p, nullptr, x_step, x_final, x_destroy);
+	}
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errmsg(m_db));
+	}
+}
@@ -0,0 +1,166 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/image.h>
+#include <sqlite/sqld.h>
+#include <sqlite3.h>
+#include <string>
+#include <cstring>
+#include <system_error>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite database image implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+/*
+	Bytes 18 and 19 of the header are the read and write file format versions, 2 for a database in WAL mode.
+	The memdb vfs cannot open a WAL, so an image in WAL mode is changed to rollback mode (1) before it is used.
+*/
+static bool is_wal(const unsigned char* p, size_t sz)
+{
+	return sz >= 20 && (p[18] == 2 || p[19] == 2);
+}
+
+static void clear_wal(unsigned char* p, size_t sz)
+{
+	if (is_wal(p, sz))
+	{
+		p[18] = 1;
+		p[19] = 1;
+	}
+}
+
+std::vector<char> Conn::serialize()
+{
+	sqlite3_int64 sz = 0;
+
+	// in-memory databases are contiguous, and can be copied directly
+	auto p = reinterpret_cast<char*>(sqlite3_serialize(m_db, "main", &sz, SQLITE_SERIALIZE_NOCOPY));
+	if (p)
+	{
+		return std::vector<char>(p, p+sz);
+	}
+
+	p = reinterpret_cast<char*>(sqlite3_serialize(m_db, "main", &sz, 0));
+	if (!p)
+	{
+		throw std::runtime_error(sqlite3_errmsg(m_db));
+	}
+	std::vector<char> v(p, p+sz);
+	sqlite3_free(p);
+	return v;
+}
+
+void Conn::deserialize(std::span<const std::byte> image, bool readonly)
+{
+	{
+		std::lock_guard<std::mutex> lk(m_cache_mx);
+		cache_flush();
+	}
+
+	unsigned char* data;
+	unsigned flags;
+	if (readonly)
+	{
+		data = const_cast<unsigned char*>(reinterpret_cast<const unsigned char*>(image.data()));	// never written
+		if (is_wal(data, image.size()))
+		{
+			throw std::runtime_error("read-only deserialize of a WAL mode image, use a MappedImage or a copy");
+		}
+		flags = SQLITE_DESERIALIZE_READONLY;
+	}
+	else
+	{
+		data = static_cast<unsigned char*>(sqlite3_malloc64(image.size() ? image.size() : 1));
+		if (!data)
+		{
+			throw std::runtime_error(sqlite3_errstr(SQLITE_NOMEM));
+		}
+		memcpy(data, image.data(), image.size());
+		clear_wal(data, image.size());
+		flags = SQLITE_DESERIALIZE_FREEONCLOSE|SQLITE_DESERIALIZE_RESIZEABLE;
+	}
+
+	int r = sqlite3_deserialize(m_db, "main", data, image.size(), image.size(), flags);		// frees a copy on failure
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+	result_cache_reset();
+}
+
+MappedImage::MappedImage(const std::string& path) : m_addr(nullptr), m_size(0)
+{
+	int fd = ::open(path.c_str(), O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+	{
+		throw std::system_error(errno, std::system_category(), path);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+	{
+		int e = errno;
+		::close(fd);
+		throw std::system_error(e, std::system_category(), path);
+	}
+	m_size = st.st_size;
+
+	if (m_size > 0)
+	{
+		// private and writable, so the header of a WAL mode file can be changed in a copy of the first page
+		m_addr = mmap(nullptr, m_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (m_addr == MAP_FAILED)
+		{
+			int e = errno;
+			::close(fd);
+			m_addr = nullptr;
+			throw std::system_error(e, std::system_category(), path);
+		}
+		clear_wal(static_cast<unsigned char*>(m_addr), m_size);
+	}
+	::close(fd);				// the mapping stays valid
+}
+
+MappedImage::~MappedImage()
+{
+	if (m_addr)
+	{
+		munmap(m_addr, m_size);
+	}
+}
@@ -0,0 +1,300 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/maint.h>
+#include <sqlite/pool.h>
+#include <sqlite3.h>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite background maintenance implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+using std::chrono::steady_clock;
+using std::chrono::nanoseconds;
+
+static int64_t pragma_int(Conn& conn, const std::string& sql)
+{
+	Req req(conn);
+	req.sql() << sql;
+	if (req.exec_select() != 1)
+	{
+		throw std::runtime_error(sql + " returned no value");
+	}
+	return req.col_int64(0);
+}
+
+Maintenance::Maintenance(Conn& conn, const MaintenanceOptions& opts) : m_opts(opts), m_pool(nullptr), m_writer(&conn),
+	m_autocheckpoint(0), m_stop(false), m_wake(false), m_frames(0), m_backfilled(0), m_last_commit(steady_clock::now()),
+	m_stats{0, 0, 0, nanoseconds(0), nanoseconds(0), nanoseconds(0), 0, 0, 0, 0, 0, 0, 0}
+{
+	const char* path = sqlite3_db_filename(conn.m_db, "main");
+	if (!path || !*path)
+	{
+		throw std::runtime_error("maintenance requires a file database");
+	}
+	start(path);
+}
+
+Maintenance::Maintenance(ConnPool& pool, const MaintenanceOptions& opts) : m_opts(opts), m_pool(&pool), m_writer(nullptr),
+	m_autocheckpoint(0), m_stop(false), m_wake(false), m_frames(0), m_backfilled(0), m_last_commit(steady_clock::now()),
+	m_stats{0, 0, 0, nanoseconds(0), nanoseconds(0), nanoseconds(0), 0, 0, 0, 0, 0, 0, 0}
+{
+	auto l = pool.writer();				// the writer is not used by other threads while attaching
+	m_writer = &l.conn();
+	start(pool.path());
+}
+
+void Maintenance::start(const std::string& path)
+{
+	m_conn.reset(new Conn(path));				// the uri flag is added, but a plain file name is not a uri
+	m_conn->busy_policy(BusyPolicy::fixed(m_opts.busy_timeout));
+
+	Req req(*m_conn);
+	req.sql() << "PRAGMA journal_mode;";
+	if (req.exec_select() != 1 || req.col_text_view(0) != "wal")
+	{
+		throw std::runtime_error("maintenance requires a database in WAL mode");
+	}
+	req.clear();
+
+	m_autocheckpoint = pragma_int(*m_writer, "PRAGMA wal_autocheckpoint;");		// 0 if disabled or replaced by a hook
+	sqlite3_wal_hook(m_writer->m_db, &Maintenance::wal_hook, this);		// replaces the automatic checkpoint
+	m_thread = std::thread(&Maintenance::run, this);
+}
+
+Maintenance::~Maintenance()
+{
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_stop = true;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+
+	if (m_pool)
+	{
+		auto l = m_pool->writer();
+		sqlite3_wal_autocheckpoint(l.conn().m_db, m_autocheckpoint);
+	}
+	else
+	{
+		sqlite3_wal_autocheckpoint(m_writer->m_db, m_autocheckpoint);
+	}
+}
+
+int Maintenance::wal_hook(void* ctx, sqlite3*, const char* db, int frames)
+{
+	if (strcmp(db, "main") != 0)
+	{
+		return SQLITE_OK;
+	}
+
+	Maintenance* m = static_cast<Maintenance*>(ctx);
+	bool wake = false;
+	{
+		std::lock_guard<std::mutex> lk(m->m_mx);
+		if (frames < m->m_frames)
+		{
+			m->m_backfilled = 0;			// the WAL was restarted from the beginning
+		}
+		m->m_frames = frames;
+		m->m_last_commit = steady_clock::now();
+		m->m_stats.wal_pages = frames;
+		m->m_stats.max_wal_pages = std::max(m->m_stats.max_wal_pages, m->m_stats.wal_pages);
+		if (!m->m_wake && frames-m->m_backfilled >= m->m_opts.wal_pages)
+		{
+			m->m_wake = true;
+			wake = true;
+		}
+	}
+	if (wake)
+	{
+		m->m_cv.notify_one();
+	}
+	return SQLITE_OK;
+}
+
+void Maintenance::run()
+{
+	auto next_optimize = steady_clock::now() + m_opts.optimize_interval;
+	auto next_vacuum = steady_clock::now() + m_opts.vacuum_interval;
+
+	std::unique_lock<std::mutex> lk(m_mx);
+	while (1)
+	{
+		m_cv.wait_for(lk, m_opts.interval, [this]() { return m_stop || m_wake; });
+		if (m_stop)
+		{
+			break;
+		}
+		m_wake = false;
+		lk.unlock();
+
+		checkpoint();
+
+		auto now = steady_clock::now();
+		if (m_opts.optimize_interval.count() > 0 && now >= next_optimize)
+		{
+			optimize();
+			next_optimize = now + m_opts.optimize_interval;
+		}
+		if (m_opts.vacuum_interval.count() > 0 && now >= next_vacuum)
+		{
+			vacuum();
+			next_vacuum = now + m_opts.vacuum_interval;
+		}
+
+		lk.lock();
+	}
+}
+
+void Maintenance::checkpoint()
+{
+	int64_t frames;
+	bool idle;
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		frames = m_frames;
+		if (frames-m_backfilled <= 0)
+		{
+			return;
+		}
+		idle = m_opts.idle.count() > 0 && steady_clock::now()-m_last_commit >= m_opts.idle;
+		if (frames-m_backfilled < m_opts.wal_pages && !idle)
+		{
+			return;
+		}
+	}
+
+	int mode = SQLITE_CHECKPOINT_PASSIVE;
+	if (frames >= m_opts.truncate_pages)
+	{
+		mode = SQLITE_CHECKPOINT_TRUNCATE;
+	}
+	else if (frames >= m_opts.restart_pages)
+	{
+		mode = SQLITE_CHECKPOINT_RESTART;
+	}
+
+	int log = -1, ckpt = -1;
+	auto st = steady_clock::now();
+	int r = sqlite3_wal_checkpoint_v2(m_conn->m_db, "main", mode, &log, &ckpt);
+	auto ns = std::chrono::duration_cast<nanoseconds>(steady_clock::now()-st);
+
+	std::lock_guard<std::mutex> lk(m_mx);
+	m_stats.checkpoints++;
+	if (mode != SQLITE_CHECKPOINT_PASSIVE)
+	{
+		m_stats.escalations++;
+	}
+	m_stats.last_checkpoint = ns;
+	m_stats.max_checkpoint = std::max(m_stats.max_checkpoint, ns);
+	m_stats.total_checkpoint += ns;
+
+	if (r != SQLITE_OK && r != SQLITE_BUSY)
+	{
+		m_stats.errors++;
+		return;
+	}
+	if (r == SQLITE_BUSY || ckpt < log)
+	{
+		m_stats.incomplete++;
+	}
+	m_stats.backfilled_pages = std::max(ckpt, 0);
+	if (m_frames == frames)				// otherwise there has been a commit, which may have restarted the WAL
+	{
+		m_backfilled = mode == SQLITE_CHECKPOINT_TRUNCATE && r == SQLITE_OK ? frames : ckpt;
+	}
+}
+
+void Maintenance::optimize()
+{
+	try
+	{
+		Req req(*m_conn);
+		req.sql() << "PRAGMA analysis_limit=" << m_opts.analysis_limit << "; ANALYZE;";
+		req.exec();
+
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_stats.optimizes++;
+	}
+	catch (const std::exception&)
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_stats.errors++;
+	}
+}
+
+void Maintenance::vacuum()
+{
+	try
+	{
+		if (pragma_int(*m_conn, "PRAGMA auto_vacuum;") != 2)		// incremental
+		{
+			return;
+		}
+		int64_t before = pragma_int(*m_conn, "PRAGMA freelist_count;");
+		if (before == 0)
+		{
+			return;
+		}
+
+		// each page removed returns an empty row, so the statement is run to completion by sqlite3_exec
+		std::string sql = "PRAGMA incremental_vacuum(" + std::to_string(m_opts.vacuum_pages) + ");";
+		if (sqlite3_exec(m_conn->m_db, sql.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK)
+		{
+			throw std::runtime_error(sqlite3_errmsg(m_conn->m_db));
+		}
+
+		int64_t after = pragma_int(*m_conn, "PRAGMA freelist_count;");
+
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_stats.vacuums++;
+		m_stats.vacuumed_pages += before-after;
+	}
+	catch (const std::exception&)
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_stats.errors++;
+	}
+}
+
+MaintenanceStats Maintenance::stats()
+{
+	std::lock_guard<std::mutex> lk(m_mx);
+	return m_stats;
+}
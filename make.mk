@@ -41,4 +41,6 @@ else
 SLIBS := -lsccsqlite $(SLIBS)
 endif
 
+SLIBS := $(SLIBS) -lpthread # threads used by the pool
+
 endif
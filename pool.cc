@@ -0,0 +1,210 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/pool.h>
+#include <sqlite3.h>
+#include <string>
+#include <system_error>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite connection pool implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+using std::chrono::steady_clock;
+using std::chrono::nanoseconds;
+
+/*
+	Escape characters which have a meaning in a uri filename.
+*/
+static std::string uri_path(const std::string& path)
+{
+	std::string uri("file:");
+	for (char c : path)
+	{
+		switch (c)
+		{
+		case '%': uri += "%25"; break;
+		case '?': uri += "%3f"; break;
+		case '#': uri += "%23"; break;
+		default: uri += c;
+		}
+	}
+	return uri;
+}
+
+ConnPool::ConnPool(const std::string& path, int readers) : m_path(path), m_opened(steady_clock::now())
+{
+	if (readers < 1)
+	{
+		throw std::runtime_error("connection pool requires at least one reader");
+	}
+
+	std::string uri = uri_path(path);
+
+	// each connection is leased to one thread at a time, so the sqlite connection mutex is not needed
+	Conn::Options opts;
+	opts.flags = SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE|SQLITE_OPEN_NOMUTEX;
+
+	/*
+		The writer creates the database and sets WAL mode, which is persistent, before the readers are opened.
+	*/
+	m_writer.conns.emplace_back(new Conn(uri+"?mode=rwc&cache=private", opts));
+
+	Req req(*m_writer.conns.back());
+	req.sql() << "PRAGMA journal_mode=WAL;";
+	if (req.exec_select() != 1 || req.col_text_view(0) != "wal")
+	{
+		throw std::runtime_error("connection pool database does not support WAL mode");
+	}
+	req.clear();
+
+	for (int i = 0; i < readers; i++)
+	{
+		m_readers.conns.emplace_back(new Conn(uri+"?mode=ro&cache=private", opts));
+	}
+
+	for (auto g : {&m_readers, &m_writer})
+	{
+		for (auto& c : g->conns)
+		{
+			g->avail.push_back(c.get());
+		}
+		g->stats = {0, 0, nanoseconds(0), nanoseconds(0), 0};
+		g->busy = nanoseconds(0);
+		g->active_start = nanoseconds(0);
+	}
+}
+
+ConnPool::~ConnPool()
+{
+}
+
+Conn* ConnPool::acquire(Group& g, steady_clock::time_point& start)
+{
+	std::unique_lock<std::mutex> lk(m_mx);
+
+	g.stats.leases++;
+
+	if (g.avail.empty())
+	{
+		auto st = steady_clock::now();
+
+		g.cv.wait(lk, [&g]() { return !g.avail.empty(); });
+
+		nanoseconds w = steady_clock::now()-st;
+		g.stats.waits++;
+		g.stats.wait_time += w;
+		if (w > g.stats.max_wait)
+		{
+			g.stats.max_wait = w;
+		}
+	}
+
+	Conn* c = g.avail.back();
+	g.avail.pop_back();
+	start = steady_clock::now();
+	g.active_start += start.time_since_epoch();
+	return c;
+}
+
+void ConnPool::release(Group& g, Conn* c, steady_clock::time_point start)
+{
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+
+		g.avail.push_back(c);
+		g.busy += steady_clock::now()-start;
+		g.active_start -= start.time_since_epoch();
+	}
+	g.cv.notify_one();
+}
+
+PoolStats ConnPool::stats(Group& g)
+{
+	std::lock_guard<std::mutex> lk(m_mx);
+
+	auto now = steady_clock::now();
+	int active = g.conns.size()-g.avail.size();
+
+	/*
+		Time in use is the time of returned leases, plus the time so far of active leases.
+	*/
+	nanoseconds busy = g.busy + active*now.time_since_epoch() - g.active_start;
+	nanoseconds total = (now-m_opened)*g.conns.size();
+
+	PoolStats st = g.stats;
+	st.utilization = total.count() > 0 ? static_cast<double>(busy.count())/total.count() : 0;
+	return st;
+}
+
+ConnPool::Lease ConnPool::reader()
+{
+	steady_clock::time_point start;
+	Conn* c = acquire(m_readers, start);
+	return Lease(this, &m_readers, c, start);
+}
+
+ConnPool::Lease ConnPool::writer()
+{
+	steady_clock::time_point start;
+	Conn* c = acquire(m_writer, start);
+	return Lease(this, &m_writer, c, start);
+}
+
+PoolStats ConnPool::reader_stats()
+{
+	return stats(m_readers);
+}
+
+PoolStats ConnPool::writer_stats()
+{
+	return stats(m_writer);
+}
+
+ConnPool::Lease::Lease(ConnPool* pool, Group* group, Conn* conn, steady_clock::time_point start)
+	: m_pool(pool), m_group(group), m_conn(conn), m_start(start)
+{
+}
+
+ConnPool::Lease::Lease(Lease&& other)
+	: m_pool(other.m_pool), m_group(other.m_group), m_conn(other.m_conn), m_start(other.m_start)
+{
+	other.m_conn = nullptr;
+}
+
+ConnPool::Lease::~Lease()
+{
+	if (m_conn)
+	{
+		m_pool->release(*m_group, m_conn, m_start);
+	}
+}
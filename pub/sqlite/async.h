@@ -0,0 +1,314 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_ASYNC_H
+#define _SCC_SQLD_ASYNC_H
+
+#include <sqlite/sqld.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <functional>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <variant>
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Asynchronous connection.
+	\file
+*/
+
+class AsyncConn;
+
+/** Asynchronous operation on an AsyncConn.
+
+	Either awaited in a coroutine, or started with future(). Each operation is started once; an operation
+	which is neither awaited nor started does nothing.
+
+	When awaited, the coroutine is resumed by the resume hook of the connection, or on the executor
+	thread if no hook is set.
+*/
+template <typename T>
+class AsyncOp
+{
+	using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+	AsyncConn& m_conn;
+	std::function<T(Conn&)> m_fn;
+	std::optional<Value> m_val;
+	std::exception_ptr m_err;
+
+	friend class AsyncConn;
+	AsyncOp(AsyncConn& conn, std::function<T(Conn&)> fn) : m_conn(conn), m_fn(std::move(fn)) {}
+public:
+	AsyncOp(AsyncOp&&) = default;
+	AsyncOp(const AsyncOp&) = delete;
+	AsyncOp& operator=(const AsyncOp&) = delete;
+	AsyncOp& operator=(AsyncOp&&) = delete;
+
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(std::coroutine_handle<>);
+	T await_resume()
+	{
+		if (m_err)
+		{
+			std::rethrow_exception(m_err);
+		}
+		if constexpr (!std::is_void_v<T>)
+		{
+			return std::move(*m_val);
+		}
+	}
+
+	/** Queue the operation, and return a future for the result. */
+	std::future<T> future();
+};
+
+/** Asynchronous connection.
+
+	An executor thread owns the connection and runs queued operations in FIFO order, so the calling threads
+	do not block on the database. Operations are awaitable from coroutines, or return a std::future:
+
+	    AsyncConn db("file:data.db?mode=rwc");
+
+	    db.exec("create table t(id INTEGER, name TEXT);").future().get();
+
+	    Task handler(AsyncConn& db)			// some coroutine type
+	    {
+	        co_await db.exec("insert into t values(?, ?);", 1, "one");
+	        auto v = co_await db.select<int, std::string>("select id, name from t;");
+	        ...
+	    }
+
+	Use call() to run any copyable function on the executor thread with the connection:
+
+	    auto f = db.call([](Conn& c) { ... return x; }).future();
+
+	Arguments are copied into the operation, strings as std::string. Operations queued before the
+	connection is destroyed are run before the executor thread exits.
+*/
+class AsyncConn
+{
+	struct Job
+	{
+		virtual ~Job() {}
+		virtual void run(Conn&) = 0;
+	};
+	template <typename F>
+	struct JobFn : public Job
+	{
+		F fn;
+		JobFn(F&& f) : fn(std::move(f)) {}
+		void run(Conn& c) { fn(c); }
+	};
+
+	Conn m_conn;
+	std::mutex m_mx;
+	std::condition_variable m_cv;
+	std::deque<std::unique_ptr<Job>> m_queue;
+	bool m_stop;
+	std::function<void(std::coroutine_handle<>)> m_resume;
+	std::thread m_thread;
+
+	template <typename> friend class AsyncOp;
+
+	void run();
+	void push(std::unique_ptr<Job>);
+
+	template <typename F>
+	void post(F&& f)
+	{
+		push(std::unique_ptr<Job>(new JobFn<std::decay_t<F>>(std::forward<F>(f))));
+	}
+
+	void resume(std::coroutine_handle<> h)
+	{
+		if (m_resume)
+		{
+			m_resume(h);
+		}
+		else
+		{
+			h.resume();
+		}
+	}
+
+	// string arguments are owned by the operation
+	template <typename T>
+	using Owned = std::conditional_t<std::is_convertible_v<const T&, std::string_view>, std::string, std::decay_t<T>>;
+public:
+	/** Open the connection, and start the executor thread.
+
+		\param uri connection uri, see Conn
+	*/
+	AsyncConn(const std::string& = "file:mem?mode=memory&cache=shared");
+
+	/** Open the connection with options, and start the executor thread. */
+	AsyncConn(const std::string&, const Conn::Options&);
+
+	/** Run the queued operations, and stop the executor thread. */
+	virtual ~AsyncConn();
+
+	AsyncConn(const AsyncConn&) = delete;
+	AsyncConn& operator=(const AsyncConn&) = delete;
+	AsyncConn(AsyncConn&&) = delete;
+	AsyncConn& operator=(AsyncConn&&) = delete;
+
+	/** Set the hook which resumes awaiting coroutines.
+
+		For example, post the handle to an event loop, so that coroutines continue on the loop thread.
+		Must be set before operations are queued.
+	*/
+	void resume_with(std::function<void(std::coroutine_handle<>)> hook) { m_resume = std::move(hook); }
+
+	/** Run a function with the connection on the executor thread.
+
+		The function is called as fn(Conn&), and the operation result is its return value.
+	*/
+	template <typename F>
+	AsyncOp<std::invoke_result_t<F&, Conn&>> call(F fn)
+	{
+		return AsyncOp<std::invoke_result_t<F&, Conn&>>(*this, std::move(fn));
+	}
+
+	/** Execute sql, with arguments bound in order from index 1. See Req::exec() and Req::bind(). */
+	template <typename... Args>
+	AsyncOp<void> exec(std::string_view sql, const Args&... args)
+	{
+		return AsyncOp<void>(*this, [sql=std::string(sql), ...args=Owned<Args>(args)](Conn& c)
+		{
+			Req req(c);
+			req.sql() << sql;
+			if constexpr (sizeof...(Args) > 0)
+			{
+				req.bind(args...);
+			}
+			req.exec();
+		});
+	}
+
+	/** Select all rows, with arguments bound in order from index 1. See Req::rows() for the column types.
+
+		Column types must own their data (for example std::string rather than std::string_view).
+	*/
+	template <typename... Ts, typename... Args>
+	AsyncOp<std::vector<typename Rows<Ts...>::value_type>> select(std::string_view sql, const Args&... args)
+	{
+		static_assert(((!std::is_same_v<Ts, std::string_view> && !std::is_same_v<Ts, std::span<const std::byte>>) && ...),
+			"select column types must own their data");
+
+		return AsyncOp<std::vector<typename Rows<Ts...>::value_type>>(*this, [sql=std::string(sql), ...args=Owned<Args>(args)](Conn& c)
+		{
+			Req req(c);
+			req.sql() << sql;
+			if constexpr (sizeof...(Args) > 0)
+			{
+				req.bind(args...);
+			}
+			std::vector<typename Rows<Ts...>::value_type> v;
+			for (auto&& r : req.rows<Ts...>())
+			{
+				v.push_back(std::move(r));
+			}
+			return v;
+		});
+	}
+};
+
+template <typename T>
+void AsyncOp<T>::await_suspend(std::coroutine_handle<> h)
+{
+	m_conn.post([this, h](Conn& c)
+	{
+		try
+		{
+			if constexpr (std::is_void_v<T>)
+			{
+				m_fn(c);
+				m_val.emplace();
+			}
+			else
+			{
+				m_val.emplace(m_fn(c));
+			}
+		}
+		catch (...)
+		{
+			m_err = std::current_exception();
+		}
+		m_conn.resume(h);
+	});
+}
+
+template <typename T>
+std::future<T> AsyncOp<T>::future()
+{
+	auto p = std::make_shared<std::promise<T>>();
+	auto f = p->get_future();
+	m_conn.post([p, fn=std::move(m_fn)](Conn& c)
+	{
+		try
+		{
+			if constexpr (std::is_void_v<T>)
+			{
+				fn(c);
+				p->set_value();
+			}
+			else
+			{
+				p->set_value(fn(c));
+			}
+		}
+		catch (...)
+		{
+			p->set_exception(std::current_exception());
+		}
+	});
+	return f;
+}
+
+/** @} */
+}
+
+#endif
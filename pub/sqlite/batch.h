@@ -0,0 +1,146 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_BATCH_H
+#define _SCC_SQLD_BATCH_H
+
+#include <sqlite/sqld.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <cstddef>
+#include <cstdint>
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Columnar batch.
+	\file
+*/
+
+/** Column storage type. */
+enum class ColType
+{
+	integer,		///< 64-bit INTEGER values.
+	real,			///< 64-bit REAL values.
+	text,			///< UTF-8 TEXT values.
+	blob,			///< BLOB values.
+};
+
+/** Batch of rows in column-major order.
+
+	Filled by Req::fetch_batch(). Each column stores its values in contiguous typed arrays, with a
+	validity bitmap of NULL values. TEXT and BLOB values are stored in one arena per column, with
+	rows+1 offsets, similar to the [arrow](https://arrow.apache.org/docs/format/Columnar.html) format.
+
+	A batch keeps its memory when cleared or refilled, so a scan which reuses the batch does not
+	allocate once the buffers have grown to the batch size.
+*/
+class ColumnBatch
+{
+public:
+	/** Column data. */
+	struct Column
+	{
+		std::string name;				///< Column name.
+		ColType type;					///< Storage type, values are converted to this type.
+		std::vector<int64_t> ints;		///< Values for integer columns (0 for NULL).
+		std::vector<double> reals;		///< Values for real columns (0 for NULL).
+		std::vector<uint64_t> offsets;	///< Arena offsets for text and blob columns; row i is [offsets[i], offsets[i+1]).
+		std::vector<char> arena;		///< Data for text and blob columns.
+		std::vector<uint8_t> valid;		///< Validity bitmap, bit (i%8) of byte (i/8) is set if row i is not NULL.
+
+		/** Is the row NULL? */
+		bool is_null(size_t i) const
+		{
+			return (valid[i/8] & (1 << (i%8))) == 0;
+		}
+
+		/** Text value of a text column. */
+		std::string_view text(size_t i) const
+		{
+			return std::string_view(arena.data()+offsets[i], offsets[i+1]-offsets[i]);
+		}
+
+		/** Blob value of a blob column. */
+		std::span<const std::byte> blob(size_t i) const
+		{
+			return std::span<const std::byte>(reinterpret_cast<const std::byte*>(arena.data())+offsets[i], offsets[i+1]-offsets[i]);
+		}
+	};
+private:
+	friend class Req;
+
+	std::vector<Column> m_cols;
+	size_t m_rows;
+	bool m_inferred;					// types were not set by types(), and integer columns can be widened
+
+	void init(sqlite3_stmt*);
+	void append(sqlite3_stmt*);
+public:
+	ColumnBatch();
+	virtual ~ColumnBatch();
+
+	/** Set the column types.
+
+		By default, the types are set by the first fetch into a batch without columns, from the declared column
+		types. Columns with NUMERIC affinity, expressions and columns without a declared type use the type of
+		the value in the first row, or text if it is NULL, and an integer column is changed to real if a later row has
+		a real value. Values are converted to the types set here.
+	*/
+	void types(const std::vector<ColType>&);
+
+	/** Remove all rows, keeping the columns and the memory. */
+	void clear();
+
+	/** Remove all rows and columns, keeping the memory. */
+	void reset();
+
+	/** Number of rows. */
+	size_t rows() const { return m_rows; }
+
+	/** Number of columns. */
+	int cols() const { return static_cast<int>(m_cols.size()); }
+
+	/** Column data.
+		\param col zero-indexed column
+	*/
+	const Column& col(int i) const { return m_cols.at(i); }
+};
+
+/** @} */
+}
+
+#endif
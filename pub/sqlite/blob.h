@@ -0,0 +1,144 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_BLOB_H
+#define _SCC_SQLD_BLOB_H
+
+#include <sqlite/sqld.h>
+#include <string>
+#include <span>
+#include <cstddef>
+#include <cstdint>
+
+struct sqlite3_blob;	// forward declaration
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Incremental BLOB i/o.
+	\file
+*/
+
+/** Read and write a BLOB value in place, using the [incremental blob](https://www.sqlite.org/c3ref/blob_open.html) api.
+
+	Data is copied directly between sqlite and caller-provided buffers, so memory use is bounded by the buffer
+	size rather than the size of the value. The size of the BLOB is fixed; to store a new value, insert a
+	zeroblob of the final size and stream the data into it:
+
+	    Req req(db);
+	    req.sql() << "INSERT INTO files (name, data) VALUES (?, ?);";
+	    req.bind_text(1, "big.bin");
+	    req.bind_zeroblob(2, size);
+	    req.exec();
+
+	    BlobStream bs(db, "files", "data", db.last_insert_rowid(), true);
+	    for (size_t off = 0; off < size; off += chunk.size())
+	    {
+	        ... fill chunk ...
+	        bs.write(chunk.data(), std::min(chunk.size(), size-off), off);
+	    }
+
+	Changing the row (by any connection) invalidates the stream, and further reads and writes fail. Writes
+	are part of the current transaction of the connection.
+*/
+class BlobStream
+{
+	Conn& m_conn;
+	sqlite3_blob* m_blob;
+	int64_t m_rowid;
+	size_t m_size;
+public:
+	/** Open a BLOB.
+
+		Throws an exception if the row does not exist, or the column is not a BLOB or TEXT.
+		\param conn connection
+		\param table table name
+		\param column column name
+		\param rowid row to open
+		\param write open for writing
+		\param db database name, for example "main"
+	*/
+	BlobStream(Conn&, const std::string&, const std::string&, int64_t, bool = false, const std::string& = "main");
+	virtual ~BlobStream();
+
+	BlobStream(const BlobStream&) = delete;
+	BlobStream& operator=(const BlobStream&) = delete;
+	BlobStream(BlobStream&&) = delete;
+	BlobStream& operator=(BlobStream&&) = delete;
+
+	/** Move to another row of the same table and column, without reopening.
+
+		Much faster than opening a new stream. Throws an exception if the row does not exist,
+		or the column is not a BLOB or TEXT.
+	*/
+	void reopen(int64_t);
+
+	/** Current row. */
+	int64_t rowid() const { return m_rowid; }
+
+	/** Size of the BLOB in bytes. */
+	size_t size() const { return m_size; }
+
+	/** Read bytes from an offset.
+
+		Throws an exception if the range is past the end of the BLOB.
+		\param buf buffer
+		\param len bytes to read
+		\param off offset in the BLOB
+	*/
+	void read(void*, size_t, size_t);
+
+	/** Read into a buffer from an offset.
+
+		\returns the number of bytes read, which is less than the buffer size at the end of the BLOB.
+	*/
+	size_t read(std::span<std::byte>, size_t);
+
+	/** Write bytes at an offset.
+
+		Throws an exception if the range is past the end of the BLOB, or the stream was not opened for writing.
+		\param buf data
+		\param len bytes to write
+		\param off offset in the BLOB
+	*/
+	void write(const void*, size_t, size_t);
+
+	/** Write a buffer at an offset. */
+	void write(std::span<const std::byte> buf, size_t off) { write(buf.data(), buf.size(), off); }
+};
+
+/** @} */
+}
+
+#endif
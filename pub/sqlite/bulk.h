@@ -0,0 +1,258 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_BULK_H
+#define _SCC_SQLD_BULK_H
+
+#include <sqlite/sqld.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <variant>
+#include <span>
+#include <tuple>
+#include <optional>
+#include <chrono>
+#include <cstdint>
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Bulk inserter.
+	\file
+*/
+
+/** Bulk insert statistics.
+
+	See BulkInserter::stats().
+*/
+struct BulkStats
+{
+	uint64_t rows;						///< Rows inserted.
+	uint64_t bytes;						///< Bytes of data added.
+	uint64_t statements;				///< Insert statements executed.
+	uint64_t commits;					///< Transactions committed.
+	std::chrono::nanoseconds elapsed;	///< Time from the first row to the last insert.
+
+	/** Rows inserted per second. */
+	double rows_per_sec() const
+	{
+		return elapsed.count() > 0 ? rows*1e9/elapsed.count() : 0;
+	}
+};
+
+/** Bulk insert options.
+
+	See BulkInserter.
+*/
+struct BulkOptions
+{
+	int rows_per_stmt = 64;						///< Rows inserted by each statement.
+	uint64_t commit_rows = 100000;				///< Commit after this many rows.
+	uint64_t commit_bytes = 64*1024*1024;		///< Commit after this many bytes of data.
+};
+
+/** Bulk inserter.
+
+	Inserts rows into a table using a multi-row insert statement, which is compiled once, inside transactions
+	which are committed periodically. For example:
+
+	    BulkInserter ins(db, "t", {"id", "name"});
+	    for (...)
+	        ins.add(id, name);
+	    ins.finish();						// insert the remaining rows and commit
+
+	Supported values are integral and floating point types, strings, std::vector<char> and std::span<const std::byte>
+	(BLOB), nullptr (NULL), and std::optional of these.
+
+	Rows which have not been committed when the inserter is destroyed are rolled back.
+*/
+class BulkInserter
+{
+public:
+	/** Column value. */
+	using Value = std::variant<std::nullptr_t, int64_t, double, std::string, std::vector<char>>;
+
+private:
+	Conn& m_conn;
+	BulkOptions m_opts;
+	size_t m_ncols;
+	std::string m_head;					// insert statement up to the values
+	Req m_multi;						// full batch insert statement
+	Trans m_trans;
+	std::vector<Value> m_buf;			// values of buffered rows
+	int m_count;						// number of buffered rows
+	uint64_t m_trans_rows;
+	uint64_t m_trans_bytes;
+	BulkStats m_stats;
+	std::chrono::steady_clock::time_point m_start;
+
+	template <typename T>
+	struct Optional
+	{
+		static constexpr bool value = false;
+	};
+	template <typename T>
+	struct Optional<std::optional<T>>
+	{
+		static constexpr bool value = true;
+	};
+
+	template <typename T>
+	void put(Value& slot, const T& v)
+	{
+		if constexpr (std::is_same_v<T, std::nullptr_t>)
+		{
+			slot = nullptr;
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			slot = static_cast<int64_t>(v);
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			slot = static_cast<double>(v);
+		}
+		else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+		{
+			std::string_view sv(v);
+			if (auto p = std::get_if<std::string>(&slot))		// reuse the string from an earlier row
+			{
+				p->assign(sv);
+			}
+			else
+			{
+				slot = std::string(sv);
+			}
+		}
+		else if constexpr (std::is_same_v<T, std::vector<char>> || std::is_convertible_v<const T&, std::span<const std::byte>>)
+		{
+			const char* b;
+			size_t sz;
+			if constexpr (std::is_same_v<T, std::vector<char>>)
+			{
+				b = v.data();
+				sz = v.size();
+			}
+			else
+			{
+				std::span<const std::byte> sp(v);
+				b = reinterpret_cast<const char*>(sp.data());
+				sz = sp.size();
+			}
+			if (auto p = std::get_if<std::vector<char>>(&slot))
+			{
+				p->assign(b, b+sz);
+			}
+			else
+			{
+				slot = std::vector<char>(b, b+sz);
+			}
+		}
+		else if constexpr (Optional<T>::value)
+		{
+			if (v)
+			{
+				put(slot, *v);
+			}
+			else
+			{
+				slot = nullptr;
+			}
+		}
+		else
+		{
+			static_assert(!sizeof(T), "unsupported insert type");
+		}
+	}
+
+	Value* next_row(size_t);
+	void row_added();
+	void statement(Req&, int);
+	void insert(Req&, int);
+public:
+	/** Construct an inserter.
+
+		Names are quoted in the insert statement, and must not include a schema.
+
+		\param conn connection
+		\param table table name
+		\param columns column names
+		\param opts options
+	*/
+	BulkInserter(Conn&, const std::string&, const std::vector<std::string>&, const BulkOptions& = BulkOptions());
+	virtual ~BulkInserter();
+
+	BulkInserter(const BulkInserter&) = delete;
+	BulkInserter& operator=(const BulkInserter&) = delete;
+
+	/** Add a row, with one value per column.
+
+		If the batch completed by the row cannot be inserted, for example because of a constraint violation,
+		the rows of the batch are dropped and the exception is thrown. Rows inserted earlier in the transaction
+		are kept, and more rows may be added.
+	*/
+	template <typename... Args>
+	void add(const Args&... args)
+	{
+		Value* row = next_row(sizeof...(args));
+		int i = 0;
+		(put(row[i++], args), ...);
+		row_added();
+	}
+
+	/** Add a row from a tuple, with one value per column. */
+	template <typename... Args>
+	void add(const std::tuple<Args...>& t)
+	{
+		std::apply([this](const Args&... args) { add(args...); }, t);
+	}
+
+	/** Add a row from a span, with one value per column. */
+	void add_row(std::span<const Value>);
+
+	/** Insert buffered rows, and commit.
+
+		More rows may be added after this call.
+	*/
+	void finish();
+
+	/** Statistics. */
+	BulkStats stats() const;
+};
+
+/** @} */
+}
+
+#endif
@@ -0,0 +1,165 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_CHANGE_H
+#define _SCC_SQLD_CHANGE_H
+
+#include <sqlite/sqld.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <cstddef>
+
+struct sqlite3_session;	// forward declaration
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Change data capture.
+	\file
+*/
+
+/** Action when a change cannot be applied as recorded. */
+enum class Conflict
+{
+	abort,					///< Roll back the changeset and throw an exception, the default.
+	omit,					///< Skip the change.
+	replace,				///< Overwrite the conflicting row; changes to missing rows or violating constraints are skipped.
+};
+
+/** Stream of the changes committed on a connection, using the [session](https://www.sqlite.org/sessionintro.html)
+	extension, which requires SQLITE_ENABLE_SESSION and SQLITE_ENABLE_PREUPDATE_HOOK.
+
+	Each Trans commit on the connection adds one changeset, a compact binary buffer with the rows inserted,
+	updated and deleted, to the stream. A replica applies the changesets in order to stay current, so the
+	traffic and the time to apply scale with the number of changes, not the size of the tables:
+
+	    ChangeStream cs(db, {"orders"});
+	    Trans t(db);
+	    t.begin();
+	    ... changes ...
+	    t.commit();								// captures the changeset
+
+	    std::vector<char> c;
+	    while (cs.next(c))
+	    {
+	        ChangeStream::apply(replica, c);
+	    }
+
+	Only tables with a PRIMARY KEY are recorded. Changes made outside of a Trans are included with the next
+	commit, or with flush(). A changeset holds the net effect of a transaction, so changes which are rolled
+	back, also to a Savepoint, do not appear.
+
+	If the stream stops recording, because the connection is closed or reopened or a new session cannot be
+	started after a commit, next() returns the changesets already in the stream, then throws an exception with
+	the reason; a new stream and a full copy of the tables are then needed to resynchronize a replica.
+
+	The stream must be destroyed before the connection. next() and pending() may be called from any thread.
+*/
+class ChangeStream
+{
+	Conn& m_conn;
+	std::vector<std::string> m_tables;
+	std::string m_schema;
+	bool m_patchset;
+	sqlite3_session* m_session;
+	std::vector<char> m_staged;				// captured by the commit in progress
+	std::string m_error;					// why changes are no longer recorded
+
+	mutable std::mutex m_mx;
+	std::deque<std::vector<char>> m_sets;
+	size_t m_bytes;
+
+	friend class Trans;
+	friend class Conn;
+
+	void create();
+	void capture();
+	void publish();
+	void detach(const std::string&);
+public:
+	/** Record changes to tables.
+
+		Tables which do not exist yet are recorded once they are created. Throws an exception if the session
+		cannot be created.
+		\param conn connection
+		\param tables names of the tables to record, or all tables if empty
+		\param schema database name, for example "main"
+		\param patchset record patchsets, which are smaller than changesets since they omit the original values
+			of updated and deleted rows, other than the primary key; conflicts are then only detected on the key
+	*/
+	ChangeStream(Conn&, const std::vector<std::string>& = {}, const std::string& = "main", bool = false);
+	virtual ~ChangeStream();
+
+	ChangeStream(const ChangeStream&) = delete;
+	ChangeStream& operator=(const ChangeStream&) = delete;
+	ChangeStream(ChangeStream&&) = delete;
+	ChangeStream& operator=(ChangeStream&&) = delete;
+
+	/** Add the changes made outside of a Trans to the stream.
+
+		Throws an exception if the connection is in a transaction, or the stream has stopped recording.
+	*/
+	void flush();
+
+	/** Take the oldest changeset from the stream.
+
+		Throws an exception if the stream is empty and has stopped recording.
+		\returns true if a changeset was moved into the buffer, false if the stream is empty
+	*/
+	bool next(std::vector<char>&);
+
+	/** Number of changesets in the stream. */
+	size_t pending() const;
+
+	/** Total size in bytes of the changesets in the stream. */
+	size_t pending_bytes() const;
+
+	/** Apply a changeset or patchset.
+
+		The changes are applied in one transaction, or in a savepoint if the connection is already in a
+		transaction. Throws an exception if a conflict aborts the changes, or the changeset is invalid; no changes
+		are then applied.
+		\param conn connection to apply the changes on
+		\param changes changeset from next()
+		\param conflict action on conflicts
+	*/
+	static void apply(Conn&, const std::vector<char>&, Conflict = Conflict::abort);
+};
+
+/** @} */
+}
+
+#endif
@@ -0,0 +1,114 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_CONFIG_H
+#define _SCC_SQLD_CONFIG_H
+
+#include <cstdint>
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Process-level sqlite configuration.
+	\file
+*/
+
+/** Allocation statistics.
+
+	See Config::alloc_stats().
+*/
+struct AllocStats
+{
+	uint64_t allocs;				///< Allocations (and reallocations) requested by sqlite.
+	uint64_t frees;					///< Frees requested by sqlite.
+	uint64_t system_allocs;			///< Allocations passed to the system allocator.
+	uint64_t system_frees;			///< Frees passed to the system allocator.
+};
+
+/** Process-level sqlite configuration.
+
+	Configures the sqlite memory allocator, page cache and default lookaside for all connections, for example:
+
+	    Config cfg;
+	    cfg.allocator = Config::Allocator::pool;
+	    cfg.memstatus = false;
+	    cfg.init();						// before the first Conn is constructed
+
+	init() shuts sqlite down and initializes it again with the new settings, so it must be called
+	when no connections are open, typically at program startup. It is not thread safe with respect
+	to other sqlite calls.
+*/
+struct Config
+{
+	/** Memory allocator. */
+	enum class Allocator
+	{
+		sqlite,			///< The sqlite default allocator (system malloc), without statistics.
+		system,			///< System malloc, with statistics.
+		pool,			///< Per-thread pools of small block sizes, backed by system malloc, with statistics.
+	};
+
+	Allocator allocator = Allocator::sqlite;	///< Memory allocator.
+
+	/** Enable memory status tracking.
+
+		Memory status is used by sqlite3_status() and soft heap limits, but serializes all
+		allocations on a global mutex.
+	*/
+	bool memstatus = true;
+
+	int page_size = 4096;						///< Expected database page size, used to size the page cache slots.
+	int pagecache_pages = 0;					///< Number of preallocated page cache slots, 0 to allocate pages from the allocator.
+
+	int lookaside_slot_size = 1200;				///< Per-connection lookaside slot size, in bytes.
+	int lookaside_slots = 100;					///< Number of lookaside slots per connection, 0 to disable.
+
+	/** Apply the configuration.
+
+		Throws std::runtime_error if sqlite rejects a setting, for example if a connection is open.
+	*/
+	void init() const;
+
+	/** Allocation statistics, if the allocator is system or pool. */
+	static AllocStats alloc_stats();
+
+	/** Reset the allocation statistics. */
+	static void reset_alloc_stats();
+};
+
+/** @} */
+
+}	// namespace
+
+#endif
@@ -0,0 +1,90 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_IMAGE_H
+#define _SCC_SQLD_IMAGE_H
+
+#include <string>
+#include <span>
+#include <cstddef>
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Memory mapped database image.
+	\file
+*/
+
+/** Read-only memory map of a database file.
+
+	Used to serve a prebuilt database image without reading or copying it:
+
+	    MappedImage img("prebuilt.db");
+	    Conn db(":memory:");
+	    db.deserialize(img.data(), true);		// read-only, pages are loaded on demand
+
+	The image must outlive the connections using it.
+
+	A file in WAL mode is served in rollback mode: the header of the mapped first page is changed, which copies
+	that page, and the file is not modified. Only the database file is mapped, so changes in a WAL file which
+	have not been checkpointed are not seen; checkpoint with TRUNCATE or close the writers before mapping.
+*/
+class MappedImage
+{
+	void* m_addr;
+	size_t m_size;
+public:
+	/** Map a file.
+
+		Throws std::system_error if the file cannot be opened or mapped.
+	*/
+	MappedImage(const std::string&);
+	virtual ~MappedImage();
+
+	MappedImage(const MappedImage&) = delete;
+	MappedImage& operator=(const MappedImage&) = delete;
+	MappedImage(MappedImage&&) = delete;
+	MappedImage& operator=(MappedImage&&) = delete;
+
+	/** Mapped file contents. */
+	std::span<const std::byte> data() const { return std::span<const std::byte>(static_cast<const std::byte*>(m_addr), m_size); }
+
+	/** Size of the file. */
+	size_t size() const { return m_size; }
+};
+
+/** @} */
+}
+
+#endif
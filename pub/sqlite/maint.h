@@ -0,0 +1,174 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_MAINT_H
+#define _SCC_SQLD_MAINT_H
+
+#include <sqlite/sqld.h>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Background database maintenance.
+	\file
+*/
+
+class ConnPool;
+
+/** Maintenance options.
+
+	See Maintenance.
+*/
+struct MaintenanceOptions
+{
+	std::chrono::milliseconds interval = std::chrono::milliseconds(1000);	///< Time between maintenance passes.
+	int64_t wal_pages = 1000;					///< Pages written to the WAL since the last checkpoint which start a PASSIVE checkpoint.
+	std::chrono::milliseconds idle = std::chrono::milliseconds(5000);	///< Time without commits after which any pages in the WAL are checkpointed, 0 to disable.
+	int64_t restart_pages = 10000;				///< WAL size in pages which escalates to a RESTART checkpoint.
+	int64_t truncate_pages = 100000;			///< WAL size in pages which escalates to a TRUNCATE checkpoint.
+	std::chrono::milliseconds busy_timeout = std::chrono::milliseconds(100);	///< Time escalated checkpoints, ANALYZE and vacuums wait for locks.
+	std::chrono::milliseconds optimize_interval = std::chrono::hours(1);	///< Time between ANALYZE runs, 0 to disable.
+	int analysis_limit = 400;					///< Rows sampled from each index by ANALYZE, 0 for all rows.
+	std::chrono::milliseconds vacuum_interval = std::chrono::minutes(1);	///< Time between incremental vacuums, 0 to disable.
+	int vacuum_pages = 1000;					///< Free pages removed by each incremental vacuum, 0 for all.
+};
+
+/** Maintenance statistics.
+
+	See Maintenance::stats().
+*/
+struct MaintenanceStats
+{
+	uint64_t checkpoints;						///< Checkpoints run.
+	uint64_t escalations;						///< Checkpoints run in RESTART or TRUNCATE mode.
+	uint64_t incomplete;						///< Checkpoints which could not copy the whole WAL because of readers or writers.
+	std::chrono::nanoseconds last_checkpoint;	///< Duration of the last checkpoint.
+	std::chrono::nanoseconds max_checkpoint;	///< Longest checkpoint.
+	std::chrono::nanoseconds total_checkpoint;	///< Total time spent in checkpoints.
+	int64_t wal_pages;							///< WAL size in pages after the last commit.
+	int64_t max_wal_pages;						///< Largest WAL size seen.
+	int64_t backfilled_pages;					///< WAL pages copied to the database by the last checkpoint.
+	uint64_t optimizes;							///< ANALYZE runs.
+	uint64_t vacuums;							///< Incremental vacuums run.
+	int64_t vacuumed_pages;						///< Free pages removed by incremental vacuums.
+	uint64_t errors;							///< Maintenance tasks which failed, for example when the database was locked.
+};
+
+/** Background maintenance of a database in [WAL mode](https://www.sqlite.org/wal.html).
+
+	By default, sqlite checkpoints the WAL file inline, on the commit which takes it past 1000 pages, so
+	a random writer pays for the checkpoint. Maintenance disables the automatic checkpoint of the connection it
+	is attached to, and runs checkpoints on a background thread, using its own connection:
+
+	    Conn db("file:data.db?mode=rwc", Conn::Options::throughput());
+	    Maintenance m(db);
+	    ... writes on db ...
+
+	A PASSIVE checkpoint, which does not wait for readers or writers, runs when wal_pages have been written
+	since the last checkpoint, or the WAL has pages and there have been no commits for the idle time. Under
+	steady readers a passive checkpoint cannot copy the whole WAL, and the file keeps growing; once it reaches
+	restart_pages or truncate_pages the checkpoint escalates to RESTART or TRUNCATE, which waits up to
+	busy_timeout for readers to finish, so the WAL can be reused or truncated. Writers on other connections
+	are blocked while it waits.
+
+	Statistics are periodically updated with ANALYZE, limited to analysis_limit rows per index. PRAGMA optimize
+	is not used since it only analyzes tables queried by the connection running it. Databases with
+	auto_vacuum=INCREMENTAL have free pages removed with incremental_vacuum. These write to the database, so
+	writers should use a BusyPolicy to wait for them.
+
+	The WAL size is found from the commits of the attached connection, so all writes should be made through it.
+	The maintenance object must be destroyed before the connection or pool, and the connection must not be
+	reopened while it exists. The automatic checkpoint setting of the connection is restored when it is destroyed.
+*/
+class Maintenance
+{
+	MaintenanceOptions m_opts;
+	ConnPool* m_pool;
+	Conn* m_writer;
+	int m_autocheckpoint;						// automatic checkpoint of the writer before attaching
+	std::unique_ptr<Conn> m_conn;				// used by the maintenance thread
+
+	std::mutex m_mx;
+	std::condition_variable m_cv;
+	bool m_stop;
+	bool m_wake;
+	int64_t m_frames;							// WAL size at the last commit
+	int64_t m_backfilled;						// WAL pages copied by the last checkpoint
+	std::chrono::steady_clock::time_point m_last_commit;
+	MaintenanceStats m_stats;
+	std::thread m_thread;
+
+	void start(const std::string&);
+	void run();
+	void checkpoint();
+	void optimize();
+	void vacuum();
+
+	static int wal_hook(void*, sqlite3*, const char*, int);
+public:
+	/** Attach to a connection, and start the maintenance thread.
+
+		The automatic checkpoint of the connection is disabled. Throws an exception if the connection is not to a
+		file database in WAL mode. The connection must outlive the maintenance object.
+	*/
+	Maintenance(Conn&, const MaintenanceOptions& = MaintenanceOptions());
+
+	/** Attach to the writer of a pool, and start the maintenance thread.
+
+		The pool must outlive the maintenance object.
+	*/
+	Maintenance(ConnPool&, const MaintenanceOptions& = MaintenanceOptions());
+
+	/** Stop the maintenance thread, and restore the automatic checkpoint setting the connection had when attached. */
+	virtual ~Maintenance();
+
+	Maintenance(const Maintenance&) = delete;
+	Maintenance& operator=(const Maintenance&) = delete;
+	Maintenance(Maintenance&&) = delete;
+	Maintenance& operator=(Maintenance&&) = delete;
+
+	/** Maintenance statistics. */
+	MaintenanceStats stats();
+};
+
+/** @} */
+}
+
+#endif
@@ -0,0 +1,173 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_POOL_H
+#define _SCC_SQLD_POOL_H
+
+#include <sqlite/sqld.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Connection pool.
+	\file
+*/
+
+/** Connection pool statistics.
+
+	See ConnPool::reader_stats() and ConnPool::writer_stats().
+*/
+struct PoolStats
+{
+	uint64_t leases;						///< Number of leases.
+	uint64_t waits;							///< Number of leases which had to wait for a connection.
+	std::chrono::nanoseconds wait_time;		///< Total time spent waiting for connections.
+	std::chrono::nanoseconds max_wait;		///< Longest time spent waiting for a connection.
+	double utilization;						///< Fraction of connection time leased since the pool was opened.
+};
+
+/** Pool of connections to a file database in [WAL mode](https://www.sqlite.org/wal.html).
+
+	The pool opens one read/write connection and a number of read-only connections, each with a private cache.
+	In WAL mode readers do not block the writer, and the writer does not block readers, so read-heavy
+	work can proceed in parallel on separate threads.
+
+	Connections are leased to one thread at a time, and returned to the pool when the lease is destroyed:
+
+	    ConnPool pool("data.db", 8);
+	    {
+	        auto l = pool.reader();			// waits for a free reader
+	        Req req(*l);
+	        req.sql() << "select count(*) from t;";
+	        req.exec_select();
+	    }									// reader is returned to the pool
+
+	Leases must not outlive the pool. Requests made on a leased connection should
+	be cleared or destroyed before the lease is returned. Connections are opened without the sqlite
+	connection mutex (SQLITE_OPEN_NOMUTEX), so a leased connection must not be shared between threads.
+*/
+class ConnPool
+{
+	struct Group
+	{
+		std::vector<std::unique_ptr<Conn>> conns;
+		std::vector<Conn*> avail;
+		std::condition_variable cv;
+		PoolStats stats;
+		std::chrono::nanoseconds busy;				// leased time of returned leases
+		std::chrono::nanoseconds active_start;		// sum of start times of active leases
+	};
+
+	std::string m_path;
+	std::mutex m_mx;
+	Group m_readers;
+	Group m_writer;
+	std::chrono::steady_clock::time_point m_opened;
+
+	Conn* acquire(Group&, std::chrono::steady_clock::time_point&);
+	void release(Group&, Conn*, std::chrono::steady_clock::time_point);
+	PoolStats stats(Group&);
+public:
+	/** Connection lease.
+
+		Returns the connection to the pool when destroyed.
+	*/
+	class Lease
+	{
+		friend class ConnPool;
+
+		ConnPool* m_pool;
+		Group* m_group;
+		Conn* m_conn;
+		std::chrono::steady_clock::time_point m_start;
+
+		Lease(ConnPool*, Group*, Conn*, std::chrono::steady_clock::time_point);
+	public:
+		Lease(Lease&&);
+		Lease(const Lease&) = delete;
+		Lease& operator=(const Lease&) = delete;
+		Lease& operator=(Lease&&) = delete;
+		virtual ~Lease();
+
+		/** Leased connection. */
+		Conn& conn() { return *m_conn; }
+		Conn& operator*() { return *m_conn; }
+		Conn* operator->() { return m_conn; }
+	};
+
+	/** Open the pool.
+
+		Creates the database file if it does not exist, and sets it to WAL mode.
+
+		\param path database file name
+		\param readers number of read-only connections
+	*/
+	ConnPool(const std::string&, int = 4);
+	virtual ~ConnPool();
+
+	ConnPool(const ConnPool&) = delete;
+	ConnPool& operator=(const ConnPool&) = delete;
+	ConnPool(ConnPool&&) = delete;
+	ConnPool& operator=(ConnPool&&) = delete;
+
+	/** Lease a read-only connection, waiting until one is available. */
+	Lease reader();
+
+	/** Lease the read/write connection, waiting until it is available. */
+	Lease writer();
+
+	/** Reader lease statistics. */
+	PoolStats reader_stats();
+
+	/** Writer lease statistics. */
+	PoolStats writer_stats();
+
+	/** Database file name. */
+	const std::string& path() const { return m_path; }
+
+	/** Number of read-only connections. */
+	int readers() const { return static_cast<int>(m_readers.conns.size()); }
+};
+
+/** @} */
+}
+
+#endif
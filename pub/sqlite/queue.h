@@ -0,0 +1,162 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_QUEUE_H
+#define _SCC_SQLD_QUEUE_H
+
+#include <sqlite/sqld.h>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Group commit write queue.
+	\file
+*/
+
+/** Write queue options.
+
+	See WriteQueue.
+*/
+struct WriteQueueOptions
+{
+	size_t max_batch = 256;											///< Maximum number of writes in a transaction.
+	std::chrono::microseconds max_latency = std::chrono::microseconds(1000);	///< Maximum time the first write of a batch waits for others.
+};
+
+/** Write queue statistics.
+
+	See WriteQueue::stats().
+*/
+struct WriteQueueStats
+{
+	uint64_t writes;				///< Writes run.
+	uint64_t failed;				///< Writes which failed, and were rolled back.
+	uint64_t batches;				///< Transactions committed.
+	uint64_t failed_batches;		///< Transactions which could not begin or commit.
+	uint64_t max_batch;				///< Largest number of writes in a transaction.
+};
+
+/** Group commit write queue.
+
+	Threads submit writes, and a writer thread runs them in batches, each batch in one
+	BEGIN IMMEDIATE ... COMMIT transaction, so many small writes share one commit (and one sync of a file
+	database):
+
+	    WriteQueue q(db);
+	    auto f = q.submit("insert into t values(?, ?);", id, name);
+	    f.get();						// throws if the write failed
+
+	A batch is started when the first write is queued, and committed when it has max_batch writes,
+	or max_latency has passed, whichever is first. Each write runs in a savepoint, so a write which fails is
+	rolled back without affecting the rest of the batch. Futures are ready after the batch is committed.
+
+	The connection is used by the writer thread while the queue exists, and should not be used by other
+	threads. Queued writes are run before the queue is destroyed.
+*/
+class WriteQueue
+{
+	struct Item
+	{
+		std::function<void(Conn&)> fn;
+		std::promise<void> done;
+		std::chrono::steady_clock::time_point queued;
+	};
+
+	Conn& m_conn;
+	WriteQueueOptions m_opts;
+	std::mutex m_mx;
+	std::condition_variable m_cv;
+	std::deque<Item> m_queue;
+	bool m_stop;
+	WriteQueueStats m_stats;
+	std::thread m_thread;
+
+	void run();
+	void commit(std::deque<Item>&);
+
+	template <typename T>
+	using Owned = std::conditional_t<std::is_convertible_v<const T&, std::string_view>, std::string, std::decay_t<T>>;
+public:
+	/** Start the writer thread. */
+	WriteQueue(Conn&, const WriteQueueOptions& = WriteQueueOptions());
+
+	/** Commit the queued writes, and stop the writer thread. */
+	virtual ~WriteQueue();
+
+	WriteQueue(const WriteQueue&) = delete;
+	WriteQueue& operator=(const WriteQueue&) = delete;
+	WriteQueue(WriteQueue&&) = delete;
+	WriteQueue& operator=(WriteQueue&&) = delete;
+
+	/** Queue a write function, called as fn(Conn&) inside the batch transaction.
+
+		An exception thrown by the function rolls back its changes, and is set in the future.
+	*/
+	std::future<void> submit(std::function<void(Conn&)>);
+
+	/** Queue a bound statement, with arguments bound in order from index 1. See Req::bind(). */
+	template <typename... Args>
+	std::future<void> submit(std::string_view sql, const Args&... args)
+	{
+		return submit(std::function<void(Conn&)>([sql=std::string(sql), ...args=Owned<Args>(args)](Conn& c)
+		{
+			Req req(c);
+			req.sql() << sql;
+			if constexpr (sizeof...(Args) > 0)
+			{
+				req.bind(args...);
+			}
+			req.exec();
+		}));
+	}
+
+	/** Write statistics. */
+	WriteQueueStats stats();
+};
+
+/** @} */
+}
+
+#endif
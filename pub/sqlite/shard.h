@@ -0,0 +1,336 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_SHARD_H
+#define _SCC_SQLD_SHARD_H
+
+#include <sqlite/sqld.h>
+#include <sqlite/async.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <future>
+#include <functional>
+#include <tuple>
+#include <cstdint>
+#include <cstddef>
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Sharded connections.
+	\file
+*/
+
+/** Rows of a query fanned out to all shards, see ShardedConn::select_all().
+
+	Iterates the rows of each shard in shard order, or, after order_by(), merges the rows in order; each
+	shard's rows must then be sorted the same way, for example by an ORDER BY clause. Rows are not copied
+	when iterated.
+
+	    auto rows = db.select_all<int64_t, std::string>("SELECT id, name FROM t ORDER BY id;");
+	    for (const auto& [id, name] : rows.order_by<0>()) ...
+
+	combine() merges partial aggregates, either for all rows, or for rows with the same order key:
+
+	    auto counts = db.select_all<std::string, int64_t>("SELECT grp, count(*) FROM t GROUP BY grp ORDER BY grp;")
+	        .order_by<0>()
+	        .combine([](auto& acc, const auto& r) { std::get<1>(acc) += std::get<1>(r); });
+*/
+template <typename... Ts>
+class ShardRows
+{
+public:
+	using value_type = typename Rows<Ts...>::value_type;
+	using Less = std::function<bool(const value_type&, const value_type&)>;
+private:
+	std::vector<std::vector<value_type>> m_parts;
+	Less m_less;
+public:
+	ShardRows(std::vector<std::vector<value_type>>&& parts) : m_parts(std::move(parts)) {}
+
+	/** Merge rows in order of a comparison. */
+	ShardRows& order_by(Less less)
+	{
+		m_less = std::move(less);
+		return *this;
+	}
+
+	/** Merge rows in order of a column, ascending or descending. */
+	template <size_t I>
+	ShardRows& order_by(bool desc = false)
+	{
+		if (desc)
+		{
+			return order_by([](const value_type& a, const value_type& b) { return std::get<I>(b) < std::get<I>(a); });
+		}
+		return order_by([](const value_type& a, const value_type& b) { return std::get<I>(a) < std::get<I>(b); });
+	}
+
+	/** Rows of each shard. */
+	const std::vector<std::vector<value_type>>& parts() const { return m_parts; }
+
+	/** Total number of rows. */
+	size_t size() const
+	{
+		size_t n = 0;
+		for (auto& p : m_parts)
+		{
+			n += p.size();
+		}
+		return n;
+	}
+
+	class iterator
+	{
+		const ShardRows* m_rows;
+		std::vector<size_t> m_pos;		// next row of each shard
+		size_t m_cur;					// shard of the current row
+
+		void next_shard()
+		{
+			auto& parts = m_rows->m_parts;
+			if (!m_rows->m_less)
+			{
+				while (m_cur < parts.size() && m_pos[m_cur] == parts[m_cur].size())
+				{
+					m_cur++;
+				}
+				return;
+			}
+			m_cur = parts.size();		// linear scan, the number of shards is small
+			for (size_t i = 0; i < parts.size(); i++)
+			{
+				if (m_pos[i] == parts[i].size())
+				{
+					continue;
+				}
+				if (m_cur == parts.size() || m_rows->m_less(parts[i][m_pos[i]], parts[m_cur][m_pos[m_cur]]))
+				{
+					m_cur = i;
+				}
+			}
+		}
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = ShardRows::value_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const value_type*;
+		using reference = const value_type&;
+
+		iterator() : m_rows(nullptr), m_cur(0) {}
+		iterator(const ShardRows* rows) : m_rows(rows), m_pos(rows->m_parts.size(), 0), m_cur(0)
+		{
+			next_shard();
+		}
+
+		reference operator*() const { return m_rows->m_parts[m_cur][m_pos[m_cur]]; }
+		pointer operator->() const { return &**this; }
+		iterator& operator++()
+		{
+			m_pos[m_cur]++;
+			next_shard();
+			return *this;
+		}
+		bool operator==(const iterator& o) const
+		{
+			bool end = !m_rows || m_cur == m_rows->m_parts.size();
+			bool oend = !o.m_rows || o.m_cur == o.m_rows->m_parts.size();
+			if (end || oend)
+			{
+				return end == oend;
+			}
+			return m_cur == o.m_cur && m_pos == o.m_pos;
+		}
+	};
+
+	iterator begin() const { return iterator(this); }
+	iterator end() const { return iterator(); }
+
+	/** Combine partial aggregates.
+
+		Rows which are equal in the merge order are combined, or all rows if order_by() was not used;
+		fn(acc, row) adds a row to the first row of its group.
+		\returns the combined rows, in merge order
+	*/
+	template <typename F>
+	std::vector<value_type> combine(F fn) const
+	{
+		std::vector<value_type> v;
+		for (const auto& r : *this)
+		{
+			if (!v.empty() && (!m_less || !m_less(v.back(), r)))		// merge order: back is not less than r, so equal
+			{
+				fn(v.back(), r);
+			}
+			else
+			{
+				v.push_back(r);
+			}
+		}
+		return v;
+	}
+};
+
+/** Sharded connections.
+
+	Manages one AsyncConn for each shard database. Writes are routed to a shard by a key, and queries run
+	on one shard, or in parallel on all shards, each on its own executor thread, with the results merged
+	(see ShardRows):
+
+	    ShardedConn db({"file:s0.db?mode=rwc", "file:s1.db?mode=rwc", "file:s2.db?mode=rwc"}, Conn::Options::throughput());
+	    db.exec_all("CREATE TABLE IF NOT EXISTS t (id INTEGER PRIMARY KEY, name TEXT);");
+
+	    db.exec(id, "INSERT INTO t VALUES (?, ?);", id, name).future().get();		// on shard_of(id)
+
+	    for (const auto& [id, name] : db.select_all<int64_t, std::string>("SELECT id, name FROM t ORDER BY id;").order_by<0>())
+	        ...
+
+	The key hash maps a key to a shard, and must be the same each time the shards are opened.
+*/
+class ShardedConn
+{
+public:
+	using Hash = std::function<uint64_t(int64_t)>;
+private:
+	std::vector<std::unique_ptr<AsyncConn>> m_shards;
+	Hash m_hash;
+public:
+	/** Open the shards.
+
+		\param uris connection uri of each shard
+		\param opts connection options
+		\param hash key hash, the default mixes the bits of the key
+	*/
+	ShardedConn(const std::vector<std::string>&, const Conn::Options& = Conn::Options(), Hash = Hash());
+	virtual ~ShardedConn() {}
+
+	ShardedConn(const ShardedConn&) = delete;
+	ShardedConn& operator=(const ShardedConn&) = delete;
+	ShardedConn(ShardedConn&&) = delete;
+	ShardedConn& operator=(ShardedConn&&) = delete;
+
+	/** Number of shards. */
+	size_t size() const { return m_shards.size(); }
+
+	/** Shard of a key. */
+	size_t shard_of(int64_t key) const { return m_hash(key) % m_shards.size(); }
+
+	/** Connection of a shard. */
+	AsyncConn& shard(size_t i) { return *m_shards.at(i); }
+
+	/** Connection of the shard of a key. */
+	AsyncConn& shard_for(int64_t key) { return *m_shards[shard_of(key)]; }
+
+	/** Execute sql on the shard of a key. See AsyncConn::exec(). */
+	template <typename... Args>
+	AsyncOp<void> exec(int64_t key, std::string_view sql, const Args&... args)
+	{
+		return shard_for(key).exec(sql, args...);
+	}
+
+	/** Execute sql on all shards in parallel, and wait for completion.
+
+		Throws the first error, after all shards are done.
+	*/
+	template <typename... Args>
+	void exec_all(std::string_view sql, const Args&... args)
+	{
+		std::vector<std::future<void>> fs;
+		for (auto& s : m_shards)
+		{
+			fs.push_back(s->exec(sql, args...).future());
+		}
+		wait(fs);
+	}
+
+	/** Select rows from all shards in parallel. See AsyncConn::select() for the column types.
+
+		Throws the first error, after all shards are done.
+	*/
+	template <typename... Ts, typename... Args>
+	ShardRows<Ts...> select_all(std::string_view sql, const Args&... args)
+	{
+		using V = std::vector<typename ShardRows<Ts...>::value_type>;
+		std::vector<std::future<V>> fs;
+		for (auto& s : m_shards)
+		{
+			fs.push_back(s->select<Ts...>(sql, args...).future());
+		}
+		return ShardRows<Ts...>(wait(fs));
+	}
+
+private:
+	template <typename T>
+	static auto wait(std::vector<std::future<T>>& fs)
+	{
+		std::exception_ptr err;
+		std::conditional_t<std::is_void_v<T>, int, std::vector<T>> v{};
+		for (auto& f : fs)
+		{
+			try
+			{
+				if constexpr (std::is_void_v<T>)
+				{
+					f.get();
+				}
+				else
+				{
+					v.push_back(f.get());
+				}
+			}
+			catch (...)
+			{
+				if (!err)
+				{
+					err = std::current_exception();
+				}
+			}
+		}
+		if (err)
+		{
+			std::rethrow_exception(err);
+		}
+		if constexpr (!std::is_void_v<T>)
+		{
+			return v;
+		}
+	}
+};
+
+/** @} */
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_SNAPSHOT_H
+#define _SCC_SQLD_SNAPSHOT_H
+
+#include <sqlite/sqld.h>
+#include <string>
+
+struct sqlite3_snapshot;	// forward declaration
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** WAL database snapshots.
+	\file
+*/
+
+/** State of a [WAL mode](https://www.sqlite.org/wal.html) database, which other connections can read.
+
+	Uses the [snapshot](https://www.sqlite.org/c3ref/snapshot.html) api, which requires SQLITE_ENABLE_SNAPSHOT.
+	Readers on several connections, for example one per thread, see exactly the same state while writers
+	continue, without sharing a transaction:
+
+	    Snapshot snap(db);						// state as of now
+
+	    // on each reader thread
+	    Trans t(reader);
+	    snap.open(t);							// begins the transaction at the snapshot
+	    ... queries ...
+	    t.commit();
+
+	A checkpoint can remove the state from the WAL file once no transaction is reading it, and opening the
+	snapshot then fails. To keep it available, capture the snapshot in a Trans on the capturing connection,
+	and keep the transaction open until the readers have started.
+
+	Once constructed, a snapshot can be opened from several threads at once.
+*/
+class Snapshot
+{
+	sqlite3_snapshot* m_snap;
+	std::string m_schema;
+public:
+	/** Capture the state of a database seen by a connection.
+
+		If the connection is in a transaction, this is the state the transaction reads; otherwise a read
+		transaction is run to capture the latest state. Throws an exception if the database is not in WAL mode,
+		or the connection has a write transaction.
+		\param conn connection
+		\param schema database name, for example "main"
+	*/
+	Snapshot(Conn&, const std::string& = "main");
+	virtual ~Snapshot();
+
+	Snapshot(const Snapshot&) = delete;
+	Snapshot& operator=(const Snapshot&) = delete;
+	Snapshot(Snapshot&&) = delete;
+	Snapshot& operator=(Snapshot&&) = delete;
+
+	/** Begin a transaction which reads the snapshot.
+
+		The transaction must not be active, and must be Trans::Mode::deferred, since an immediate or exclusive
+		transaction takes the write lock and reads the latest database; it is begun, and is then used as usual.
+		Throws an exception if the snapshot is no longer available, or the database is not the same, in which
+		case the transaction is not active.
+	*/
+	void open(Trans&) const;
+
+	/** Compare with another snapshot of the same database.
+
+		\returns < 0 if this is older, 0 if they are the same, or > 0 if this is newer
+	*/
+	int compare(const Snapshot&) const;
+};
+
+/** @} */
+}
+
+#endif
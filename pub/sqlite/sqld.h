@@ -32,11 +32,29 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define _SCC_SQLD_H
 
 #include <string>
+#include <string_view>
+#include <span>
+#include <cstddef>
 #include <sstream>
 #include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <type_traits>
+#include <tuple>
+#include <optional>
+#include <utility>
+#include <stdexcept>
+#include <new>
 
 struct sqlite3;		// forward declaration
 struct sqlite3_stmt;
+struct sqlite3_context;
+struct sqlite3_value;
 
 namespace scc::sqld
 {
@@ -49,6 +67,346 @@ namespace scc::sqld
 	\file
 */
 
+/** Statement cache statistics.
+
+	See Conn::stmt_cache_stats().
+*/
+struct StmtCacheStats
+{
+	uint64_t hits;			///< Statements reused from the cache.
+	uint64_t misses;		///< Statements that had to be compiled.
+	uint64_t evictions;		///< Statements finalized to make room in the cache.
+	size_t size;			///< Number of statements currently in the cache.
+	size_t max_size;		///< Maximum number of statements held in the cache.
+};
+
+/** Result cache statistics.
+
+	See Conn::select_cached().
+*/
+struct ResultCacheStats
+{
+	uint64_t hits;			///< Results returned from the cache.
+	uint64_t misses;		///< Results which had to be selected.
+	uint64_t invalidations;	///< Results found invalid, because a table they read changed.
+	uint64_t evictions;		///< Results removed to make room in the cache.
+	size_t entries;			///< Number of results currently in the cache.
+	size_t bytes;			///< Approximate memory used by the results.
+	size_t max_bytes;		///< Maximum memory used by the results, 0 if the cache is disabled.
+};
+
+/** Connection memory usage.
+
+	See Conn::memory_usage().
+*/
+struct MemoryUsage
+{
+	int64_t cache;			///< Bytes used by the page cache.
+	int64_t schema;			///< Bytes used by database schemas.
+	int64_t statements;		///< Bytes used by prepared statements, including the statement cache.
+	int64_t results;		///< Approximate bytes used by the result cache.
+	int64_t lookaside;		///< Lookaside memory slots in use.
+	int64_t lookaside_max;	///< Highest number of lookaside slots in use.
+	uint64_t cache_hits;	///< Page cache hits.
+	uint64_t cache_misses;	///< Page cache misses.
+};
+
+/** Busy handling policy.
+
+	Used when the database is locked by another connection, see Conn::busy_policy(). Shared cache
+	table locks (SQLITE_LOCKED) fail without retrying.
+*/
+struct BusyPolicy
+{
+	/** Policy kind. */
+	enum class Kind
+	{
+		fail,				///< Fail at once with SQLITE_BUSY, the sqlite default.
+		fixed,				///< Retry at a fixed interval until the timeout.
+		backoff,			///< Retry with exponential backoff and jitter until the timeout.
+		callback,			///< Ask a callback.
+	};
+
+	Kind kind = Kind::fail;
+	std::chrono::milliseconds timeout = std::chrono::milliseconds(0);		///< Time to retry, from the first busy result.
+	std::chrono::microseconds delay = std::chrono::microseconds(1000);		///< Retry interval, or first backoff delay.
+	std::chrono::microseconds max_delay = std::chrono::microseconds(50000);	///< Largest backoff delay.
+
+	/** Called with the number of earlier retries for the lock, returns true to retry.
+
+		The callback may sleep before returning.
+	*/
+	std::function<bool(int)> callback;
+
+	/** Fail at once. */
+	static BusyPolicy fail();
+	/** Retry every delay until the timeout. */
+	static BusyPolicy fixed(std::chrono::milliseconds, std::chrono::microseconds = std::chrono::microseconds(1000));
+	/** Retry after delays doubling from the first delay up to max_delay, each randomized between half and the full delay. */
+	static BusyPolicy backoff(std::chrono::milliseconds, std::chrono::microseconds = std::chrono::microseconds(100),
+		std::chrono::microseconds = std::chrono::microseconds(50000));
+	/** Ask a callback. */
+	static BusyPolicy custom(std::function<bool(int)>);
+};
+
+/** Busy statistics.
+
+	See Conn::busy_stats().
+*/
+struct BusyStats
+{
+	uint64_t events;						///< Times a lock was busy.
+	uint64_t retries;						///< Retries after a busy lock.
+	uint64_t failures;						///< Busy locks given up, which returned SQLITE_BUSY.
+	std::chrono::nanoseconds total_wait;	///< Total time spent waiting for busy locks.
+	std::chrono::nanoseconds max_wait;		///< Longest wait for a single lock.
+};
+
+/** Online backup options.
+
+	See Conn::backup_to() and Conn::restore_from().
+*/
+struct BackupOptions
+{
+	int pages_per_step = 256;									///< Pages copied in each step, -1 to copy all in one step.
+	std::chrono::milliseconds pause = std::chrono::milliseconds(1);	///< Pause between steps, so writers on the source can proceed.
+	std::chrono::milliseconds busy_timeout = std::chrono::seconds(5);	///< Time steps are retried while the source or destination is locked, before the backup throws.
+
+	/** Called after each step with the remaining and total page counts, return false to cancel the backup. */
+	std::function<bool(int, int)> progress;
+};
+
+/** Statement execution profile.
+
+	See Conn::stats().
+*/
+struct StmtProfile
+{
+	std::string sql;						///< Normalized sql text, with literals replaced by "?".
+	uint64_t calls;							///< Number of executions.
+	std::chrono::nanoseconds total;			///< Total execution time.
+	std::chrono::nanoseconds p50;			///< Median execution time (approximate).
+	std::chrono::nanoseconds p99;			///< 99th percentile execution time (approximate).
+	uint64_t rows;							///< Rows returned.
+	uint64_t vm_steps;						///< Virtual machine operations.
+	uint64_t fullscan_steps;				///< Forward steps in full table scans.
+	uint64_t sorts;							///< Sort operations.
+	uint64_t autoindexes;					///< Rows inserted into automatic indexes.
+};
+
+/** Statement execution recorded by the slow query log.
+
+	See Conn::enable_slow_query_log().
+*/
+struct SlowQuery
+{
+	std::string sql;						///< Sql text as prepared.
+	std::string expanded;					///< Sql text with the bound parameter values, empty if too long.
+	std::chrono::system_clock::time_point when;		///< Completion time.
+	std::chrono::nanoseconds duration;		///< Execution time.
+	uint64_t rows;							///< Rows returned.
+	uint64_t fullscan_steps;				///< Forward steps in full table scans.
+	uint64_t autoindexes;					///< Rows inserted into automatic indexes.
+	std::vector<std::string> plan;			///< EXPLAIN QUERY PLAN output, one line per step, indented by depth.
+};
+
+/** Slow query log options. */
+struct SlowQueryOptions
+{
+	std::chrono::nanoseconds threshold = std::chrono::milliseconds(100);	///< Record executions taking at least this long.
+	bool scans = true;						///< Also record executions with full table scans or automatic indexes.
+	size_t capacity = 64;					///< Number of executions kept, the oldest are dropped first.
+
+	/** Called with each execution recorded.
+
+		The sink is called from within the statement execution, so it must not use the connection; it should
+		copy the record and return quickly. Exceptions are ignored.
+	*/
+	std::function<void(const SlowQuery&)> sink;
+};
+
+/** Arguments and result of a call to a user-defined sql function.
+
+	Used by Conn::create_function() and Conn::create_aggregate() to convert between sqlite values and c++ types.
+	Integral, floating point, std::string, std::string_view, std::vector<char> and std::span<const std::byte>
+	(BLOB) types are supported, and std::optional<T> for values which may be NULL.
+*/
+class FuncCall
+{
+	sqlite3_context* m_ctx;
+	int m_argc;
+	sqlite3_value** m_argv;
+
+	void check_arg(int) const;
+public:
+	FuncCall(sqlite3_context* ctx, int argc, sqlite3_value** argv) : m_ctx(ctx), m_argc(argc), m_argv(argv) {}
+
+	/** Number of arguments. */
+	int size() const { return m_argc; }
+
+	bool is_null(int) const;
+	int get_int(int) const;
+	int64_t get_int64(int) const;
+	double get_real(int) const;
+	std::string_view get_text(int) const;			///< Valid until the function returns.
+	std::span<const std::byte> get_blob(int) const;	///< Valid until the function returns.
+
+	void result_int(int);
+	void result_int64(int64_t);
+	void result_real(double);
+	void result_text(std::string_view);
+	void result_blob(const void*, size_t);
+	void result_null();
+	void result_error(const char*);
+
+	/** Aggregate state slot for the current group, initialized to nullptr.
+
+		Returns nullptr if create is false and the slot was never used, or on allocation failure.
+	*/
+	void** state(bool);
+
+	/** Argument converted to a c++ type. */
+	template <typename T>
+	T arg(int i) const
+	{
+		if constexpr (Optional<T>::value)
+		{
+			if (is_null(i))
+			{
+				return std::nullopt;
+			}
+			return arg<typename T::value_type>(i);
+		}
+		else if constexpr (std::is_same_v<T, bool>)
+		{
+			return get_int(i) != 0;
+		}
+		else if constexpr (std::is_integral_v<T> && sizeof(T) <= sizeof(int))
+		{
+			return static_cast<T>(get_int(i));
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			return static_cast<T>(get_int64(i));
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			return static_cast<T>(get_real(i));
+		}
+		else if constexpr (std::is_same_v<T, std::string_view>)
+		{
+			return get_text(i);
+		}
+		else if constexpr (std::is_same_v<T, std::string>)
+		{
+			return std::string(get_text(i));
+		}
+		else if constexpr (std::is_same_v<T, std::span<const std::byte>>)
+		{
+			return get_blob(i);
+		}
+		else if constexpr (std::is_same_v<T, std::vector<char>>)
+		{
+			auto v = get_blob(i);
+			return std::vector<char>(reinterpret_cast<const char*>(v.data()), reinterpret_cast<const char*>(v.data())+v.size());
+		}
+		else
+		{
+			static_assert(!sizeof(T), "unsupported argument type");
+		}
+	}
+
+	/** Set the result from a c++ value. */
+	template <typename T>
+	void result(const T& v)
+	{
+		if constexpr (Optional<T>::value)
+		{
+			if (!v)
+			{
+				result_null();
+				return;
+			}
+			result(*v);
+		}
+		else if constexpr (std::is_same_v<T, std::nullptr_t>)
+		{
+			result_null();
+		}
+		else if constexpr (std::is_integral_v<T> && sizeof(T) <= sizeof(int))
+		{
+			result_int(static_cast<int>(v));
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			result_int64(static_cast<int64_t>(v));
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			result_real(static_cast<double>(v));
+		}
+		else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+		{
+			result_text(std::string_view(v));
+		}
+		else if constexpr (std::is_same_v<T, std::vector<char>>)
+		{
+			result_blob(v.data(), v.size());
+		}
+		else if constexpr (std::is_same_v<T, std::span<const std::byte>>)
+		{
+			result_blob(v.data(), v.size());
+		}
+		else
+		{
+			static_assert(!sizeof(T), "unsupported result type");
+		}
+	}
+
+private:
+	template <typename T>
+	struct Optional
+	{
+		static constexpr bool value = false;
+	};
+	template <typename T>
+	struct Optional<std::optional<T>>
+	{
+		static constexpr bool value = true;
+	};
+};
+
+/** Signature of a callable, used to marshal user-defined function arguments. */
+template <typename F>
+struct FuncTraits : FuncTraits<decltype(&F::operator())> {};
+template <typename R, typename... A>
+struct FuncTraits<R(*)(A...)>
+{
+	using result_type = R;
+	using args = std::tuple<std::decay_t<A>...>;
+};
+template <typename R, typename C, typename... A>
+struct FuncTraits<R(C::*)(A...)> : FuncTraits<R(*)(A...)> {};
+template <typename R, typename C, typename... A>
+struct FuncTraits<R(C::*)(A...) const> : FuncTraits<R(*)(A...)> {};
+
+/** Callbacks of a user-defined function, see Conn::create_function() and Conn::create_aggregate().
+
+	A scalar function sets func; an aggregate sets step and final, and a window function adds inverse and value.
+*/
+struct FuncDef
+{
+	std::function<void(FuncCall&)> func;
+	std::function<void(FuncCall&)> step;
+	std::function<void(FuncCall&)> final;
+	std::function<void(FuncCall&)> inverse;
+	std::function<void(FuncCall&)> value;
+};
+
+class Req;
+class ColumnBatch;
+class ChangeStream;
+
 /** Database connection.
 
 	Uses the [uri method](https://sqlite.org/uri.html) to specifiy a connection.
@@ -57,17 +415,163 @@ namespace scc::sqld
 	to an [in-memory](https://sqlite.org/inmemorydb.html) database.
 
 	Once constructed or reopened, a database connection is thread-safe.
+
+	The connection keeps a bounded, least-recently-used cache of prepared statements. A Req which
+	consists of a single statement checks its compiled statement out of the cache, and returns it
+	when done, so the same sql text is compiled only once.
+
+	Connection settings can be given as Options, which are applied each time the connection is opened:
+
+	    Conn db("file:data.db?mode=rwc", Conn::Options::throughput());
 */
 class Conn
 {
+public:
+	/** Connection options.
+
+		Settings which are not set keep the sqlite default. They are applied in order, page size first,
+		since it cannot be changed once the database has tables or is in WAL mode.
+	*/
+	struct Options
+	{
+		/** Open flags for [sqlite3_open_v2](https://www.sqlite.org/c3ref/open.html).
+
+			If neither SQLITE_OPEN_READONLY nor SQLITE_OPEN_READWRITE is set, SQLITE_OPEN_READWRITE and
+			SQLITE_OPEN_CREATE are added, so 0 is read/write/create and SQLITE_OPEN_NOMUTEX alone is the same
+			with no connection mutex. SQLITE_OPEN_URI is always added. With SQLITE_OPEN_NOMUTEX, the connection must only be used by
+			one thread at a time.
+		*/
+		int flags = 0;
+		std::optional<int> page_size;				///< Page size in bytes, for a new database.
+		std::string journal_mode;					///< delete, truncate, persist, memory, wal or off; in-memory databases only support memory and off.
+		std::string synchronous;					///< off, normal, full or extra.
+		std::optional<int> cache_size;				///< Page cache size, in pages if positive, or in KiB if negative.
+		std::optional<int64_t> mmap_size;			///< Maximum bytes of the database file to memory map for reads.
+		std::string temp_store;						///< default, file or memory.
+		std::optional<int> busy_timeout;			///< Milliseconds to retry when the database is locked, sets a fixed BusyPolicy.
+
+		/** Settings for speed: WAL, normal sync, 256 MiB memory map, 64 MiB cache, temp tables in memory. */
+		static Options throughput();
+
+		/** Settings for durability: WAL, full sync on each commit. */
+		static Options durable();
+	};
+
+private:
 	sqlite3* m_db;
+	Options m_opts;
 	friend class Req;
+	friend class Trans;
+	friend class Savepoint;
+	friend class BlobStream;
+	friend class VTab;
+	friend class Snapshot;
+	friend class ChangeStream;
+	friend class Maintenance;
+	friend class Stmt;
+	friend struct Config;
+
+	static int open_conns();
+
+	struct CacheEntry
+	{
+		std::string sql;
+		sqlite3_stmt* stmt;
+	};
+	std::mutex m_cache_mx;
+	std::list<CacheEntry> m_cache;		// most recently used at front
+	std::unordered_map<std::string_view, std::list<CacheEntry>::iterator> m_cache_idx;	// keys refer to CacheEntry::sql
+	StmtCacheStats m_cache_stats;
+
+	sqlite3_stmt* checkout(std::string_view, std::string&);
+	void checkin(std::string&&, sqlite3_stmt*);
+	void cache_trim(size_t);
+	void cache_flush();
+
+	struct Profiler;
+	std::unique_ptr<Profiler> m_prof;
+
+	struct Busy;
+	std::unique_ptr<Busy> m_busy;
+
+	struct ResultCache;
+	std::unique_ptr<ResultCache> m_rcache;
 
+	std::mutex m_streams_mx;
+	std::vector<ChangeStream*> m_streams;		// attached change streams, captured at each Trans commit
+
+	void result_cache_hooks();
+	void result_cache_reset();		// the database was replaced without update hooks
+	std::shared_ptr<const ColumnBatch> cache_find(const std::string&);
+	std::shared_ptr<const ColumnBatch> cache_fill(const std::string&, std::string_view, const std::function<void(Req&)>&);
+
+	template <typename T>
+	static void cache_key(std::string& k, const T& v)		// typed encoding of a parameter
+	{
+		auto raw = [&k](const void* p, size_t sz) { k.append(static_cast<const char*>(p), sz); };
+		if constexpr (std::is_same_v<T, std::nullptr_t>)
+		{
+			k += 'n';
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			int64_t i = v;
+			k += 'i';
+			raw(&i, sizeof(i));
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			double d = v;
+			k += 'r';
+			raw(&d, sizeof(d));
+		}
+		else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+		{
+			std::string_view s(v);
+			uint64_t sz = s.size();
+			k += 't';
+			raw(&sz, sizeof(sz));
+			raw(s.data(), s.size());
+		}
+		else if constexpr (std::is_same_v<T, std::vector<char>>)
+		{
+			uint64_t sz = v.size();
+			k += 'b';
+			raw(&sz, sizeof(sz));
+			raw(v.data(), v.size());
+		}
+		else
+		{
+			static_assert(!sizeof(T), "unsupported parameter type");
+		}
+	}
+
+	void open(const std::string&);
 	void close();
+	void create_array_module();
+
+	void exec_cached(std::string_view);
+
+	void register_function(const std::string&, int, bool, std::unique_ptr<FuncDef>);
+
+	template <typename G, typename... A>
+	static decltype(auto) apply_args(G&& g, FuncCall& c, std::tuple<A...>*)
+	{
+		return [&]<size_t... I>(std::index_sequence<I...>) -> decltype(auto)
+		{
+			return g(c.arg<A>(I)...);
+		}(std::index_sequence_for<A...>());
+	}
 public:
 	/** Constructs and open a sqlite in-memory database connection.
 	*/
 	Conn(const std::string& = "file:mem?mode=memory&cache=shared");
+
+	/** Constructs and open a connection with options.
+
+		Throws an exception if the connection cannot be opened, or an option cannot be applied.
+	*/
+	Conn(const std::string&, const Options&);
 	virtual ~Conn();
 
 	Conn(const Conn&) = delete;
@@ -77,23 +581,349 @@ public:
 
 	/** Reopen the connection.
 
-		The database will be destroyed and reopened. This command is not thread-safe.
+		The database will be destroyed and reopened with the current options. This command is not thread-safe.
 	*/
 	void reopen(const std::string& = "file:mem?mode=memory&cache=shared");
+
+	/** Reopen the connection with new options. */
+	void reopen(const std::string&, const Options&);
+
+	/** Options applied when the connection is opened. */
+	const Options& options() const { return m_opts; }
+
+	/** Set the maximum memory used by the result cache, in bytes.
+
+		Least recently used results are removed if the cache is larger than the new size. A size of 0, the
+		default, disables the cache. See select_cached().
+	*/
+	void result_cache_size(size_t);
+
+	/** Result cache statistics. */
+	ResultCacheStats result_cache_stats();
+
+	/** Remove all results from the result cache, and reset the statistics. */
+	void result_cache_clear();
+
+	/** Select all rows into a columnar batch, using the result cache.
+
+		The cache is keyed by the sql text and the parameters, which are bound in order from index 1 as with
+		Req::bind(). A cached result is returned without running the statement; otherwise the rows are fetched
+		with Req::fetch_batch(), and the result is cached if the cache is enabled.
+
+		    db.result_cache_size(16 << 20);
+		    auto b = db.select_cached("SELECT key, value FROM config WHERE app = ?;", app);	// shared_ptr<const ColumnBatch>
+
+		A result is invalidated when a row of a table it reads is changed through this connection, or the
+		table is dropped or altered; changes made by other connections to the same database are not seen.
+		Results depending on other state, for example random() or the current time, should not be cached.
+		Throws an exception if the sql is not a single read-only statement.
+
+		While the cache is enabled, the truncate optimization for DELETE without WHERE is disabled,
+		so that the deleted rows are seen.
+	*/
+	template <typename... Args>
+	std::shared_ptr<const ColumnBatch> select_cached(std::string_view sql, const Args&... args)
+	{
+		std::string key(sql);
+		key += '\0';
+		(cache_key(key, args), ...);
+		if (auto b = cache_find(key))
+		{
+			return b;
+		}
+		return cache_fill(key, sql, [&](auto& req)
+		{
+			if constexpr (sizeof...(Args) > 0)
+			{
+				req.bind(args...);
+			}
+		});
+	}
+
+	/** Rowid of the last successful insert into a rowid table on this connection, 0 if none. */
+	int64_t last_insert_rowid();
+
+	/** Register a scalar sql function.
+
+		The number and types of the arguments and the result type are deduced from the callable, and converted
+		as described in FuncCall. A void result returns NULL, and an exception thrown by the function
+		fails the statement with its message.
+
+		A deterministic function always returns the same result for the same arguments, which lets the planner
+		use it in indexes and constraints, and evaluate it once for constant arguments.
+
+		    db.create_function("score", [](int64_t hits, double weight) { return hits*weight; });
+		    req.sql() << "SELECT id FROM docs WHERE score(hits, 0.5) > 10;";
+
+		Functions belong to the open database, and must be registered again after reopen().
+		Registering a function with the same name and number of arguments replaces it.
+	*/
+	template <typename F>
+	void create_function(const std::string& name, F f, bool deterministic = true)
+	{
+		using T = FuncTraits<F>;
+		using A = typename T::args;
+
+		auto def = std::make_unique<FuncDef>();
+		def->func = [f](FuncCall& c) mutable
+		{
+			if constexpr (std::is_void_v<typename T::result_type>)
+			{
+				apply_args(f, c, static_cast<A*>(nullptr));
+				c.result_null();
+			}
+			else
+			{
+				c.result(apply_args(f, c, static_cast<A*>(nullptr)));
+			}
+		};
+		register_function(name, std::tuple_size_v<A>, deterministic, std::move(def));
+	}
+
+	/** Register an aggregate sql function.
+
+		Each group starts with a copy of the initial state. The state type has a step() member, whose arguments
+		are the arguments of the function, and a value() member which returns the result:
+
+		    struct Mean
+		    {
+		        double sum = 0;
+		        int64_t n = 0;
+		        void step(double v) { sum += v; n++; }
+		        std::optional<double> value() const { return n ? std::optional<double>(sum/n) : std::nullopt; }
+		    };
+		    db.create_aggregate("mean", Mean());
+
+		If the state also has an inverse() member, with the same arguments as step(), which removes a value,
+		the function can be used as an aggregate [window function](https://www.sqlite.org/windowfunctions.html).
+
+		Functions belong to the open database, and must be registered again after reopen().
+	*/
+	template <typename S>
+	void create_aggregate(const std::string& name, const S& init = S(), bool deterministic = true)
+	{
+		using A = typename FuncTraits<decltype(&S::step)>::args;
+
+		auto def = std::make_unique<FuncDef>();
+		def->step = [init](FuncCall& c)
+		{
+			void** p = c.state(true);
+			if (!p)
+			{
+				throw std::bad_alloc();
+			}
+			if (!*p)
+			{
+				*p = new S(init);
+			}
+			S* s = static_cast<S*>(*p);
+			apply_args([s](auto&&... a) { s->step(std::forward<decltype(a)>(a)...); }, c, static_cast<A*>(nullptr));
+		};
+		def->final = [init](FuncCall& c)		// called once per group, destroys the state
+		{
+			void** p = c.state(false);
+			if (p && *p)
+			{
+				std::unique_ptr<S> s(static_cast<S*>(*p));
+				*p = nullptr;
+				c.result(s->value());
+			}
+			else
+			{
+				c.result(S(init).value());		// empty group
+			}
+		};
+		if constexpr (requires { &S::inverse; })
+		{
+			def->inverse = [](FuncCall& c)
+			{
+				void** p = c.state(false);
+				if (p && *p)
+				{
+					S* s = static_cast<S*>(*p);
+					apply_args([s](auto&&... a) { s->inverse(std::forward<decltype(a)>(a)...); }, c, static_cast<A*>(nullptr));
+				}
+			};
+			def->value = [init](FuncCall& c)
+			{
+				void** p = c.state(false);
+				if (p && *p)
+				{
+					c.result(static_cast<S*>(*p)->value());
+				}
+				else
+				{
+					c.result(S(init).value());
+				}
+			};
+		}
+		register_function(name, std::tuple_size_v<A>, deterministic, std::move(def));
+	}
+
+	/** Statement cache statistics. */
+	StmtCacheStats stmt_cache_stats();
+
+	/** Set the maximum number of statements in the statement cache.
+
+		Least recently used statements are finalized if the cache is larger than the new size.
+		A size of 0 disables the cache. The default is 64.
+	*/
+	void stmt_cache_size(size_t);
+
+	/** Finalize all statements in the statement cache, and reset the statistics.
+	*/
+	void stmt_cache_clear();
+
+	/** Memory used by the connection, from [sqlite3_db_status](https://www.sqlite.org/c3ref/db_status.html).
+	*/
+	MemoryUsage memory_usage();
+
+	/** Release as much memory as possible.
+
+		Frees unused page cache memory, finalizes the statements in the statement cache, and removes all results
+		from the result cache. Requests which are in use keep their statements. The caches fill again as the
+		connection is used.
+		\returns approximate number of bytes released
+	*/
+	int64_t release_memory();
+
+	/** Enable or disable statement profiling.
+
+		While enabled, executions of each statement are aggregated by normalized sql text, using
+		the [trace](https://www.sqlite.org/c3ref/trace_v2.html) and
+		[statement status](https://www.sqlite.org/c3ref/stmt_status.html) interfaces.
+		Execution time is measured from the first step to the reset or completion of the statement.
+		The overhead is a lookup and a lock per execution, and a counter per row, so profiling can be left on.
+
+		Disabling profiling keeps the statistics.
+	*/
+	void enable_profiling(bool = true);
+
+	/** Snapshot of the statement profiles, sorted by total time, highest first. */
+	std::vector<StmtProfile> stats();
+
+	/** Reset the statement profiles. */
+	void reset_stats();
+
+	/** Enable the slow query log.
+
+		Executions of statements which exceed the latency threshold, or which scan a table or build an automatic
+		index (usually a missing index), are kept in a bounded log. The query plan is captured with
+		[EXPLAIN QUERY PLAN](https://www.sqlite.org/eqp.html) when the execution completes. Uses the same trace
+		interface as statement profiling, and both may be enabled.
+
+		Enabling again replaces the options and keeps the log.
+	*/
+	void enable_slow_query_log(const SlowQueryOptions& = SlowQueryOptions());
+
+	/** Disable the slow query log, keeping the recorded executions. */
+	void disable_slow_query_log();
+
+	/** Snapshot of the slow query log, oldest first. */
+	std::vector<SlowQuery> slow_queries();
+
+	/** Clear the slow query log. */
+	void clear_slow_queries();
+
+	/** Set the busy handling policy.
+
+		The policy applies when this connection finds the database locked by another connection, and is kept
+		when the connection is reopened. The default is to fail at once.
+	*/
+	void busy_policy(const BusyPolicy&);
+
+	/** Current busy handling policy. */
+	BusyPolicy busy_policy();
+
+	/** Busy statistics. */
+	BusyStats busy_stats();
+
+	/** Reset the busy statistics. */
+	void reset_busy_stats();
+
+	/** Copy the main database to another connection, using the [online backup](https://www.sqlite.org/backup.html) api.
+
+		The copy is made in steps, and the source is only locked while a step runs. If the source is written
+		by another connection during the backup, the backup restarts; changes made through this connection
+		are copied to the destination.
+
+		A step which finds the source or destination locked is retried after the pause. Throws an exception if
+		no step succeeds for the busy_timeout, and the destination is unchanged.
+
+		\returns true if the backup completed, false if it was cancelled by the progress callback.
+	*/
+	bool backup_to(Conn&, const BackupOptions& = BackupOptions());
+
+	/** Copy the main database to the database at a uri, which is created if it does not exist. */
+	bool backup_to(const std::string&, const BackupOptions& = BackupOptions());
+
+	/** Replace the main database with a copy of the main database of another connection. */
+	bool restore_from(Conn&, const BackupOptions& = BackupOptions());
+
+	/** Replace the main database with a copy of the database at a uri. */
+	bool restore_from(const std::string&, const BackupOptions& = BackupOptions());
+
+	/** Serialize the main database.
+
+		\returns The database image, which is the same as the database file contents.
+	*/
+	std::vector<char> serialize();
+
+	/** Replace the main database with an in-memory database loaded from an image.
+
+		The main database of this connection is closed and replaced; other connections to it are not affected.
+		The statement cache is cleared, and requests on this connection should be cleared first.
+
+		With readonly, the image is used in place without a copy, and must remain valid until the connection
+		is closed or deserialized again, for example a MappedImage (see sqlite/image.h).
+		Otherwise the image is copied, and the database can be written.
+
+		An in-memory database cannot use a WAL, so the copy of an image in WAL mode is changed to rollback mode.
+		A read-only image in WAL mode cannot be changed and throws an exception; a MappedImage is changed
+		when it is mapped.
+	*/
+	void deserialize(std::span<const std::byte>, bool readonly = false);
+
+	/** Replace the main database with a copy of an image. */
+	void deserialize(const std::vector<char>& image) { deserialize(std::as_bytes(std::span(image))); }
 };
 
 /** Database transaction.
 
 	An active transaction will be aborted when the object is destroyed.
+
+	The [transaction mode](https://www.sqlite.org/lang_transaction.html) sets when locks are taken. A deferred
+	transaction takes the write lock on the first write, which can fail with SQLITE_BUSY if another connection
+	is writing; an immediate transaction takes the write lock when it begins:
+
+	    Trans x(db, Trans::Mode::immediate);
+	    x.begin();						// the write lock is held, or this throws
+
+	Transaction statements are kept in the connection's statement cache.
 */
 class Trans
 {
+public:
+	/** Transaction mode. */
+	enum class Mode
+	{
+		deferred,				///< BEGIN DEFERRED, the default.
+		immediate,				///< BEGIN IMMEDIATE, start a write transaction.
+		exclusive,				///< BEGIN EXCLUSIVE, also prevents readers outside of WAL mode.
+	};
+
+private:
 	Conn& m_conn;
+	Mode m_mode;
 	bool m_active;
+	friend class Snapshot;
 public:
-	Trans(Conn&);
+	Trans(Conn&, Mode = Mode::deferred);
 	virtual ~Trans();
 
+	/** Transaction mode. */
+	Mode mode() const { return m_mode; }
+
 	/** BEGIN the transaction.
 
 		Throws an exception if the transaction is already active.
@@ -102,7 +932,8 @@ public:
 	
 	/** COMMIT the transaction.
 
-		Throws an exception if the transaction is not active.
+		Adds the changes to each ChangeStream on the connection. Throws an exception if the transaction is not
+		active.
 	*/
 	void commit();
 	
@@ -116,6 +947,210 @@ public:
 	bool is_active() const { return m_active; }
 };
 
+/** Savepoint.
+
+	A [savepoint](https://www.sqlite.org/lang_savepoint.html) marks a point in a transaction which can be
+	rolled back to without aborting the transaction. Savepoints nest, and an active savepoint is rolled back
+	when the object is destroyed:
+
+	    Trans x(db);
+	    x.begin();
+	    for (auto& job : jobs)
+	    {
+	        Savepoint sp(db);
+	        if (run(job))
+	            sp.release();			// keep the changes
+	    }								// otherwise rolled back
+	    x.commit();
+
+	Outside of a transaction, a savepoint starts a transaction, which is committed by release().
+*/
+class Savepoint
+{
+	Conn& m_conn;
+	bool m_active;
+public:
+	/** Start the savepoint. */
+	Savepoint(Conn&);
+	virtual ~Savepoint();
+
+	Savepoint(const Savepoint&) = delete;
+	Savepoint& operator=(const Savepoint&) = delete;
+
+	/** RELEASE the savepoint, keeping the changes made since it started.
+
+		Throws an exception if the savepoint is not active.
+	*/
+	void release();
+
+	/** ROLLBACK TO and release the savepoint, undoing the changes made since it started.
+
+		Throws an exception if the savepoint is not active.
+	*/
+	void rollback();
+
+	/** Is this savepoint active? */
+	bool is_active() const { return m_active; }
+};
+
+/** Error result of a non-throwing operation.
+
+	The code and message are captured from the connection when the operation fails, and are the same as those
+	reported by the throwing api. Successful operations do not allocate.
+
+	See Result.
+*/
+struct Error
+{
+	int code;					///< Primary [result code](https://www.sqlite.org/rescode.html), for example SQLITE_BUSY; SQLITE_MISUSE for api usage errors.
+	int extended;				///< Extended result code, for example SQLITE_CONSTRAINT_UNIQUE.
+	std::string what;			///< Description, the message of sqlite for the failure, for example "UNIQUE constraint failed: t.id".
+};
+
+/** Result of a non-throwing operation, either a value or an Error.
+
+	Used by the try_ methods of Req, so that expected failures such as SQLITE_BUSY or constraint violations
+	can be handled without the cost of an exception:
+
+	    auto r = req.try_exec();
+	    if (!r && r.error().code == SQLITE_BUSY)
+	        ...
+*/
+template <typename T>
+class Result
+{
+	T m_val;
+	Error m_err;
+public:
+	Result(T v) : m_val(std::move(v)), m_err{0, 0, {}} {}
+	Result(const Error& e) : m_val(), m_err(e) {}
+
+	/** Did the operation succeed? */
+	bool has_value() const { return m_err.code == 0; }
+	explicit operator bool() const { return has_value(); }
+
+	/** Value, which throws an exception if the operation failed. */
+	const T& value() const
+	{
+		if (!has_value())
+		{
+			throw std::runtime_error(m_err.what);
+		}
+		return m_val;
+	}
+
+	/** Value, without checking. */
+	const T& operator*() const { return m_val; }
+
+	/** Error, if the operation failed. */
+	const Error& error() const { return m_err; }
+};
+
+/** Result of a non-throwing operation without a value. */
+template <>
+class Result<void>
+{
+	Error m_err;
+public:
+	Result() : m_err{0, 0, {}} {}
+	Result(const Error& e) : m_err(e) {}
+
+	/** Did the operation succeed? */
+	bool has_value() const { return m_err.code == 0; }
+	explicit operator bool() const { return has_value(); }
+
+	/** Throws an exception if the operation failed. */
+	void value() const
+	{
+		if (!has_value())
+		{
+			throw std::runtime_error(m_err.what);
+		}
+	}
+
+	/** Error, if the operation failed. */
+	const Error& error() const { return m_err; }
+};
+
+/** Adapter to iterate rows as a user type.
+
+	Specialize for a user type with the column types, and a function to construct the type from the
+	column values, for example:
+
+	    struct Rec { int64_t id; std::string name; };
+
+	    template <> struct scc::sqld::RowAdapter<Rec>
+	    {
+	        using columns = std::tuple<int64_t, std::string>;
+	        static Rec make(int64_t id, std::string name) { return Rec{id, std::move(name)}; }
+	    };
+
+	    for (const auto& r : req.rows<Rec>()) ...
+
+	See Req::rows().
+*/
+template <typename T>
+struct RowAdapter;
+
+/** Typed row range.
+
+	See Req::rows().
+*/
+template <typename... Ts>
+class Rows
+{
+	template <typename T>
+	struct Adapted
+	{
+		static constexpr bool value = false;
+	};
+	template <typename T> requires requires { typename RowAdapter<T>::columns; }
+	struct Adapted<T>
+	{
+		static constexpr bool value = true;
+	};
+
+	template <typename T>
+	struct Columns
+	{
+		using type = std::tuple<Ts...>;
+	};
+	template <typename T> requires (Adapted<T>::value)
+	struct Columns<T>
+	{
+		using type = typename RowAdapter<T>::columns;
+	};
+
+	static constexpr bool adapted = sizeof...(Ts) == 1 && (Adapted<Ts>::value && ...);
+public:
+	/** Column value types. */
+	using columns = typename Columns<std::tuple_element_t<0, std::tuple<Ts...>>>::type;
+	/** Row type, either the adapted type or a tuple of the column types. */
+	using value_type = std::conditional_t<adapted, std::tuple_element_t<0, std::tuple<Ts...>>, std::tuple<Ts...>>;
+
+	class iterator
+	{
+		Req* m_req;		// null at end
+
+		template <size_t... I>
+		columns get(std::index_sequence<I...>);
+	public:
+		iterator(Req* req) : m_req(req) {}
+
+		value_type operator*();
+		iterator& operator++();
+		bool operator==(const iterator& o) const { return m_req == o.m_req; }
+		bool operator!=(const iterator& o) const { return m_req != o.m_req; }
+	};
+private:
+	Req& m_req;
+public:
+	Rows(Req& req) : m_req(req) {}
+
+	iterator begin();
+	iterator end() { return iterator(nullptr); }
+};
+
 /** Database request.
 
 	Sqlite [data types](https://www.sqlite.org/datatype3.html) are more flexible than standard databases,
@@ -124,18 +1159,170 @@ public:
 	Information on the recent STRICT table option is [here](https://www.sqlite.org/stricttables.html).
 
 	UTF-16 values are not implemented.
+
+	The col_text_view() and col_blob_view() accessors refer to memory owned by sqlite, and are valid
+	until the next call to next_row(), exec_select(), reset() or clear(), and until
+	another accessor converts the same column to a different type.
+
+	Values can be bound to [parameters](https://www.sqlite.org/lang_expr.html#varparam) in the sql statement,
+	for example:
+
+	    req.sql() << "insert into t values(?, :name);";
+	    req.bind_int(1, 10);
+	    req.bind_text(":name", "ten");
+	    req.exec();
+	    req.reset();					// reuses the compiled statement
+	    req.bind(11, "eleven");			// bind parameters 1 and 2
+	    req.exec();
+
+	Parameters are bound to the next statement to be executed. Bindings are kept by reset().
 */
 class Req
 {
 	Conn& m_conn;
 	sqlite3_stmt* m_stmt;
+	std::string m_key;		// statement cache key, empty if the statement is not cached
+	bool m_first;			// statement is the first in the sql stream
+	bool m_pending;			// statement is ready to execute, and may be bound
+
+	bool m_compiled;							// statements are taken from the script
+	std::vector<sqlite3_stmt*> m_script;		// compiled statements
+	std::string m_script_sql;					// snapshot of the stream when compiled
+	std::string::size_type m_script_pos;		// position of first statement not yet compiled
+	size_t m_next;								// next script statement to execute
 
 	std::ostringstream m_sql;
 	std::string::size_type m_pos;
 	int m_cols;
 
 	void finalize();
-	void prepare();
+	void uncompile();
+	int compile_next();
+	int prepare();
+	Error error(int) const;
+	[[noreturn]] static void raise(const Error&);
+	Error bind_stmt();
+
+	static void check(const Error& e)
+	{
+		if (e.code)
+		{
+			throw std::runtime_error(e.what);
+		}
+	}
+
+	// non-throwing binds
+	Error bind_value(int, int);
+	Error bind_value(int, int64_t);
+	Error bind_value(int, double);
+	Error bind_value(int, std::string_view);
+	Error bind_value(int, const void*, size_t);
+	Error bind_value(int, std::nullptr_t);
+	void check_col(int) const;
+
+	template <typename...> friend class Rows;
+
+	// unchecked column access for typed rows
+	bool get_null(int);
+	int get_int(int);
+	int64_t get_int64(int);
+	double get_real(int);
+	std::string_view get_text(int);
+	std::span<const std::byte> get_blob(int);
+
+	template <typename T>
+	struct Optional
+	{
+		static constexpr bool value = false;
+	};
+	template <typename T>
+	struct Optional<std::optional<T>>
+	{
+		static constexpr bool value = true;
+	};
+
+	template <typename T>
+	T get(int col)
+	{
+		if constexpr (Optional<T>::value)
+		{
+			if (get_null(col))
+			{
+				return std::nullopt;
+			}
+			return get<typename T::value_type>(col);
+		}
+		else if constexpr (std::is_same_v<T, bool>)
+		{
+			return get_int(col) != 0;
+		}
+		else if constexpr (std::is_integral_v<T> && sizeof(T) <= sizeof(int))
+		{
+			return static_cast<T>(get_int(col));
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			return static_cast<T>(get_int64(col));
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			return static_cast<T>(get_real(col));
+		}
+		else if constexpr (std::is_same_v<T, std::string_view>)
+		{
+			return get_text(col);
+		}
+		else if constexpr (std::is_same_v<T, std::string>)
+		{
+			return std::string(get_text(col));
+		}
+		else if constexpr (std::is_same_v<T, std::span<const std::byte>>)
+		{
+			return get_blob(col);
+		}
+		else if constexpr (std::is_same_v<T, std::vector<char>>)
+		{
+			auto v = get_blob(col);
+			return std::vector<char>(reinterpret_cast<const char*>(v.data()), reinterpret_cast<const char*>(v.data())+v.size());
+		}
+		else
+		{
+			static_assert(!sizeof(T), "unsupported column type");
+		}
+	}
+
+	template <typename T>
+	Error bind_arg(int idx, const T& v)
+	{
+		if constexpr (std::is_same_v<T, std::nullptr_t>)
+		{
+			return bind_value(idx, nullptr);
+		}
+		else if constexpr (std::is_integral_v<T> && sizeof(T) <= sizeof(int) && (std::is_signed_v<T> || sizeof(T) < sizeof(int)))
+		{
+			return bind_value(idx, static_cast<int>(v));
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			return bind_value(idx, static_cast<int64_t>(v));
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			return bind_value(idx, static_cast<double>(v));
+		}
+		else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+		{
+			return bind_value(idx, std::string_view(v));
+		}
+		else if constexpr (std::is_same_v<T, std::vector<char>>)
+		{
+			return bind_value(idx, static_cast<const void*>(v.data()), v.size());
+		}
+		else
+		{
+			static_assert(!sizeof(T), "unsupported bind type");
+		}
+	}
 public:
 	Req(Conn&);
 	virtual ~Req();
@@ -150,9 +1337,165 @@ public:
 
 		After this call, the sql() stream is unchanged, and the request is initialized to start of stream.
 		The sql stream can then be executed again.
+
+		If the current statement is the first in the stream, it is reset and reused without compiling,
+		and its parameter bindings are kept.
 	*/
 	void reset();
 
+	/** Compile all statements in the sql() stream.
+
+		After this call, the request executes the compiled statements, and changes to the sql() stream are
+		ignored until clear() is called. After execution, reset() rewinds to the first statement without
+		compiling, so the script can be executed repeatedly.
+
+		Statements which depend on schema changes made by earlier statements (for example, an insert into
+		a table created by the script) are compiled when they are first executed.
+	*/
+	void compile();
+
+	/** Bind 32-bit INTEGER.
+		\param idx one-indexed parameter
+	*/
+	void bind_int(int, int);
+
+	/** Bind 64-bit INTEGER.
+		\param idx one-indexed parameter
+	*/
+	void bind_int64(int, int64_t);
+
+	/** Bind 64-bit REAL.
+		\param idx one-indexed parameter
+	*/
+	void bind_real(int, double);
+
+	/** Bind UTF-8 TEXT.
+
+		The text is copied.
+		\param idx one-indexed parameter
+	*/
+	void bind_text(int, std::string_view);
+
+	/** Bind BLOB unstructured data.
+
+		The data is copied.
+		\param idx one-indexed parameter
+	*/
+	void bind_blob(int, const void*, size_t);
+
+	/** Bind BLOB unstructured data.
+		\param idx one-indexed parameter
+	*/
+	void bind_blob(int idx, const std::vector<char>& v)
+	{
+		bind_blob(idx, v.data(), v.size());
+	}
+
+	/** Bind NULL.
+		\param idx one-indexed parameter
+	*/
+	void bind_null(int);
+
+	/** Bind a BLOB of zeros, without allocating it.
+
+		Used to reserve space for a BLOB which is then written with BlobStream.
+		\param idx one-indexed parameter
+		\param sz size in bytes
+	*/
+	void bind_zeroblob(int, size_t);
+
+	/** Bind an array, for use with the carray table-valued function.
+
+		Every connection has the carray function, which returns the elements of an array parameter as rows of
+		a value column, so a single cached statement can take a list of any size:
+
+		    std::vector<int64_t> ids = ...;
+		    req.sql() << "SELECT name FROM t WHERE id IN carray(?);";
+		    req.bind_array(1, ids);
+
+		The elements are not copied; the array must remain valid until the statement is reset or the
+		parameter is bound again.
+		\param idx one-indexed parameter
+	*/
+	void bind_array(int, std::span<const int64_t>);
+
+	/** Bind an array of REAL values. */
+	void bind_array(int, std::span<const double>);
+
+	/** Bind an array of TEXT values. */
+	void bind_array(int, std::span<const std::string_view>);
+
+	/** Return the index of a named parameter, for example ":name".
+
+		Throws an exception if the statement does not have the parameter.
+	*/
+	int bind_index(const std::string&);
+
+	/** Bind 32-bit INTEGER to named parameter. */
+	void bind_int(const std::string& name, int v) { bind_int(bind_index(name), v); }
+
+	/** Bind 64-bit INTEGER to named parameter. */
+	void bind_int64(const std::string& name, int64_t v) { bind_int64(bind_index(name), v); }
+
+	/** Bind 64-bit REAL to named parameter. */
+	void bind_real(const std::string& name, double v) { bind_real(bind_index(name), v); }
+
+	/** Bind UTF-8 TEXT to named parameter. */
+	void bind_text(const std::string& name, std::string_view v) { bind_text(bind_index(name), v); }
+
+	/** Bind BLOB unstructured data to named parameter. */
+	void bind_blob(const std::string& name, const void* v, size_t sz) { bind_blob(bind_index(name), v, sz); }
+
+	/** Bind BLOB unstructured data to named parameter. */
+	void bind_blob(const std::string& name, const std::vector<char>& v) { bind_blob(bind_index(name), v); }
+
+	/** Bind NULL to named parameter. */
+	void bind_null(const std::string& name) { bind_null(bind_index(name)); }
+
+	/** Bind a BLOB of zeros to named parameter. */
+	void bind_zeroblob(const std::string& name, size_t sz) { bind_zeroblob(bind_index(name), sz); }
+
+	/** Bind an array to named parameter. */
+	void bind_array(const std::string& name, std::span<const int64_t> v) { bind_array(bind_index(name), v); }
+
+	/** Bind an array of REAL values to named parameter. */
+	void bind_array(const std::string& name, std::span<const double> v) { bind_array(bind_index(name), v); }
+
+	/** Bind an array of TEXT values to named parameter. */
+	void bind_array(const std::string& name, std::span<const std::string_view> v) { bind_array(bind_index(name), v); }
+
+	/** Bind all parameters in order, starting with parameter 1.
+
+		Integral, floating point, string, std::vector<char> (BLOB) and nullptr (NULL) values are supported.
+	*/
+	template <typename... Args>
+	void bind(const Args&... args)
+	{
+		int idx = 1;
+		(check(bind_arg(idx++, args)), ...);
+	}
+
+	/** Bind all parameters in order, starting with parameter 1, without throwing exceptions.
+
+		Stops at the first parameter which fails. See bind().
+	*/
+	template <typename... Args>
+	Result<void> try_bind(const Args&... args)
+	{
+		Error e{0, 0, {}};
+		int idx = 1;
+		((e = bind_arg(idx++, args), e.code == 0) && ...);
+		if (e.code)
+		{
+			return e;
+		}
+		return Result<void>();
+	}
+
+	/** Set all parameters of the current statement to NULL.
+	*/
+	void clear_bindings();
+
 	/** Executes in select mode.
 
 		Executes statements in sql() stream, until either row data is available, or there are no more
@@ -178,6 +1521,18 @@ public:
 	*/
 	void exec();
 
+	/** Executes in select mode, without throwing exceptions. See exec_select(). */
+	Result<int> try_exec_select();
+
+	/** Get the next row, without throwing exceptions. See next_row(). */
+	Result<int> try_next_row();
+
+	/** Execute all statements, ignoring all row data, without throwing exceptions. See exec().
+
+		After an error, the request can be reset() to retry.
+	*/
+	Result<void> try_exec();
+
 	/** Return column name.
 		\param col zero-indexed column
 	*/
@@ -198,6 +1553,13 @@ public:
 	*/
 	void col_text(int, std::string&);
 
+	/** Return UTF-8 TEXT without copying.
+
+		NULL values are returned as an empty view.
+		\param col zero-indexed column
+	*/
+	std::string_view col_text_view(int);
+
 	/** Return 32-bit INTEGER.
 		\param col zero-indexed column
 	*/
@@ -218,6 +1580,52 @@ public:
 	*/
 	void col_blob(int, std::vector<char>&);
 
+	/** Return BLOB unstructured data without copying.
+
+		NULL values are returned as an empty span.
+		\param col zero-indexed column
+	*/
+	std::span<const std::byte> col_blob_view(int);
+
+	/** Return size in bytes of TEXT or BLOB data.
+
+		Can be used to size a buffer before copying the data from col_text_view() or col_blob_view().
+		\param col zero-indexed column
+	*/
+	int col_bytes(int);
+
+	/** Typed rows of the current select statement.
+
+		Iterates over the rows, converting each column directly to the requested type, for example:
+
+		    req.sql() << "select id, name, score from t;";
+		    for (auto [id, name, score] : req.rows<int64_t, std::string_view, double>())
+		        ...
+
+		If there is no current row data, exec_select() is called when iteration begins. The number of columns
+		is checked once, when iteration begins; an exception is thrown if it does not match the number of types.
+
+		Supported types are integral and floating point types, std::string, std::string_view,
+		std::vector<char>, std::span<const std::byte>, and std::optional of these, which is empty
+		for NULL values. Views are valid until the next row. A single type specialized with RowAdapter
+		iterates rows as that type.
+	*/
+	template <typename... Ts>
+	Rows<Ts...> rows()
+	{
+		return Rows<Ts...>(*this);
+	}
+
+	/** Fetch rows of the current select statement into a columnar batch.
+
+		The batch is cleared, and filled with up to max_rows rows. If there is no current row data,
+		exec_select() is called first. After this call, the request is positioned at the first row not fetched,
+		so fetch_batch() can be called again to continue the scan. ColumnBatch is declared in sqlite/batch.h.
+
+		\returns Number of rows fetched, or 0 if no row data.
+	*/
+	size_t fetch_batch(ColumnBatch&, size_t);
+
 	/** Sql streamer.
 
 		Adds to the request, for example:
@@ -233,6 +1641,55 @@ public:
 	}
 };
 
+template <typename... Ts>
+template <size_t... I>
+typename Rows<Ts...>::columns Rows<Ts...>::iterator::get(std::index_sequence<I...>)
+{
+	return columns{m_req->get<std::tuple_element_t<I, columns>>(I)...};		// braced init evaluates in order
+}
+
+template <typename... Ts>
+typename Rows<Ts...>::value_type Rows<Ts...>::iterator::operator*()
+{
+	if constexpr (adapted)
+	{
+		return std::apply(RowAdapter<value_type>::make, get(std::make_index_sequence<std::tuple_size_v<columns>>()));
+	}
+	else
+	{
+		return get(std::make_index_sequence<std::tuple_size_v<columns>>());
+	}
+}
+
+template <typename... Ts>
+typename Rows<Ts...>::iterator& Rows<Ts...>::iterator::operator++()
+{
+	if (!m_req->next_row())
+	{
+		m_req = nullptr;
+	}
+	return *this;
+}
+
+template <typename... Ts>
+typename Rows<Ts...>::iterator Rows<Ts...>::begin()
+{
+	int cols = m_req.m_cols;
+	if (!cols)
+	{
+		cols = m_req.exec_select();
+	}
+	if (!cols)
+	{
+		return end();
+	}
+	if (cols != static_cast<int>(std::tuple_size_v<columns>))
+	{
+		throw std::runtime_error("rows() called with wrong number of column types");
+	}
+	return iterator(&m_req);
+}
+
 /** @} */
 }
 
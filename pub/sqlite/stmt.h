@@ -0,0 +1,206 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_STMT_H
+#define _SCC_SQLD_STMT_H
+
+#include <sqlite/sqld.h>
+#include <string>
+#include <string_view>
+#include <span>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Movable prepared statement.
+	\file
+*/
+
+/** Prepared statement handle.
+
+	A Stmt owns only a prepared statement, so it is small, movable, and can be kept in containers or returned
+	from functions. It is meant for hot paths which run one statement many times, and do not need the sql
+	stream, multiple statements or the statement cache of Req:
+
+	    Stmt ins(db, "insert into t values(?, ?);");
+	    for (auto& r : records)
+	    {
+	        ins.bind(r.id, r.name);
+	        ins.exec();						// runs the statement and resets it
+	    }
+
+	    Stmt sel(db, "select name from t where id = ?;");
+	    sel.bind(10);
+	    while (sel.step())
+	    {
+	        auto name = sel.col_text_view(0);
+	    }
+	    sel.reset();
+
+	The statement is prepared with SQLITE_PREPARE_PERSISTENT, since it is expected to be used many times.
+	Column accessors are valid while step() has returned true, and text and blob views until the next step(),
+	reset() or conversion of the column. Bindings are kept by reset().
+
+	Statements must be destroyed before their connection is closed or reopened.
+*/
+class Stmt
+{
+	sqlite3_stmt* m_stmt;
+
+	void check(int) const;
+	void check_col(int) const;
+
+	void bind_value(int, int);
+	void bind_value(int, int64_t);
+	void bind_value(int, double);
+	void bind_value(int, std::string_view);
+	void bind_value(int, const void*, size_t);
+	void bind_value(int, std::nullptr_t);
+
+	template <typename T>
+	void bind_arg(int idx, const T& v)
+	{
+		if constexpr (std::is_same_v<T, std::nullptr_t>)
+		{
+			bind_value(idx, nullptr);
+		}
+		else if constexpr (std::is_integral_v<T> && sizeof(T) <= sizeof(int) && (std::is_signed_v<T> || sizeof(T) < sizeof(int)))
+		{
+			bind_value(idx, static_cast<int>(v));
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			bind_value(idx, static_cast<int64_t>(v));
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			bind_value(idx, static_cast<double>(v));
+		}
+		else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+		{
+			bind_value(idx, std::string_view(v));
+		}
+		else if constexpr (std::is_same_v<T, std::vector<char>>)
+		{
+			bind_value(idx, static_cast<const void*>(v.data()), v.size());
+		}
+		else
+		{
+			static_assert(!sizeof(T), "unsupported bind type");
+		}
+	}
+public:
+	/** Construct an empty handle. */
+	Stmt() noexcept : m_stmt(nullptr) {}
+
+	/** Prepare a statement.
+
+		Throws an exception if the sql is invalid, or has more than one statement.
+	*/
+	Stmt(Conn&, std::string_view);
+
+	/** Finalize the statement. */
+	~Stmt();
+
+	Stmt(const Stmt&) = delete;
+	Stmt& operator=(const Stmt&) = delete;
+
+	/** Move the statement, leaving the other handle empty. */
+	Stmt(Stmt&& other) noexcept : m_stmt(other.m_stmt)
+	{
+		other.m_stmt = nullptr;
+	}
+
+	/** Finalize the current statement, and move the statement, leaving the other handle empty. */
+	Stmt& operator=(Stmt&&) noexcept;
+
+	/** True if the handle has a statement. */
+	explicit operator bool() const { return m_stmt != nullptr; }
+
+	/** Sql text of the statement. */
+	std::string_view sql() const;
+
+	void bind_int(int idx, int v) { bind_value(idx, v); }
+	void bind_int64(int idx, int64_t v) { bind_value(idx, v); }
+	void bind_real(int idx, double v) { bind_value(idx, v); }
+	void bind_text(int idx, std::string_view v) { bind_value(idx, v); }
+	void bind_blob(int idx, const void* v, size_t sz) { bind_value(idx, v, sz); }
+	void bind_null(int idx) { bind_value(idx, nullptr); }
+
+	/** Index of a named parameter, for example ":name". Throws an exception if it does not exist. */
+	int bind_index(const std::string&);
+
+	/** Bind all parameters in order, starting with parameter 1. See Req::bind(). */
+	template <typename... Args>
+	void bind(const Args&... args)
+	{
+		int idx = 1;
+		(bind_arg(idx++, args), ...);
+	}
+
+	/** Set all parameters to NULL. */
+	void clear_bindings();
+
+	/** Run the statement to the next row.
+
+		Throws an exception on error, and the statement must then be reset.
+		\returns true if a row is available, false if the statement is done
+	*/
+	bool step();
+
+	/** Run the statement to completion, ignoring any rows, and reset it. */
+	void exec();
+
+	/** Reset the statement, so it runs from the start. Bindings are kept. */
+	void reset();
+
+	/** Number of columns in the result. */
+	int columns() const;
+
+	bool col_null(int);
+	int col_int(int);
+	int64_t col_int64(int);
+	double col_real(int);
+	std::string_view col_text_view(int);
+	std::span<const std::byte> col_blob_view(int);
+};
+
+/** @} */
+}
+
+#endif
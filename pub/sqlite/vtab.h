@@ -0,0 +1,220 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _SCC_SQLD_VTAB_H
+#define _SCC_SQLD_VTAB_H
+
+#include <sqlite/sqld.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+namespace scc::sqld
+{
+
+/** \addtogroup sqlite
+	@{
+*/
+
+/** Virtual tables over c++ containers.
+	\file
+*/
+
+/** Column of a virtual table.
+
+	Made with VectorTable::column().
+*/
+struct VTabColumn
+{
+	std::string name;
+	std::string type;											///< Declared type, for example INTEGER.
+	std::function<void(const void*, FuncCall&)> get;			///< Set the result to the value of the row.
+	std::function<int64_t(const void*)> int_key;				///< INTEGER key of the row, if the column can be a key.
+	std::function<double(const void*)> real_key;				///< REAL key of the row, if the column can be a key.
+	std::function<std::string_view(const void*)> text_key;		///< TEXT key of the row, if the column can be a key.
+};
+
+/** Type-erased read-only virtual table.
+
+	Implements the sqlite [virtual table](https://www.sqlite.org/vtab.html) module, with rows provided by
+	a derived class.
+*/
+class VTab
+{
+	std::vector<VTabColumn> m_cols;
+	int m_key;
+public:
+	/** Construct with columns, and the name of the key column, or empty if there is no key.
+
+		Throws an exception if the key column does not exist, or does not have an INTEGER, REAL or TEXT key.
+	*/
+	VTab(std::vector<VTabColumn>, const std::string&);
+	virtual ~VTab() {}
+
+	/** Copy of the table, owned by sqlite when installed. */
+	virtual VTab* clone() const = 0;
+
+	/** Number of rows. */
+	virtual size_t size() const = 0;
+
+	/** Row, passed to the column accessors. */
+	virtual const void* row(size_t) const = 0;
+
+	const std::vector<VTabColumn>& columns() const { return m_cols; }
+
+	/** Index of the key column, or -1 if there is no key. */
+	int key() const { return m_key; }
+
+	/** Create table statement declaring the columns. */
+	std::string schema() const;
+
+	/** Install the table on a connection as an [eponymous](https://www.sqlite.org/vtab.html#eponymous_virtual_tables)
+		virtual table with the given name, which can be used in queries like any table.
+
+		Installing a table with the same name replaces it. Like functions, tables belong to the open database, and
+		must be installed again after Conn::reopen().
+
+		Throws an exception if the key column is not sorted.
+	*/
+	void install(Conn&, const std::string&) const;
+};
+
+/** Read-only virtual table which reads the elements of a vector in place.
+
+	Each column is read from an element by a member pointer or a callable. If the vector is sorted in ascending
+	order by a key column, equality and range constraints on the key are found by binary search, and
+	ORDER BY the key needs no sort:
+
+	    struct Rec { int64_t id; std::string name; double score; };
+	    std::vector<Rec> recs = ...;			// sorted by id
+
+	    using VT = VectorTable<Rec>;
+	    VT(recs, {VT::column("id", &Rec::id), VT::column("name", &Rec::name), VT::column("score", &Rec::score)}, "id")
+	        .install(db, "recs");
+
+	    req.sql() << "SELECT r.name, o.total FROM orders o JOIN recs r ON r.id = o.rec_id;";
+
+	The vector is referenced, not copied; it must outlive the queries using the table, and must not be modified
+	while a query is running.
+*/
+template <typename T>
+class VectorTable : public VTab
+{
+	const std::vector<T>* m_vec;
+
+	template <typename V>
+	struct Optional
+	{
+		using type = V;
+	};
+	template <typename V>
+	struct Optional<std::optional<V>>
+	{
+		using type = V;
+	};
+
+	template <typename V>
+	static std::string decl_type()
+	{
+		using U = typename Optional<V>::type;
+		if constexpr (std::is_integral_v<U>)
+		{
+			return "INTEGER";
+		}
+		else if constexpr (std::is_floating_point_v<U>)
+		{
+			return "REAL";
+		}
+		else if constexpr (std::is_convertible_v<const U&, std::string_view>)
+		{
+			return "TEXT";
+		}
+		else if constexpr (std::is_same_v<U, std::vector<char>> || std::is_same_v<U, std::span<const std::byte>>)
+		{
+			return "BLOB";
+		}
+		else
+		{
+			static_assert(!sizeof(U), "unsupported column type");
+		}
+	}
+public:
+	/** Construct with columns, and the name of the key column, or empty if there is no key. */
+	VectorTable(const std::vector<T>& v, std::vector<VTabColumn> cols, const std::string& key = "")
+		: VTab(std::move(cols), key), m_vec(&v) {}
+
+	VTab* clone() const { return new VectorTable(*this); }
+	size_t size() const { return m_vec->size(); }
+	const void* row(size_t i) const { return &(*m_vec)[i]; }
+
+	/** Column read from an element by a member pointer, or a callable taking const T&.
+
+		Types are converted as described in FuncCall. Integral, floating point, std::string_view and std::string
+		members can be keys; a callable returning std::string by value cannot be a TEXT key.
+	*/
+	template <typename F>
+	static VTabColumn column(const std::string& name, F f)
+	{
+		using R = std::invoke_result_t<const F&, const T&>;
+		using V = std::remove_cvref_t<R>;
+
+		VTabColumn c;
+		c.name = name;
+		c.type = decl_type<V>();
+		c.get = [f](const void* p, FuncCall& fc)
+		{
+			fc.result(std::invoke(f, *static_cast<const T*>(p)));
+		};
+		if constexpr (std::is_integral_v<V>)
+		{
+			c.int_key = [f](const void* p) -> int64_t { return std::invoke(f, *static_cast<const T*>(p)); };
+		}
+		else if constexpr (std::is_floating_point_v<V>)
+		{
+			c.real_key = [f](const void* p) -> double { return std::invoke(f, *static_cast<const T*>(p)); };
+		}
+		else if constexpr (std::is_same_v<V, std::string_view> || (std::is_same_v<V, std::string> && std::is_reference_v<R>))
+		{
+			c.text_key = [f](const void* p) -> std::string_view { return std::invoke(f, *static_cast<const T*>(p)); };
+		}
+		return c;
+	}
+};
+
+/** @} */
+}
+
+#endif
@@ -0,0 +1,208 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/queue.h>
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite group commit write queue implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+using std::chrono::steady_clock;
+
+WriteQueue::WriteQueue(Conn& conn, const WriteQueueOptions& opts) : m_conn(conn), m_opts(opts), m_stop(false),
+	m_stats{0, 0, 0, 0, 0}
+{
+	if (m_opts.max_batch < 1)
+	{
+		m_opts.max_batch = 1;
+	}
+	m_thread = std::thread(&WriteQueue::run, this);
+}
+
+WriteQueue::~WriteQueue()
+{
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_stop = true;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+}
+
+std::future<void> WriteQueue::submit(std::function<void(Conn&)> fn)
+{
+	Item it{std::move(fn), std::promise<void>(), steady_clock::now()};
+	auto f = it.done.get_future();
+
+	bool wake;
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_queue.push_back(std::move(it));
+		wake = m_queue.size() == 1 || m_queue.size() >= m_opts.max_batch;		// start a batch, or a batch is full
+	}
+	if (wake)
+	{
+		m_cv.notify_one();
+	}
+	return f;
+}
+
+WriteQueueStats WriteQueue::stats()
+{
+	std::lock_guard<std::mutex> lk(m_mx);
+	return m_stats;
+}
+
+void WriteQueue::run()
+{
+	std::unique_lock<std::mutex> lk(m_mx);
+	for (;;)
+	{
+		m_cv.wait(lk, [this] { return m_stop || !m_queue.empty(); });
+		if (m_queue.empty())
+		{
+			return;						// stopped, and all queued writes are committed
+		}
+
+		auto deadline = m_queue.front().queued + m_opts.max_latency;
+		m_cv.wait_until(lk, deadline, [this] { return m_stop || m_queue.size() >= m_opts.max_batch; });
+
+		std::deque<Item> batch;
+		size_t n = std::min(m_queue.size(), m_opts.max_batch);
+		for (size_t i = 0; i < n; i++)
+		{
+			batch.push_back(std::move(m_queue.front()));
+			m_queue.pop_front();
+		}
+
+		lk.unlock();
+		commit(batch);
+		lk.lock();
+	}
+}
+
+void WriteQueue::commit(std::deque<Item>& batch)
+{
+	std::vector<std::exception_ptr> errs(batch.size());
+	std::exception_ptr batch_err;
+	uint64_t failed = 0;
+
+	Trans x(m_conn, Trans::Mode::immediate);
+	try
+	{
+		x.begin();
+	}
+	catch (...)
+	{
+		batch_err = std::current_exception();
+	}
+
+	for (size_t i = 0; !batch_err && i < batch.size(); i++)
+	{
+		try
+		{
+			Savepoint sp(m_conn);
+			try
+			{
+				batch[i].fn(m_conn);
+				sp.release();
+			}
+			catch (...)
+			{
+				errs[i] = std::current_exception();
+				failed++;
+				sp.rollback();
+			}
+		}
+		catch (...)
+		{
+			batch_err = std::current_exception();		// the savepoint failed, so the transaction was rolled back by sqlite
+		}
+	}
+
+	if (!batch_err)
+	{
+		try
+		{
+			x.commit();
+		}
+		catch (...)
+		{
+			batch_err = std::current_exception();
+		}
+	}
+	if (x.is_active())
+	{
+		try
+		{
+			x.abort();
+		}
+		catch (...)
+		{
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lk(m_mx);
+		m_stats.writes += batch.size();
+		if (batch_err)
+		{
+			m_stats.failed += batch.size();
+			m_stats.failed_batches++;
+		}
+		else
+		{
+			m_stats.failed += failed;
+			m_stats.batches++;
+			m_stats.max_batch = std::max(m_stats.max_batch, uint64_t(batch.size()));
+		}
+	}
+
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		if (errs[i])
+		{
+			batch[i].done.set_exception(errs[i]);
+		}
+		else if (batch_err)
+		{
+			batch[i].done.set_exception(batch_err);
+		}
+		else
+		{
+			batch[i].done.set_value();
+		}
+	}
+}
@@ -0,0 +1,97 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/snapshot.h>
+#include <sqlite/sqld.h>
+#include <sqlite3.h>
+#include <string>
+#include <stdexcept>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite snapshot implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+Snapshot::Snapshot(Conn& conn, const std::string& schema) : m_snap(nullptr), m_schema(schema)
+{
+	bool own = sqlite3_get_autocommit(conn.m_db);
+	if (own)
+	{
+		conn.exec_cached("BEGIN;");
+	}
+	int r = sqlite3_snapshot_get(conn.m_db, m_schema.c_str(), &m_snap);		// starts the read if needed
+	if (own)
+	{
+		try
+		{
+			conn.exec_cached("COMMIT;");
+		}
+		catch (...)
+		{
+			sqlite3_snapshot_free(m_snap);
+			throw;
+		}
+	}
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+}
+
+Snapshot::~Snapshot()
+{
+	sqlite3_snapshot_free(m_snap);
+}
+
+void Snapshot::open(Trans& t) const
+{
+	if (t.is_active())
+	{
+		throw std::runtime_error("snapshot open() with active transaction");
+	}
+	if (t.mode() != Trans::Mode::deferred)
+	{
+		throw std::runtime_error("snapshot open() requires a deferred transaction");		// a write transaction reads the latest
+	}
+	t.begin();
+	int r = sqlite3_snapshot_open(t.m_conn.m_db, m_schema.c_str(), m_snap);
+	if (r != SQLITE_OK)
+	{
+		t.abort();
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+}
+
+int Snapshot::compare(const Snapshot& other) const
+{
+	return sqlite3_snapshot_cmp(m_snap, other.m_snap);
+}
@@ -29,10 +29,20 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include <sqlite/sqld.h>
+#include <sqlite/batch.h>
+#include <sqlite/change.h>
 #include <sqlite3.h>
 #include <string>
 #include <system_error>
 #include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <limits>
+#include <deque>
 
 /** \addtogroup sqlite
 	@{ */
@@ -43,150 +53,1809 @@ static const std::string::size_type npos = std::string::npos;
 
 using namespace scc::sqld;
 
-Conn::Conn(const std::string& uri) : m_db(nullptr)
+static const size_t default_stmt_cache_size = 64;
+
+static std::string_view trim(std::string_view s)
+{
+	static const char* ws = " \t\n\r\f\v";
+
+	auto b = s.find_first_not_of(ws);
+	if (b == npos)
+	{
+		return std::string_view();
+	}
+	return s.substr(b, s.find_last_not_of(ws)-b+1);
+}
+
+/*
+	Latency histogram with four buckets per power of two, so percentiles are within about 12%.
+*/
+static const int hist_buckets = 4+62*4;
+
+static int hist_bucket(uint64_t ns)
+{
+	if (ns < 4)
+	{
+		return ns;
+	}
+	int lg = 63-__builtin_clzll(ns);				// position of the leading bit, at least 2
+	return 4 + (lg-2)*4 + ((ns >> (lg-2)) & 3);		// next two bits select the bucket within the power of two
+}
+
+static uint64_t hist_value(int b)
+{
+	if (b < 4)
+	{
+		return b;
+	}
+	int lg = (b-4)/4+2;
+	uint64_t lo = uint64_t(4+(b-4)%4) << (lg-2);
+	return lo + (uint64_t(1) << (lg-2))/2;			// middle of the bucket
+}
+
+struct Conn::Profiler
+{
+	struct Hash
+	{
+		using is_transparent = void;
+		size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+	};
+
+	struct Entry
+	{
+		StmtProfile prof;
+		std::vector<uint64_t> hist;
+	};
+
+	struct Run
+	{
+		std::chrono::steady_clock::time_point start;
+		uint64_t rows;
+	};
+
+	std::mutex mx;								// guards the statistics and slow query log, which are read by other threads
+	bool enabled;
+	std::unordered_map<std::string, Entry, Hash, std::equal_to<>> stmts;
+
+	std::optional<SlowQueryOptions> slow;		// slow query log, if enabled
+	std::deque<SlowQuery> slow_log;
+
+	static thread_local bool explaining;		// running EXPLAIN QUERY PLAN, whose executions are not traced
+
+	/*
+		Statements being executed. Rows usually arrive from one statement at a time, so the last statement is
+		remembered to skip the lookup. Statements run by sqlite internally (schema loads) start but are never
+		profiled, and are swept out once they have been finalized.
+
+		Trace callbacks are made holding the database mutex, which also guards these, so rows are counted
+		without taking a lock. With SQLITE_OPEN_NOMUTEX the connection is only used by one thread at a time.
+	*/
+	std::unordered_map<sqlite3_stmt*, Run> runs;
+	sqlite3_stmt* cur_stmt;
+	Run* cur_run;
+
+	Profiler() : enabled(false), cur_stmt(nullptr), cur_run(nullptr) {}
+
+	bool active() const { return enabled || slow; }
+
+	Run* run(sqlite3_stmt* stmt)
+	{
+		if (stmt != cur_stmt)
+		{
+			auto it = runs.find(stmt);
+			if (it == runs.end())
+			{
+				return nullptr;
+			}
+			cur_stmt = stmt;
+			cur_run = &it->second;
+		}
+		return cur_run;
+	}
+
+	void start(sqlite3_stmt* stmt, const char* sql)
+	{
+		if (sql && sql[0] == '-' && sql[1] == '-')
+		{
+			return;					// trigger or nested statement, part of the current execution
+		}
+		cur_run = &(runs[stmt] = Run{std::chrono::steady_clock::now(), 0});
+		cur_stmt = stmt;
+	}
+
+	void row(sqlite3_stmt* stmt)
+	{
+		Run* r = run(stmt);
+		if (r)
+		{
+			r->rows++;
+		}
+	}
+
+	void sweep(sqlite3* db)
+	{
+		std::unordered_map<sqlite3_stmt*, Run> live;
+		for (sqlite3_stmt* s = sqlite3_next_stmt(db, nullptr); s; s = sqlite3_next_stmt(db, s))
+		{
+			auto it = runs.find(s);
+			if (it != runs.end())
+			{
+				live.insert(*it);
+			}
+		}
+		runs.swap(live);
+		cur_stmt = nullptr;
+		cur_run = nullptr;
+	}
+
+	void tracing(sqlite3* db, unsigned mask)		// set the trace mask, and forget executions in progress
+	{
+		sqlite3_mutex* m = sqlite3_db_mutex(db);		// recursive, and null with SQLITE_OPEN_NOMUTEX
+		sqlite3_mutex_enter(m);
+		runs.clear();
+		cur_stmt = nullptr;
+		cur_run = nullptr;
+		sqlite3_trace_v2(db, mask, mask ? &Profiler::trace : nullptr, mask ? this : nullptr);
+		sqlite3_mutex_leave(m);
+	}
+
+	bool profile(sqlite3_stmt* stmt, SlowQuery& q)		// returns true if the execution is slow
+	{
+		auto it = runs.find(stmt);
+		if (it == runs.end())
+		{
+			return false;			// started before profiling was enabled
+		}
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-it->second.start);
+		uint64_t rows = it->second.rows;
+		runs.erase(it);
+		if (stmt == cur_stmt)
+		{
+			cur_stmt = nullptr;
+			cur_run = nullptr;
+		}
+		if (runs.size() > 32)
+		{
+			sweep(sqlite3_db_handle(stmt));
+		}
+
+		uint64_t vm_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);		// reset for the next execution
+		uint64_t fullscan_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+		uint64_t sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+		uint64_t autoindexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+
+		std::lock_guard<std::mutex> lk(mx);
+		bool is_slow = slow && (ns >= slow->threshold || (slow->scans && (fullscan_steps || autoindexes)));
+		if (is_slow)
+		{
+			const char* sql = sqlite3_sql(stmt);
+			q.sql = sql ? sql : "";
+			char* exp = sqlite3_expanded_sql(stmt);
+			q.expanded = exp ? exp : "";
+			sqlite3_free(exp);
+			q.when = std::chrono::system_clock::now();
+			q.duration = ns;
+			q.rows = rows;
+			q.fullscan_steps = fullscan_steps;
+			q.autoindexes = autoindexes;
+		}
+		if (!enabled)
+		{
+			return is_slow;
+		}
+
+		const char* sql = sqlite3_normalized_sql(stmt);		// computed once and kept by the statement
+		if (!sql)
+		{
+			sql = sqlite3_sql(stmt);
+		}
+		std::string_view key(sql ? sql : "");
+
+		auto st = stmts.find(key);
+		if (st == stmts.end())
+		{
+			st = stmts.emplace(std::string(key), Entry{StmtProfile{std::string(key), 0, std::chrono::nanoseconds(0),
+				std::chrono::nanoseconds(0), std::chrono::nanoseconds(0), 0, 0, 0, 0, 0}, std::vector<uint64_t>(hist_buckets)}).first;
+		}
+		auto& e = st->second;
+
+		e.prof.calls++;
+		e.prof.total += ns;
+		e.hist[hist_bucket(ns.count())]++;
+		e.prof.rows += rows;
+		e.prof.vm_steps += vm_steps;
+		e.prof.fullscan_steps += fullscan_steps;
+		e.prof.sorts += sorts;
+		e.prof.autoindexes += autoindexes;
+		return is_slow;
+	}
+
+	static void explain(sqlite3_stmt* stmt, std::vector<std::string>& plan)
+	{
+		const char* sql = sqlite3_sql(stmt);
+		if (!sql)
+		{
+			return;
+		}
+		std::string eqp_sql("EXPLAIN QUERY PLAN ");
+		eqp_sql += sql;
+
+		explaining = true;
+		sqlite3_stmt* eqp = nullptr;
+		if (sqlite3_prepare_v2(sqlite3_db_handle(stmt), eqp_sql.c_str(), -1, &eqp, nullptr) == SQLITE_OK && eqp)
+		{
+			std::unordered_map<int, int> depth;			// depth of each step by id
+			while (sqlite3_step(eqp) == SQLITE_ROW)
+			{
+				auto it = depth.find(sqlite3_column_int(eqp, 1));
+				int d = it == depth.end() ? 0 : it->second+1;
+				depth[sqlite3_column_int(eqp, 0)] = d;
+				const char* detail = reinterpret_cast<const char*>(sqlite3_column_text(eqp, 3));
+				plan.push_back(std::string(2*d, ' ') + (detail ? detail : ""));
+			}
+		}
+		sqlite3_finalize(eqp);
+		explaining = false;
+	}
+
+	void record(sqlite3_stmt* stmt, SlowQuery&& q)		// called without the lock held
+	{
+		explain(stmt, q.plan);
+
+		std::function<void(const SlowQuery&)> sink;
+		{
+			std::lock_guard<std::mutex> lk(mx);
+			if (!slow)
+			{
+				return;
+			}
+			while (slow_log.size() >= slow->capacity && !slow_log.empty())
+			{
+				slow_log.pop_front();
+			}
+			if (slow->capacity)
+			{
+				slow_log.push_back(q);
+			}
+			sink = slow->sink;
+		}
+		if (sink)
+		{
+			try
+			{
+				sink(q);
+			}
+			catch (...)
+			{
+			}
+		}
+	}
+
+	static int trace(unsigned type, void* ctx, void* p, void* x)
+	{
+		if (explaining)
+		{
+			return 0;
+		}
+
+		Profiler* prof = static_cast<Profiler*>(ctx);
+		switch (type)
+		{
+		case SQLITE_TRACE_STMT:
+			prof->start(static_cast<sqlite3_stmt*>(p), static_cast<const char*>(x));
+			break;
+		case SQLITE_TRACE_ROW:
+			prof->row(static_cast<sqlite3_stmt*>(p));
+			break;
+		case SQLITE_TRACE_PROFILE:
+			{
+				SlowQuery q;
+				if (prof->profile(static_cast<sqlite3_stmt*>(p), q))
+				{
+					prof->record(static_cast<sqlite3_stmt*>(p), std::move(q));		// the plan is found without the lock, since it is traced
+				}
+			}
+			break;
+		}
+		return 0;
+	}
+};
+
+BusyPolicy BusyPolicy::fail()
+{
+	return BusyPolicy();
+}
+
+BusyPolicy BusyPolicy::fixed(std::chrono::milliseconds timeout, std::chrono::microseconds delay)
+{
+	BusyPolicy p;
+	p.kind = Kind::fixed;
+	p.timeout = timeout;
+	p.delay = delay;
+	return p;
+}
+
+BusyPolicy BusyPolicy::backoff(std::chrono::milliseconds timeout, std::chrono::microseconds delay, std::chrono::microseconds max_delay)
+{
+	BusyPolicy p;
+	p.kind = Kind::backoff;
+	p.timeout = timeout;
+	p.delay = delay;
+	p.max_delay = max_delay;
+	return p;
+}
+
+BusyPolicy BusyPolicy::custom(std::function<bool(int)> cb)
+{
+	BusyPolicy p;
+	p.kind = Kind::callback;
+	p.callback = std::move(cb);
+	return p;
+}
+
+/*
+	The busy handler is always installed, so busy events are counted for every policy. sqlite calls it
+	with the number of earlier calls for the same lock, and holds the connection while it runs, so only
+	one lock wait is in progress for a connection.
+*/
+struct Conn::Busy
+{
+	std::mutex mx;
+	BusyPolicy policy;
+	BusyStats stats;
+	std::chrono::steady_clock::time_point start;		// first busy result for the current lock
+	std::chrono::nanoseconds wait;						// time waited for the current lock
+	std::minstd_rand rng;
+
+	Busy() : stats{0, 0, 0, std::chrono::nanoseconds(0), std::chrono::nanoseconds(0)}, wait(0),
+		rng(std::random_device()()) {}
+
+	bool retry(int count)
+	{
+		using namespace std::chrono;
+
+		std::unique_lock<std::mutex> lk(mx);
+
+		auto now = steady_clock::now();
+		if (count == 0)
+		{
+			stats.events++;
+			start = now;
+			wait = nanoseconds(0);
+		}
+
+		nanoseconds delay(0);
+		switch (policy.kind)
+		{
+		case BusyPolicy::Kind::fail:
+			break;
+		case BusyPolicy::Kind::fixed:
+			delay = policy.delay;
+			break;
+		case BusyPolicy::Kind::backoff:
+		{
+			auto d = policy.delay * (int64_t(1) << std::min(count, 30));
+			if (d > policy.max_delay || d.count() <= 0)
+			{
+				d = policy.max_delay;
+			}
+			delay = d/2 + nanoseconds(std::uniform_int_distribution<int64_t>(0, duration_cast<nanoseconds>(d).count()/2)(rng));
+			break;
+		}
+		case BusyPolicy::Kind::callback:
+		{
+			auto cb = policy.callback;
+			lk.unlock();
+			bool ok = cb && cb(count);
+			lk.lock();
+			done(ok, steady_clock::now()-now);
+			return ok;
+		}
+		}
+
+		auto left = policy.timeout - (now-start);
+		if (policy.kind == BusyPolicy::Kind::fail || left <= nanoseconds(0))
+		{
+			done(false, nanoseconds(0));
+			return false;
+		}
+		if (delay > left)
+		{
+			delay = duration_cast<nanoseconds>(left);
+		}
+
+		lk.unlock();
+		std::this_thread::sleep_for(delay);
+		lk.lock();
+		done(true, steady_clock::now()-now);
+		return true;
+	}
+
+	void done(bool retried, std::chrono::nanoseconds waited)
+	{
+		wait += waited;
+		stats.total_wait += waited;
+		if (wait > stats.max_wait)
+		{
+			stats.max_wait = wait;
+		}
+		if (retried)
+		{
+			stats.retries++;
+		}
+		else
+		{
+			stats.failures++;
+		}
+	}
+
+	static int handler(void* ctx, int count)
+	{
+		return static_cast<Busy*>(ctx)->retry(count) ? 1 : 0;
+	}
+};
+
+/*
+	Result cache.
+
+	Each entry records the version of the tables its statement reads, found by the authorizer when the
+	statement is prepared. The update hook increments the version of a table when one of its rows changes,
+	so entries are invalidated when next looked up. The authorizer ignores DELETE, which disables the truncate
+	optimization so that the update hook sees every row deleted, and schema changes increment the version of
+	the table.
+
+	Results are not stored while a table they read has uncommitted changes, since the changes may be rolled
+	back; the entries read before the changes are already invalid.
+*/
+struct Conn::ResultCache
+{
+	struct Hash
+	{
+		using is_transparent = void;
+		size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+	};
+	using Tables = std::unordered_map<std::string, uint64_t, Hash, std::equal_to<>>;
+
+	struct Entry
+	{
+		std::string key;
+		std::shared_ptr<const ColumnBatch> batch;
+		std::vector<std::pair<std::string, uint64_t>> tables;		// version of each table read
+		size_t bytes;
+	};
+
+	std::mutex mx;
+	ResultCacheStats stats;
+	std::list<Entry> lru;			// most recently used at front
+	std::unordered_map<std::string_view, std::list<Entry>::iterator> idx;	// keys refer to Entry::key
+	Tables versions;
+	Tables dirty;					// tables changed in the current transaction
+
+	ResultCache() : stats{0, 0, 0, 0, 0, 0, 0} {}
+
+	static thread_local std::vector<std::string>* reads;		// tables read by the statement being prepared
+	static thread_local bool dropping;							// a drop statement is being prepared
+
+	uint64_t version(std::string_view table)
+	{
+		auto it = versions.find(table);
+		return it == versions.end() ? 0 : it->second;
+	}
+
+	void bump(std::string_view table)
+	{
+		auto it = versions.find(table);
+		if (it == versions.end())
+		{
+			versions.emplace(std::string(table), 1);
+		}
+		else
+		{
+			it->second++;
+		}
+	}
+
+	void erase(std::list<Entry>::iterator it)
+	{
+		stats.bytes -= it->bytes;
+		stats.entries--;
+		idx.erase(it->key);
+		lru.erase(it);
+	}
+
+	void clear()
+	{
+		idx.clear();
+		lru.clear();
+		stats.bytes = 0;
+		stats.entries = 0;
+	}
+
+	void trim(size_t sz)
+	{
+		while (stats.bytes > sz && !lru.empty())
+		{
+			erase(std::prev(lru.end()));
+			stats.evictions++;
+		}
+	}
+
+	static int authorize(void* ctx, int action, const char* a1, const char* a2, const char*, const char*)
+	{
+		switch (action)
+		{
+		case SQLITE_READ:
+			if (reads && a1)
+			{
+				reads->emplace_back(a1);
+			}
+			break;
+		case SQLITE_DELETE:
+			// drop statements also check DELETE on the table and the schema table, and any result
+			// other than SQLITE_OK cancels them; only a DELETE statement is ignored
+			if (dropping)
+			{
+				dropping = false;
+				break;
+			}
+			if (a1 && sqlite3_strnicmp(a1, "sqlite_", 7) == 0)
+			{
+				break;
+			}
+			return SQLITE_IGNORE;		// the rows are deleted one at a time
+		case SQLITE_DROP_TABLE:
+		case SQLITE_DROP_TEMP_TABLE:
+		case SQLITE_DROP_VIEW:
+		case SQLITE_DROP_TEMP_VIEW:
+		case SQLITE_DROP_VTABLE:
+			dropping = true;
+			// fall through
+		case SQLITE_ALTER_TABLE:
+			{
+				auto rc = static_cast<ResultCache*>(ctx);
+				std::lock_guard<std::mutex> lk(rc->mx);
+				rc->bump(action == SQLITE_ALTER_TABLE ? a2 : a1);
+			}
+			break;
+		default:
+			dropping = false;
+		}
+		return SQLITE_OK;
+	}
+
+	static void update(void* ctx, int, const char*, const char* table, sqlite3_int64)
+	{
+		auto rc = static_cast<ResultCache*>(ctx);
+		std::lock_guard<std::mutex> lk(rc->mx);
+		rc->bump(table);
+		if (rc->dirty.find(std::string_view(table)) == rc->dirty.end())
+		{
+			rc->dirty.emplace(table, 0);
+		}
+	}
+
+	static int commit(void* ctx)
+	{
+		auto rc = static_cast<ResultCache*>(ctx);
+		std::lock_guard<std::mutex> lk(rc->mx);
+		rc->dirty.clear();
+		return 0;
+	}
+
+	static void rollback(void* ctx)
+	{
+		commit(ctx);
+	}
+};
+
+thread_local bool Conn::Profiler::explaining = false;
+thread_local std::vector<std::string>* Conn::ResultCache::reads = nullptr;
+thread_local bool Conn::ResultCache::dropping = false;
+
+static std::atomic<int> conns_open(0);
+
+int Conn::open_conns()
+{
+	return conns_open.load();
+}
+
+static const unsigned profile_mask = SQLITE_TRACE_STMT|SQLITE_TRACE_ROW|SQLITE_TRACE_PROFILE;
+
+Conn::Options Conn::Options::throughput()
+{
+	Options o;
+	o.journal_mode = "wal";
+	o.synchronous = "normal";
+	o.mmap_size = 256*1024*1024;
+	o.cache_size = -64*1024;
+	o.temp_store = "memory";
+	o.busy_timeout = 5000;
+	return o;
+}
+
+Conn::Options Conn::Options::durable()
+{
+	Options o;
+	o.journal_mode = "wal";
+	o.synchronous = "full";
+	o.busy_timeout = 5000;
+	return o;
+}
+
+static std::string pragma_value(const std::string& val, std::initializer_list<const char*> allowed, const char* name)
+{
+	std::string v(val);
+	for (auto& c : v)
+	{
+		c = std::tolower(static_cast<unsigned char>(c));
+	}
+	for (auto a : allowed)
+	{
+		if (v == a)
+		{
+			return v;
+		}
+	}
+	throw std::runtime_error(std::string("invalid ") + name + " option: " + val);
+}
+
+static void pragma(sqlite3* db, const std::string& sql)
+{
+	char* err = nullptr;
+	if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK)
+	{
+		std::string msg(err ? err : sqlite3_errmsg(db));
+		sqlite3_free(err);
+		throw std::runtime_error(msg);
+	}
+}
+
+static int64_t pragma_int(sqlite3* db, const std::string& sql)
+{
+	int64_t val = 0;
+	char* err = nullptr;
+	auto cb = [](void* p, int n, char** vals, char**) -> int
+	{
+		if (n > 0 && vals[0])
+		{
+			*static_cast<int64_t*>(p) = strtoll(vals[0], nullptr, 10);
+		}
+		return 0;
+	};
+	if (sqlite3_exec(db, sql.c_str(), cb, &val, &err) != SQLITE_OK)
+	{
+		std::string msg(err ? err : sqlite3_errmsg(db));
+		sqlite3_free(err);
+		throw std::runtime_error(msg);
+	}
+	return val;
+}
+
+/*
+	Options are applied in an order which works for a new database: the page size must be set before the
+	database is written, which includes switching to WAL mode.
+*/
+static void apply(sqlite3* db, const Conn::Options& o)
+{
+	if (o.page_size)
+	{
+		pragma(db, "PRAGMA page_size=" + std::to_string(*o.page_size) + ";");
+		if (pragma_int(db, "PRAGMA page_size;") != *o.page_size)
+		{
+			throw std::runtime_error("page_size option cannot be applied to an existing database");
+		}
+	}
+	if (!o.journal_mode.empty())
+	{
+		pragma(db, "PRAGMA journal_mode=" + pragma_value(o.journal_mode, {"delete", "truncate", "persist", "memory", "wal", "off"},
+			"journal_mode") + ";");
+	}
+	if (!o.synchronous.empty())
+	{
+		pragma(db, "PRAGMA synchronous=" + pragma_value(o.synchronous, {"off", "normal", "full", "extra"}, "synchronous") + ";");
+	}
+	if (o.cache_size)
+	{
+		pragma(db, "PRAGMA cache_size=" + std::to_string(*o.cache_size) + ";");
+	}
+	if (o.mmap_size)
+	{
+		pragma(db, "PRAGMA mmap_size=" + std::to_string(*o.mmap_size) + ";");
+	}
+	if (!o.temp_store.empty())
+	{
+		pragma(db, "PRAGMA temp_store=" + pragma_value(o.temp_store, {"default", "file", "memory"}, "temp_store") + ";");
+	}
+}
+
+Conn::Conn(const std::string& uri) : m_db(nullptr), m_cache_stats{0, 0, 0, 0, default_stmt_cache_size},
+	m_prof(new Profiler), m_busy(new Busy), m_rcache(new ResultCache)
+{
+	open(uri);
+}
+
+Conn::Conn(const std::string& uri, const Options& opts) : m_db(nullptr), m_opts(opts),
+	m_cache_stats{0, 0, 0, 0, default_stmt_cache_size}, m_prof(new Profiler), m_busy(new Busy),
+	m_rcache(new ResultCache)
+{
+	if (opts.busy_timeout)
+	{
+		m_busy->policy = BusyPolicy::fixed(std::chrono::milliseconds(*opts.busy_timeout));
+	}
+	open(uri);
+}
+
+Conn::~Conn()
+{
+	close();
+}
+
+void Conn::open(const std::string& uri)
+{
+	int flags = m_opts.flags;
+	if (!(flags & (SQLITE_OPEN_READONLY|SQLITE_OPEN_READWRITE)))
+	{
+		flags |= SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE;		// no access mode, use the default
+	}
+	int r = sqlite3_open_v2(uri.c_str(), &m_db, flags|SQLITE_OPEN_URI, nullptr);
+	if (r != SQLITE_OK)
+	{
+		sqlite3_close(m_db);		// a handle is returned unless out of memory
+		m_db = nullptr;
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+
+	sqlite3_busy_handler(m_db, &Busy::handler, m_busy.get());		// before options, which may need locks
+
+	try
+	{
+		create_array_module();
+		apply(m_db, m_opts);
+	}
+	catch (...)
+	{
+		sqlite3_close(m_db);
+		m_db = nullptr;
+		throw;
+	}
+	conns_open++;
+
+	result_cache_hooks();
+
+	bool active;
+	{
+		std::lock_guard<std::mutex> lk(m_prof->mx);
+		active = m_prof->active();
+	}
+	if (active)
+	{
+		m_prof->tracing(m_db, profile_mask);		// drops statements of the previous connection
+	}
+}
+
+void Conn::close()
+{
+	if (m_db)
+	{
+		{
+			std::lock_guard<std::mutex> lk(m_cache_mx);
+			cache_flush();
+		}
+		result_cache_reset();
+		{
+			// sessions must be deleted before the database handle
+			std::lock_guard<std::mutex> lk(m_streams_mx);
+			for (auto s : m_streams)
+			{
+				s->detach("connection closed");
+			}
+		}
+
+		sqlite3_close(m_db);
+		m_db = nullptr;
+		conns_open--;
+	}
+}
+
+void Conn::reopen(const std::string& uri)
+{
+	close();
+	open(uri);
+}
+
+void Conn::reopen(const std::string& uri, const Options& opts)
+{
+	close();
+	m_opts = opts;
+	if (opts.busy_timeout)
+	{
+		std::lock_guard<std::mutex> lk(m_busy->mx);
+		m_busy->policy = BusyPolicy::fixed(std::chrono::milliseconds(*opts.busy_timeout));
+	}
+	open(uri);
+}
+
+sqlite3_stmt* Conn::checkout(std::string_view sql, std::string& key)
+{
+	std::lock_guard<std::mutex> lk(m_cache_mx);
+
+	if (m_cache_stats.max_size == 0)
+	{
+		return nullptr;
+	}
+
+	auto it = m_cache_idx.find(sql);
+	if (it == m_cache_idx.end())
+	{
+		m_cache_stats.misses++;
+		return nullptr;
+	}
+	m_cache_stats.hits++;
+
+	/*
+		Hand the entry over to the request; the index key refers to the entry's string, so remove it first.
+	*/
+	auto ent = it->second;
+	m_cache_idx.erase(it);
+	key = std::move(ent->sql);
+	sqlite3_stmt* stmt = ent->stmt;
+	m_cache.erase(ent);
+
+	return stmt;
+}
+
+void Conn::checkin(std::string&& key, sqlite3_stmt* stmt)
+{
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	std::lock_guard<std::mutex> lk(m_cache_mx);
+
+	/*
+		Finalize if the cache is disabled, the statement belongs to a connection which was reopened,
+		or another request has already returned the same sql.
+	*/
+	if (m_cache_stats.max_size == 0 || sqlite3_db_handle(stmt) != m_db || m_cache_idx.count(key))
+	{
+		sqlite3_finalize(stmt);
+		return;
+	}
+
+	m_cache.push_front({std::move(key), stmt});
+	m_cache_idx.emplace(m_cache.front().sql, m_cache.begin());
+
+	cache_trim(m_cache_stats.max_size);
+}
+
+/*
+	Runs a statement without result rows through the statement cache, without the overhead of a request.
+*/
+void Conn::exec_cached(std::string_view sql)
+{
+	std::string key;
+	sqlite3_stmt* stmt = checkout(sql, key);
+	if (!stmt)
+	{
+		int r = sqlite3_prepare_v2(m_db, sql.data(), sql.size(), &stmt, nullptr);
+		if (r != SQLITE_OK)
+		{
+			throw std::runtime_error(sqlite3_errstr(r));
+		}
+		key = sql;
+	}
+
+	int r = sqlite3_step(stmt);
+	checkin(std::move(key), stmt);
+	if (r != SQLITE_DONE && r != SQLITE_ROW)
+	{
+		throw std::runtime_error(sqlite3_errstr(r));
+	}
+}
+
+void Conn::cache_trim(size_t sz)
+{
+	while (m_cache.size() > sz)
+	{
+		auto& e = m_cache.back();
+		m_cache_idx.erase(e.sql);
+		sqlite3_finalize(e.stmt);
+		m_cache.pop_back();
+		m_cache_stats.evictions++;
+	}
+}
+
+void Conn::cache_flush()
+{
+	for (auto& e : m_cache)
+	{
+		sqlite3_finalize(e.stmt);
+	}
+	m_cache_idx.clear();
+	m_cache.clear();
+}
+
+void Conn::result_cache_hooks()
+{
+	bool on;
+	{
+		std::lock_guard<std::mutex> lk(m_rcache->mx);
+		on = m_rcache->stats.max_bytes > 0;
+	}
+	ResultCache* rc = on ? m_rcache.get() : nullptr;
+	sqlite3_set_authorizer(m_db, on ? &ResultCache::authorize : nullptr, rc);
+	sqlite3_update_hook(m_db, on ? &ResultCache::update : nullptr, rc);
+	sqlite3_commit_hook(m_db, on ? &ResultCache::commit : nullptr, rc);
+	sqlite3_rollback_hook(m_db, on ? &ResultCache::rollback : nullptr, rc);
+}
+
+void Conn::result_cache_size(size_t sz)
+{
+	bool changed;
+	{
+		std::lock_guard<std::mutex> lk(m_rcache->mx);
+		changed = (m_rcache->stats.max_bytes > 0) != (sz > 0);
+		m_rcache->stats.max_bytes = sz;
+		m_rcache->trim(sz);
+		if (changed)
+		{
+			m_rcache->clear();		// changes were not tracked while disabled
+			m_rcache->versions.clear();
+			m_rcache->dirty.clear();
+		}
+	}
+	if (changed)
+	{
+		result_cache_hooks();		// setting the authorizer expires prepared statements, which are prepared again when used
+	}
+}
+
+void Conn::result_cache_reset()
+{
+	std::lock_guard<std::mutex> lk(m_rcache->mx);
+	m_rcache->clear();
+	m_rcache->versions.clear();
+	m_rcache->dirty.clear();
+}
+
+ResultCacheStats Conn::result_cache_stats()
+{
+	std::lock_guard<std::mutex> lk(m_rcache->mx);
+	return m_rcache->stats;
+}
+
+void Conn::result_cache_clear()
+{
+	std::lock_guard<std::mutex> lk(m_rcache->mx);
+	m_rcache->clear();
+	m_rcache->stats = {0, 0, 0, 0, 0, 0, m_rcache->stats.max_bytes};
+}
+
+std::shared_ptr<const ColumnBatch> Conn::cache_find(const std::string& key)
+{
+	std::lock_guard<std::mutex> lk(m_rcache->mx);
+	auto& rc = *m_rcache;
+
+	auto it = rc.idx.find(key);
+	if (it == rc.idx.end())
+	{
+		rc.stats.misses++;
+		return nullptr;
+	}
+	auto e = it->second;
+	for (auto& t : e->tables)
+	{
+		if (rc.version(t.first) != t.second)
+		{
+			rc.erase(e);
+			rc.stats.invalidations++;
+			rc.stats.misses++;
+			return nullptr;
+		}
+	}
+	rc.lru.splice(rc.lru.begin(), rc.lru, e);
+	rc.stats.hits++;
+	return e->batch;
+}
+
+static size_t batch_bytes(const ColumnBatch& b)
+{
+	size_t n = sizeof(ColumnBatch);
+	for (int i = 0; i < b.cols(); i++)
+	{
+		auto& c = b.col(i);
+		n += sizeof(c) + c.name.capacity() + c.ints.capacity()*sizeof(int64_t) + c.reals.capacity()*sizeof(double)
+			+ c.offsets.capacity()*sizeof(uint64_t) + c.arena.capacity() + c.valid.capacity();
+	}
+	return n;
+}
+
+std::shared_ptr<const ColumnBatch> Conn::cache_fill(const std::string& key, std::string_view sql,
+	const std::function<void(Req&)>& bind)
+{
+	std::vector<std::string> reads;
+	sqlite3_stmt* stmt = nullptr;
+	const char* tail = nullptr;
+
+	ResultCache::reads = &reads;		// prepare once to find the tables, the request uses the statement cache
+	int r = sqlite3_prepare_v2(m_db, sql.data(), sql.size(), &stmt, &tail);
+	ResultCache::reads = nullptr;
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errmsg(m_db));
+	}
+	bool ok = stmt && sqlite3_stmt_readonly(stmt) && trim(std::string_view(tail, sql.data()+sql.size()-tail)).empty();
+	sqlite3_finalize(stmt);
+	if (!ok)
+	{
+		throw std::runtime_error("select_cached() requires a single read-only statement");
+	}
+	std::sort(reads.begin(), reads.end());
+	reads.erase(std::unique(reads.begin(), reads.end()), reads.end());
+
+	ResultCache::Entry e;
+	bool store;
+	{
+		std::lock_guard<std::mutex> lk(m_rcache->mx);
+		auto& rc = *m_rcache;
+		store = rc.stats.max_bytes > 0;
+		if (sqlite3_get_autocommit(m_db))
+		{
+			rc.dirty.clear();			// no transaction, in case a rollback was not reported
+		}
+		for (auto& t : reads)
+		{
+			if (rc.dirty.find(t) != rc.dirty.end())
+			{
+				store = false;
+			}
+			e.tables.emplace_back(t, rc.version(t));		// any change from now on invalidates the entry
+		}
+	}
+
+	auto batch = std::make_shared<ColumnBatch>();
+	Req req(*this);
+	req.sql() << sql;
+	bind(req);
+	req.fetch_batch(*batch, std::numeric_limits<size_t>::max());
+
+	if (!store)
+	{
+		return batch;
+	}
+
+	e.key = key;
+	e.batch = batch;
+	e.bytes = batch_bytes(*batch) + key.size() + sizeof(ResultCache::Entry);
+
+	std::lock_guard<std::mutex> lk(m_rcache->mx);
+	auto& rc = *m_rcache;
+	if (e.bytes > rc.stats.max_bytes)
+	{
+		return batch;
+	}
+	auto it = rc.idx.find(key);
+	if (it != rc.idx.end())			// filled by another thread
+	{
+		rc.erase(it->second);
+	}
+	rc.lru.push_front(std::move(e));
+	rc.idx[rc.lru.front().key] = rc.lru.begin();
+	rc.stats.bytes += rc.lru.front().bytes;
+	rc.stats.entries++;
+	rc.trim(rc.stats.max_bytes);
+	return batch;
+}
+
+StmtCacheStats Conn::stmt_cache_stats()
+{
+	std::lock_guard<std::mutex> lk(m_cache_mx);
+
+	StmtCacheStats st = m_cache_stats;
+	st.size = m_cache.size();
+	return st;
+}
+
+void Conn::stmt_cache_size(size_t sz)
+{
+	std::lock_guard<std::mutex> lk(m_cache_mx);
+
+	m_cache_stats.max_size = sz;
+	cache_trim(sz);
+}
+
+void Conn::stmt_cache_clear()
+{
+	std::lock_guard<std::mutex> lk(m_cache_mx);
+
+	cache_flush();
+	m_cache_stats = {0, 0, 0, 0, m_cache_stats.max_size};
+}
+
+static int64_t db_status(sqlite3* db, int op, bool high = false)
+{
+	int cur = 0, hi = 0;
+	sqlite3_db_status(db, op, &cur, &hi, 0);
+	return high ? hi : cur;
+}
+
+MemoryUsage Conn::memory_usage()
+{
+	MemoryUsage m;
+	m.cache = db_status(m_db, SQLITE_DBSTATUS_CACHE_USED);
+	m.schema = db_status(m_db, SQLITE_DBSTATUS_SCHEMA_USED);
+	m.statements = db_status(m_db, SQLITE_DBSTATUS_STMT_USED);
+	m.lookaside = db_status(m_db, SQLITE_DBSTATUS_LOOKASIDE_USED);
+	m.lookaside_max = db_status(m_db, SQLITE_DBSTATUS_LOOKASIDE_USED, true);
+	m.cache_hits = db_status(m_db, SQLITE_DBSTATUS_CACHE_HIT);
+	m.cache_misses = db_status(m_db, SQLITE_DBSTATUS_CACHE_MISS);
+
+	std::lock_guard<std::mutex> lk(m_rcache->mx);
+	m.results = m_rcache->stats.bytes;
+	return m;
+}
+
+int64_t Conn::release_memory()
+{
+	auto before = memory_usage();
+	{
+		std::lock_guard<std::mutex> lk(m_cache_mx);
+		cache_flush();
+	}
+	{
+		std::lock_guard<std::mutex> lk(m_rcache->mx);
+		m_rcache->clear();
+	}
+	sqlite3_db_release_memory(m_db);
+	auto after = memory_usage();
+
+	return (before.cache+before.statements+before.results) - (after.cache+after.statements+after.results);
+}
+
+void Conn::enable_profiling(bool enable)
+{
+	{
+		std::lock_guard<std::mutex> lk(m_prof->mx);
+		m_prof->enabled = enable;
+		if (m_prof->slow)
+		{
+			return;					// the slow query log keeps tracing
+		}
+	}
+
+	m_prof->tracing(m_db, enable ? profile_mask : 0);
+}
+
+void Conn::enable_slow_query_log(const SlowQueryOptions& opts)
+{
+	bool was_active;
+	{
+		std::lock_guard<std::mutex> lk(m_prof->mx);
+		was_active = m_prof->active();
+		m_prof->slow = opts;
+		while (m_prof->slow_log.size() > opts.capacity)
+		{
+			m_prof->slow_log.pop_front();
+		}
+		if (was_active)
+		{
+			return;
+		}
+	}
+
+	m_prof->tracing(m_db, profile_mask);
+}
+
+void Conn::disable_slow_query_log()
+{
+	{
+		std::lock_guard<std::mutex> lk(m_prof->mx);
+		m_prof->slow.reset();
+		if (m_prof->enabled)
+		{
+			return;					// profiling keeps tracing
+		}
+	}
+
+	m_prof->tracing(m_db, 0);
+}
+
+std::vector<SlowQuery> Conn::slow_queries()
+{
+	std::lock_guard<std::mutex> lk(m_prof->mx);
+
+	return std::vector<SlowQuery>(m_prof->slow_log.begin(), m_prof->slow_log.end());
+}
+
+void Conn::clear_slow_queries()
+{
+	std::lock_guard<std::mutex> lk(m_prof->mx);
+
+	m_prof->slow_log.clear();
+}
+
+void Conn::busy_policy(const BusyPolicy& policy)
+{
+	std::lock_guard<std::mutex> lk(m_busy->mx);
+	m_busy->policy = policy;
+}
+
+BusyPolicy Conn::busy_policy()
+{
+	std::lock_guard<std::mutex> lk(m_busy->mx);
+	return m_busy->policy;
+}
+
+int64_t Conn::last_insert_rowid()
+{
+	return sqlite3_last_insert_rowid(m_db);
+}
+
+BusyStats Conn::busy_stats()
+{
+	std::lock_guard<std::mutex> lk(m_busy->mx);
+	return m_busy->stats;
+}
+
+void Conn::reset_busy_stats()
+{
+	std::lock_guard<std::mutex> lk(m_busy->mx);
+	m_busy->stats = {0, 0, 0, std::chrono::nanoseconds(0), std::chrono::nanoseconds(0)};
+}
+
+std::vector<StmtProfile> Conn::stats()
+{
+	std::lock_guard<std::mutex> lk(m_prof->mx);
+
+	std::vector<StmtProfile> v;
+	v.reserve(m_prof->stmts.size());
+
+	for (auto& s : m_prof->stmts)
+	{
+		auto& e = s.second;
+
+		v.push_back(e.prof);
+
+		uint64_t p50 = (e.prof.calls+1)/2, p99 = e.prof.calls - e.prof.calls/100, n = 0;
+		bool got50 = false;
+		for (int b = 0; b < hist_buckets; b++)
+		{
+			n += e.hist[b];
+			if (!got50 && n >= p50)
+			{
+				v.back().p50 = std::chrono::nanoseconds(hist_value(b));
+				got50 = true;
+			}
+			if (n >= p99)
+			{
+				v.back().p99 = std::chrono::nanoseconds(hist_value(b));
+				break;
+			}
+		}
+	}
+
+	std::sort(v.begin(), v.end(), [](const StmtProfile& a, const StmtProfile& b) { return a.total > b.total; });
+	return v;
+}
+
+void Conn::reset_stats()
+{
+	std::lock_guard<std::mutex> lk(m_prof->mx);
+
+	m_prof->stmts.clear();
+}
+
+Trans::Trans(Conn& conn, Mode mode) : m_conn(conn), m_mode(mode), m_active(false)
+{
+}
+
+Trans::~Trans()
+{
+	if (m_active)
+	{
+		abort();
+	}
+}
+
+void Trans::begin()
+{
+	if (m_active)
+	{
+		throw std::runtime_error("begin() transaction when already active");
+	}
+	switch (m_mode)
+	{
+	case Mode::deferred:
+		m_conn.exec_cached("BEGIN;");
+		break;
+	case Mode::immediate:
+		m_conn.exec_cached("BEGIN IMMEDIATE;");
+		break;
+	case Mode::exclusive:
+		m_conn.exec_cached("BEGIN EXCLUSIVE;");
+		break;
+	}
+	m_active = true;
+}
+
+void Trans::commit()
+{
+	if (!m_active)
+	{
+		throw std::runtime_error("commit() transaction when not active");
+	}
+	std::lock_guard<std::mutex> lk(m_conn.m_streams_mx);
+	for (auto s : m_conn.m_streams)
+	{
+		s->capture();					// while the changes are visible to the session
+	}
+	try
+	{
+		m_conn.exec_cached("COMMIT;");
+	}
+	catch (...)
+	{
+		for (auto s : m_conn.m_streams)
+		{
+			s->m_staged.clear();
+		}
+		throw;
+	}
+	m_active = false;
+	for (auto s : m_conn.m_streams)
+	{
+		s->publish();					// does not throw
+	}
+}
+
+void Trans::abort()
+{
+	if (!m_active)
+	{
+		throw std::runtime_error("abort() transaction when not active");
+	}
+	m_active = false;						// also if sqlite has already rolled back
+	m_conn.exec_cached("ROLLBACK;");
+}
+
+static const char* savepoint_sql = "SAVEPOINT scc_savepoint;";		// nested savepoints refer to the innermost
+static const char* release_sql = "RELEASE scc_savepoint;";
+static const char* rollback_sql = "ROLLBACK TO scc_savepoint;";
+
+Savepoint::Savepoint(Conn& conn) : m_conn(conn), m_active(false)
+{
+	m_conn.exec_cached(savepoint_sql);
+	m_active = true;
+}
+
+Savepoint::~Savepoint()
+{
+	if (m_active)
+	{
+		try
+		{
+			rollback();
+		}
+		catch (...)
+		{
+		}
+	}
+}
+
+void Savepoint::release()
+{
+	if (!m_active)
+	{
+		throw std::runtime_error("release() savepoint when not active");
+	}
+	m_conn.exec_cached(release_sql);
+	m_active = false;
+}
+
+void Savepoint::rollback()
+{
+	if (!m_active)
+	{
+		throw std::runtime_error("rollback() savepoint when not active");
+	}
+	m_active = false;
+	m_conn.exec_cached(rollback_sql);
+	m_conn.exec_cached(release_sql);
+}
+
+Req::Req(Conn& conn) : m_conn(conn), m_stmt(nullptr), m_first(false), m_pending(false), m_compiled(false),
+	m_script_pos(0), m_next(0), m_pos(0), m_cols(0)
+{
+}
+
+Req::~Req()
+{
+	uncompile();
+}
+
+void Req::finalize()
+{
+	if (!m_stmt)
+	{
+		return;
+	}
+
+	if (m_compiled)				// statements are owned by the script
+	{
+	}
+	else if (!m_key.empty())
+	{
+		m_conn.checkin(std::move(m_key), m_stmt);	// return the statement to the cache
+		m_key.clear();
+	}
+	else
+	{
+		sqlite3_finalize(m_stmt);
+	}
+	m_stmt = nullptr;
+	m_pending = false;
+}
+
+void Req::uncompile()
+{
+	finalize();
+
+	for (auto stmt : m_script)
+	{
+		sqlite3_finalize(stmt);
+	}
+	m_script.clear();
+	m_script_sql.clear();
+	m_script_pos = 0;
+	m_next = 0;
+	m_compiled = false;
+}
+
+void Req::clear()
+{
+	uncompile();
+
+	m_sql.str("");		// clear out the statement
+	m_pos = 0;
+	m_cols = 0;
+}
+
+void Req::reset()
+{
+	m_cols = 0;
+
+	if (m_compiled)				// rewind the script
+	{
+		if (m_stmt)
+		{
+			sqlite3_reset(m_stmt);
+		}
+		m_stmt = nullptr;
+		m_pending = false;
+		m_next = 0;
+		return;
+	}
+
+	if (m_stmt && m_first)		// reuse the first statement, the stream position is just past it
+	{
+		sqlite3_reset(m_stmt);
+		m_pending = true;
+		return;
+	}
+
+	finalize();
+
+	m_pos = 0;
+}
+
+void Req::compile()
+{
+	uncompile();
+
+	m_script_sql = m_sql.str();		// the only copy of the stream
+	m_compiled = true;
+	m_pos = 0;
+	m_cols = 0;
+
+	while (compile_next() == SQLITE_OK)		// stop at the end, or at a statement which must wait for earlier ones to run
+	{
+	}
+}
+
+int Req::compile_next()
+{
+	while (1)
+	{
+		std::string_view rest = trim(std::string_view(m_script_sql).substr(m_script_pos));
+		if (rest.empty())
+		{
+			m_script_pos = m_script_sql.size();
+			return SQLITE_DONE;
+		}
+
+		sqlite3_stmt* stmt = nullptr;
+		const char *tail = nullptr;
+
+		int r = sqlite3_prepare_v2(m_conn.m_db, rest.data(), rest.size(), &stmt, &tail);
+		if (r != SQLITE_OK)
+		{
+			return r;
+		}
+
+		assert(tail);
+		m_script_pos = tail-m_script_sql.data();
+
+		if (stmt)				// otherwise only comments were compiled
+		{
+			m_script.push_back(stmt);
+			return SQLITE_OK;
+		}
+	}
+}
+
+/*
+	Returns SQLITE_OK with the next statement ready to execute, SQLITE_DONE if there are no more statements,
+	or an error.
+*/
+int Req::prepare()
 {
-	int r = sqlite3_open(uri.c_str(), &m_db);
+	if (m_compiled)
+	{
+		if (m_next == m_script.size())		// compile any deferred statement
+		{
+			int r = compile_next();
+			if (r != SQLITE_OK)
+			{
+				return r;
+			}
+		}
+
+		if (m_stmt)
+		{
+			sqlite3_reset(m_stmt);			// release the finished statement
+		}
+		m_stmt = m_script[m_next++];
+		m_pending = true;
+		return SQLITE_OK;
+	}
+
+	std::string_view sql = m_sql.view();
+
+	if (m_pos >= sql.size()) 				// nothing to execute, keep the last statement for reset()
+	{
+		return SQLITE_DONE;
+	}
+
+	std::string_view rest = trim(sql.substr(m_pos));
+	if (rest.empty())						// only whitespace left
+	{
+		m_pos = sql.size();
+		return SQLITE_DONE;
+	}
+
+	finalize();								// clean up the last statement if any
+
+	m_first = m_pos == 0;
+
+	/*
+		If the rest of the stream has been compiled before as a single statement, reuse it.
+	*/
+	m_stmt = m_conn.checkout(rest, m_key);
+	if (m_stmt)
+	{
+		m_pos = sql.size();
+		m_pending = true;
+		return SQLITE_OK;
+	}
+
+	/*
+		The sqlite library compiles one statement at a time, and keeps track of where it left off,
+		so start at the current position.
+	*/
+	const char *tail = nullptr;
+
+	int r = sqlite3_prepare_v2(m_conn.m_db, rest.data(), rest.size(), &m_stmt, &tail);
 	if (r != SQLITE_OK)
 	{
-		throw std::runtime_error(sqlite3_errstr(r));
+		return r;
+	}
+
+	assert(tail);
+	m_pos = tail-sql.data();	// advance (when there are no more statements this will be at the end of the sql string)
+
+	if (!m_stmt)				// only comments were left
+	{
+		return SQLITE_DONE;
+	}
+
+	if (trim(sql.substr(m_pos)).empty())		// last statement in the stream can be cached
+	{
+		m_key = rest;
 	}
+
+	m_pending = true;
+	return SQLITE_OK;
 }
 
-Conn::~Conn()
+static Error misuse(const char* what)
 {
-	close();
+	return Error{SQLITE_MISUSE, SQLITE_MISUSE, what};
 }
 
-void Conn::close()
+/*
+	Called as soon as an api call fails, so the error of the connection is still the error of the call. The
+	database mutex is held so another thread using the connection cannot replace it between the reads.
+*/
+Error Req::error(int r) const
 {
-	if (m_db)
+	sqlite3_mutex* mx = sqlite3_db_mutex(m_conn.m_db);
+	sqlite3_mutex_enter(mx);
+	int ext = sqlite3_extended_errcode(m_conn.m_db);
+	Error e{r & 0xff, ext, {}};
+	if ((ext & 0xff) == (r & 0xff))
 	{
-		sqlite3_close(m_db);
-		m_db = nullptr;
+		e.what = sqlite3_errmsg(m_conn.m_db);
+	}
+	else								// replaced already, for example by a sqlite call in a user function
+	{
+		e.extended = r;
+		e.what = sqlite3_errstr(r);
 	}
+	sqlite3_mutex_leave(mx);
+	return e;
 }
 
-void Conn::reopen(const std::string& uri)
+Error Req::bind_stmt()
 {
-	close();
-
-	int r = sqlite3_open(uri.c_str(), &m_db);
+	if (m_pending)
+	{
+		return Error{0, 0, {}};
+	}
+	if (m_cols)
+	{
+		return misuse("bind operation called with current row data");
+	}
+	int r = prepare();
+	if (r == SQLITE_DONE)
+	{
+		return misuse("bind operation called without a statement to execute");
+	}
 	if (r != SQLITE_OK)
 	{
-		throw std::runtime_error(sqlite3_errstr(r));
+		return error(r);
 	}
+	return Error{0, 0, {}};
 }
 
-Trans::Trans(Conn& conn) : m_conn(conn), m_active(false)
+Error Req::bind_value(int idx, int v)
 {
+	Error e = bind_stmt();
+	if (e.code)
+	{
+		return e;
+	}
+	int r = sqlite3_bind_int(m_stmt, idx, v);
+	return r == SQLITE_OK ? e : error(r);
 }
 
-Trans::~Trans()
+Error Req::bind_value(int idx, int64_t v)
 {
-	if (m_active)
+	Error e = bind_stmt();
+	if (e.code)
 	{
-		abort();
+		return e;
 	}
+	int r = sqlite3_bind_int64(m_stmt, idx, v);
+	return r == SQLITE_OK ? e : error(r);
 }
 
-void Trans::begin()
+Error Req::bind_value(int idx, double v)
 {
-	if (m_active)
+	Error e = bind_stmt();
+	if (e.code)
 	{
-		throw std::runtime_error("begin() transaction when already active");
+		return e;
 	}
-	Req r(m_conn);
-	r.sql() << "BEGIN;";
-	r.exec();
-	m_active = true;
+	int r = sqlite3_bind_double(m_stmt, idx, v);
+	return r == SQLITE_OK ? e : error(r);
 }
 
-void Trans::commit()
+Error Req::bind_value(int idx, std::string_view v)
 {
-	if (!m_active)
+	Error e = bind_stmt();
+	if (e.code)
 	{
-		throw std::runtime_error("commit() transaction when not active");
+		return e;
 	}
-	Req r(m_conn);
-	r.sql() << "COMMIT;";
-	r.exec();
-	m_active = false;
+	int r = sqlite3_bind_text64(m_stmt, idx, v.data(), v.size(), SQLITE_TRANSIENT, SQLITE_UTF8);
+	return r == SQLITE_OK ? e : error(r);
 }
 
-void Trans::abort()
+Error Req::bind_value(int idx, const void* v, size_t sz)
 {
-	if (!m_active)
+	Error e = bind_stmt();
+	if (e.code)
 	{
-		throw std::runtime_error("abort() transaction when not active");
+		return e;
 	}
-	Req r(m_conn);
-	r.sql() << "ROLLBACK;";
-	r.exec();
-	m_active = false;
+	int r = sqlite3_bind_blob64(m_stmt, idx, v, sz, SQLITE_TRANSIENT);
+	return r == SQLITE_OK ? e : error(r);
 }
 
-Req::Req(Conn& conn) : m_conn(conn), m_stmt(nullptr), m_pos(0), m_cols(0)
+Error Req::bind_value(int idx, std::nullptr_t)
 {
+	Error e = bind_stmt();
+	if (e.code)
+	{
+		return e;
+	}
+	int r = sqlite3_bind_null(m_stmt, idx);
+	return r == SQLITE_OK ? e : error(r);
 }
 
-Req::~Req()
+void Req::bind_int(int idx, int v)
 {
-	finalize();
+	check(bind_value(idx, v));
 }
 
-void Req::finalize()
+void Req::bind_int64(int idx, int64_t v)
 {
-	if (m_stmt)
-	{
-		sqlite3_finalize(m_stmt);
-		m_stmt = nullptr;
-	}
+	check(bind_value(idx, v));
 }
 
-void Req::clear()
+void Req::bind_real(int idx, double v)
 {
-	finalize();
-
-	m_sql.str("");		// clear out the statement
-	m_pos = 0;
-	m_cols = 0;
+	check(bind_value(idx, v));
 }
 
-void Req::reset()
+void Req::bind_text(int idx, std::string_view v)
 {
-	finalize();
-
-	m_pos = 0;
-	m_cols = 0;
+	check(bind_value(idx, v));
 }
 
-//#include <iostream>
+void Req::bind_blob(int idx, const void* v, size_t sz)
+{
+	check(bind_value(idx, v, sz));
+}
 
-void Req::prepare()
+void Req::bind_null(int idx)
 {
-	finalize();								// clean up the last statement if any
+	check(bind_value(idx, nullptr));
+}
 
-	if (m_pos >= m_sql.str().size()) 		// nothing to execute
+void Req::bind_zeroblob(int idx, size_t sz)
+{
+	check(bind_stmt());
+	int r = sqlite3_bind_zeroblob64(m_stmt, idx, sz);
+	if (r != SQLITE_OK)
 	{
-		return;
+		check(error(r));
 	}
+}
 
-//std::cout << "prepare: " << m_sql.str().substr(m_pos) << std::endl;
-
-	/*
-		The sqlite library compiles one statement at a time, and keeps track of where it left off,
-		so start at the current position.
-	*/
-	const char *head = &(m_sql.str()[m_pos]), *tail = nullptr;
-
-	int r = sqlite3_prepare_v2(m_conn.m_db, head, m_sql.str().size()+1, &m_stmt, &tail);		// include 0 character
-	if (r != SQLITE_OK)
+int Req::bind_index(const std::string& name)
+{
+	check(bind_stmt());
+	int idx = sqlite3_bind_parameter_index(m_stmt, name.c_str());
+	if (idx == 0)
 	{
-		throw std::runtime_error(sqlite3_errstr(r));
+		throw std::runtime_error("bind operation called with invalid parameter name");
 	}
+	return idx;
+}
 
-	assert(tail);
-	m_pos += tail-head;	// advance (when there are no more statements this will be larger than the sql string)
+void Req::clear_bindings()
+{
+	check(bind_stmt());
+	sqlite3_clear_bindings(m_stmt);
+}
+
+/*
+	The throwing api checks for usage errors first, so any remaining error is from sqlite, and is reported
+	with the same message as the try_ api.
+*/
+void Req::raise(const Error& e)
+{
+	throw std::runtime_error(e.what);
 }
 
 int Req::exec_select()
@@ -195,15 +1864,36 @@ int Req::exec_select()
 	{
 		throw std::runtime_error("exec_select() called with current row data");
 	}
+	auto r = try_exec_select();
+	if (!r)
+	{
+		raise(r.error());
+	}
+	return *r;
+}
+
+Result<int> Req::try_exec_select()
+{
+	if (m_cols)
+	{
+		return misuse("exec_select() called with current row data");
+	}
 
 	while (1)
 	{
-		prepare();			// go process the next request in the sql stream
-		
-		if (!m_stmt)		// this happens when we are done processing or there is only whitespace left
+		if (!m_pending)					// go process the next request in the sql stream
 		{
-			return 0;
+			int r = prepare();
+			if (r == SQLITE_DONE)
+			{
+				return 0;				// this happens when we are done processing or there is only whitespace left
+			}
+			if (r != SQLITE_OK)
+			{
+				return error(r);
+			}
 		}
+		m_pending = false;
 
 		int r = sqlite3_step(m_stmt);
 
@@ -214,7 +1904,7 @@ int Req::exec_select()
 
 		if (r != SQLITE_ROW)
 		{
-			throw std::runtime_error(sqlite3_errstr(r));
+			return error(r);
 		}
 
 		m_cols = sqlite3_column_count(m_stmt);		// we have row data, keep track of number of columns in row
@@ -231,18 +1921,44 @@ void Req::exec()
 	{
 		throw std::runtime_error("exec() called with current row data");
 	}
+	auto r = try_exec();
+	if (!r)
+	{
+		raise(r.error());
+	}
+}
+
+Result<void> Req::try_exec()
+{
+	if (m_cols)
+	{
+		return misuse("exec() called with current row data");
+	}
 
 	while (1)
 	{
-		int r = exec_select();
+		auto r = try_exec_select();
+		if (!r)
+		{
+			return r.error();
+		}
 
-		if (r == 0)		// done
+		if (*r == 0)		// done
 		{
-			return;
+			return Result<void>();
 		}
 
-		while (next_row())	// keep going until we have no more row data
+		while (1)			// keep going until we have no more row data
 		{
+			auto n = try_next_row();
+			if (!n)
+			{
+				return n.error();
+			}
+			if (*n == 0)
+			{
+				break;
+			}
 		}
 
 		// let the exec_select run again to make sure there are no more statements
@@ -259,6 +1975,24 @@ int Req::next_row()
 	{
 		throw std::runtime_error("next_row() called without current row data");
 	}
+	auto r = try_next_row();
+	if (!r)
+	{
+		raise(r.error());
+	}
+	return *r;
+}
+
+Result<int> Req::try_next_row()
+{
+	if (!m_stmt)
+	{
+		return misuse("next_row() called with invalid statement");
+	}
+	if (!m_cols)
+	{
+		return misuse("next_row() called without current row data");
+	}
 
 	int r = sqlite3_step(m_stmt);
 
@@ -270,13 +2004,13 @@ int Req::next_row()
 
 	if (r != SQLITE_ROW)			// another column coming
 	{
-		throw std::runtime_error(sqlite3_errstr(r));
+		return error(r);
 	}
 
 	return sqlite3_column_count(m_stmt);
 }
 
-std::string Req::col_name(int col)
+void Req::check_col(int col) const
 {
 	if (!m_stmt)
 	{
@@ -290,136 +2024,117 @@ std::string Req::col_name(int col)
 	{
 		throw std::runtime_error("column operation called with invalid column number");
 	}
+}
+
+std::string Req::col_name(int col)
+{
+	check_col(col);
 
 	return sqlite3_column_name(m_stmt, col);
 }
 
 void Req::col_name(int col, std::string& str)
 {
-	if (!m_stmt)
-	{
-		throw std::runtime_error("column operation called with invalid statement");
-	}
-	if (!m_cols)
-	{
-		throw std::runtime_error("column operation called when row not available");
-	}
-	if (col < 0 || col >= m_cols)
-	{
-		throw std::runtime_error("column operation called with invalid column number");
-	}
+	check_col(col);
 
 	str.assign(sqlite3_column_name(m_stmt, col));
 }
 
 std::string Req::col_text(int col)
 {
-	if (!m_stmt)
-	{
-		throw std::runtime_error("column operation called with invalid statement");
-	}
-	if (!m_cols)
-	{
-		throw std::runtime_error("column operation called when row not available");
-	}
-	if (col < 0 || col >= m_cols)
-	{
-		throw std::runtime_error("column operation called with invalid column number");
-	}
-
-	return reinterpret_cast<const char*>(sqlite3_column_text(m_stmt, col));
+	return std::string(col_text_view(col));
 }
 
 void Req::col_text(int col, std::string& str)
 {
-	if (!m_stmt)
-	{
-		throw std::runtime_error("column operation called with invalid statement");
-	}
-	if (!m_cols)
-	{
-		throw std::runtime_error("column operation called when row not available");
-	}
-	if (col < 0 || col >= m_cols)
-	{
-		throw std::runtime_error("column operation called with invalid column number");
-	}
+	str.assign(col_text_view(col));
+}
+
+std::string_view Req::col_text_view(int col)
+{
+	check_col(col);
 
-	str.assign(reinterpret_cast<const char*>(sqlite3_column_text(m_stmt, col)));
+	return get_text(col);
 }
 
 int Req::col_int(int col)
 {
-	if (!m_stmt)
-	{
-		throw std::runtime_error("column operation called with invalid statement");
-	}
-	if (!m_cols)
-	{
-		throw std::runtime_error("column operation called when row not available");
-	}
-	if (col < 0 || col >= m_cols)
-	{
-		throw std::runtime_error("column operation called with invalid column number");
-	}
+	check_col(col);
 
 	return sqlite3_column_int(m_stmt, col);
 }
 
 int64_t Req::col_int64(int col)
 {
-	if (!m_stmt)
-	{
-		throw std::runtime_error("column operation called with invalid statement");
-	}
-	if (!m_cols)
-	{
-		throw std::runtime_error("column operation called when row not available");
-	}
-	if (col < 0 || col >= m_cols)
-	{
-		throw std::runtime_error("column operation called with invalid column number");
-	}
+	check_col(col);
 
 	return sqlite3_column_int64(m_stmt, col);
 }
 
 double Req::col_real(int col)
 {
-	if (!m_stmt)
-	{
-		throw std::runtime_error("column operation called with invalid statement");
-	}
-	if (!m_cols)
-	{
-		throw std::runtime_error("column operation called when row not available");
-	}
-	if (col < 0 || col >= m_cols)
-	{
-		throw std::runtime_error("column operation called with invalid column number");
-	}
+	check_col(col);
 
 	return sqlite3_column_double(m_stmt, col);
 }
 
 void Req::col_blob(int col, std::vector<char>& str)
 {
-	if (!m_stmt)
-	{
-		throw std::runtime_error("column operation called with invalid statement");
-	}
-	if (!m_cols)
+	auto v = col_blob_view(col);
+
+	str.assign(reinterpret_cast<const char*>(v.data()), reinterpret_cast<const char*>(v.data())+v.size());
+}
+
+std::span<const std::byte> Req::col_blob_view(int col)
+{
+	check_col(col);
+
+	return get_blob(col);
+}
+
+int Req::col_bytes(int col)
+{
+	check_col(col);
+
+	return sqlite3_column_bytes(m_stmt, col);
+}
+
+bool Req::get_null(int col)
+{
+	return sqlite3_column_type(m_stmt, col) == SQLITE_NULL;
+}
+
+int Req::get_int(int col)
+{
+	return sqlite3_column_int(m_stmt, col);
+}
+
+int64_t Req::get_int64(int col)
+{
+	return sqlite3_column_int64(m_stmt, col);
+}
+
+double Req::get_real(int col)
+{
+	return sqlite3_column_double(m_stmt, col);
+}
+
+std::string_view Req::get_text(int col)
+{
+	const char* v = reinterpret_cast<const char*>(sqlite3_column_text(m_stmt, col));
+	if (!v)
 	{
-		throw std::runtime_error("column operation called when row not available");
+		return std::string_view();
 	}
-	if (col < 0 || col >= m_cols)
+	return std::string_view(v, sqlite3_column_bytes(m_stmt, col));
+}
+
+std::span<const std::byte> Req::get_blob(int col)
+{
+	const std::byte* v = reinterpret_cast<const std::byte*>(sqlite3_column_blob(m_stmt, col));
+	if (!v)
 	{
-		throw std::runtime_error("column operation called with invalid column number");
+		return std::span<const std::byte>();
 	}
-	
-	int sz = sqlite3_column_bytes(m_stmt, col);
-
-	const char* v = reinterpret_cast<const char*>(sqlite3_column_blob(m_stmt, col));
-
-	str.assign(v, v+sz);
+	return std::span<const std::byte>(v, sqlite3_column_bytes(m_stmt, col));
 }
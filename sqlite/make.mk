@@ -33,6 +33,8 @@ BLDLIBS += $(BASE)/scclib-sqlite/sqlite
 
 CPPFLAGS += -isystem $(BASE)/scclib-sqlite/sqlite/include
 
+CPPFLAGS += -DSQLITE_ENABLE_NORMALIZE -DSQLITE_ENABLE_SNAPSHOT -DSQLITE_ENABLE_SESSION -DSQLITE_ENABLE_PREUPDATE_HOOK # options which change sqlite3.h declarations
+
 ifeq ($(BLDTYPE),debug)
 SLIBS := -limportsqlited $(SLIBS)
 else
@@ -0,0 +1,258 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/stmt.h>
+#include <sqlite/sqld.h>
+#include <sqlite3.h>
+#include <string>
+#include <cctype>
+#include <stdexcept>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite prepared statement implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+Stmt::Stmt(Conn& conn, std::string_view sql) : m_stmt(nullptr)
+{
+	const char* tail = nullptr;
+	int r = sqlite3_prepare_v3(conn.m_db, sql.data(), sql.size(), SQLITE_PREPARE_PERSISTENT, &m_stmt, &tail);
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errmsg(conn.m_db));
+	}
+	if (!m_stmt)
+	{
+		throw std::runtime_error("statement has no sql");
+	}
+	for (const char* end = sql.data()+sql.size(); tail && tail < end; tail++)
+	{
+		if (!isspace(static_cast<unsigned char>(*tail)))
+		{
+			sqlite3_finalize(m_stmt);
+			m_stmt = nullptr;
+			throw std::runtime_error("statement has more than one sql statement");
+		}
+	}
+}
+
+Stmt::~Stmt()
+{
+	sqlite3_finalize(m_stmt);
+}
+
+Stmt& Stmt::operator=(Stmt&& other) noexcept
+{
+	if (this != &other)
+	{
+		sqlite3_finalize(m_stmt);
+		m_stmt = other.m_stmt;
+		other.m_stmt = nullptr;
+	}
+	return *this;
+}
+
+void Stmt::check(int r) const
+{
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errmsg(sqlite3_db_handle(m_stmt)));
+	}
+}
+
+void Stmt::check_col(int col) const
+{
+	if (!m_stmt)
+	{
+		throw std::runtime_error("column operation called with empty statement");
+	}
+	if (col < 0 || col >= sqlite3_data_count(m_stmt))
+	{
+		throw std::runtime_error("column operation called with invalid column number, or row not available");
+	}
+}
+
+std::string_view Stmt::sql() const
+{
+	const char* s = m_stmt ? sqlite3_sql(m_stmt) : nullptr;
+	return s ? std::string_view(s) : std::string_view();
+}
+
+static void check_stmt(sqlite3_stmt* stmt)
+{
+	if (!stmt)
+	{
+		throw std::runtime_error("operation called with empty statement");
+	}
+}
+
+void Stmt::bind_value(int idx, int v)
+{
+	check_stmt(m_stmt);
+	check(sqlite3_bind_int(m_stmt, idx, v));
+}
+
+void Stmt::bind_value(int idx, int64_t v)
+{
+	check_stmt(m_stmt);
+	check(sqlite3_bind_int64(m_stmt, idx, v));
+}
+
+void Stmt::bind_value(int idx, double v)
+{
+	check_stmt(m_stmt);
+	check(sqlite3_bind_double(m_stmt, idx, v));
+}
+
+void Stmt::bind_value(int idx, std::string_view v)
+{
+	check_stmt(m_stmt);
+	check(sqlite3_bind_text64(m_stmt, idx, v.data(), v.size(), SQLITE_TRANSIENT, SQLITE_UTF8));
+}
+
+void Stmt::bind_value(int idx, const void* v, size_t sz)
+{
+	check_stmt(m_stmt);
+	check(sqlite3_bind_blob64(m_stmt, idx, v, sz, SQLITE_TRANSIENT));
+}
+
+void Stmt::bind_value(int idx, std::nullptr_t)
+{
+	check_stmt(m_stmt);
+	check(sqlite3_bind_null(m_stmt, idx));
+}
+
+int Stmt::bind_index(const std::string& name)
+{
+	check_stmt(m_stmt);
+	int idx = sqlite3_bind_parameter_index(m_stmt, name.c_str());
+	if (idx == 0)
+	{
+		throw std::runtime_error("bind operation called with invalid parameter name");
+	}
+	return idx;
+}
+
+void Stmt::clear_bindings()
+{
+	check_stmt(m_stmt);
+	sqlite3_clear_bindings(m_stmt);
+}
+
+bool Stmt::step()
+{
+	check_stmt(m_stmt);
+	int r = sqlite3_step(m_stmt);
+	if (r == SQLITE_ROW)
+	{
+		return true;
+	}
+	if (r == SQLITE_DONE)
+	{
+		return false;
+	}
+	throw std::runtime_error(sqlite3_errmsg(sqlite3_db_handle(m_stmt)));
+}
+
+void Stmt::exec()
+{
+	check_stmt(m_stmt);
+	int r;
+	while ((r = sqlite3_step(m_stmt)) == SQLITE_ROW)
+	{
+	}
+	if (r != SQLITE_DONE)
+	{
+		std::string err(sqlite3_errmsg(sqlite3_db_handle(m_stmt)));
+		sqlite3_reset(m_stmt);
+		throw std::runtime_error(err);
+	}
+	sqlite3_reset(m_stmt);
+}
+
+void Stmt::reset()
+{
+	check_stmt(m_stmt);
+	sqlite3_reset(m_stmt);			// returns the error of the last step, which has already been reported
+}
+
+int Stmt::columns() const
+{
+	check_stmt(m_stmt);
+	return sqlite3_column_count(m_stmt);
+}
+
+bool Stmt::col_null(int col)
+{
+	check_col(col);
+	return sqlite3_column_type(m_stmt, col) == SQLITE_NULL;
+}
+
+int Stmt::col_int(int col)
+{
+	check_col(col);
+	return sqlite3_column_int(m_stmt, col);
+}
+
+int64_t Stmt::col_int64(int col)
+{
+	check_col(col);
+	return sqlite3_column_int64(m_stmt, col);
+}
+
+double Stmt::col_real(int col)
+{
+	check_col(col);
+	return sqlite3_column_double(m_stmt, col);
+}
+
+std::string_view Stmt::col_text_view(int col)
+{
+	check_col(col);
+	const char* v = reinterpret_cast<const char*>(sqlite3_column_text(m_stmt, col));
+	if (!v)
+	{
+		return std::string_view();
+	}
+	return std::string_view(v, sqlite3_column_bytes(m_stmt, col));
+}
+
+std::span<const std::byte> Stmt::col_blob_view(int col)
+{
+	check_col(col);
+	const std::byte* v = reinterpret_cast<const std::byte*>(sqlite3_column_blob(m_stmt, col));
+	if (!v)
+	{
+		return std::span<const std::byte>();
+	}
+	return std::span<const std::byte>(v, sqlite3_column_bytes(m_stmt, col));
+}
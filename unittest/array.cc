@@ -0,0 +1,157 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite array parameters \file */
+/** \example unittest/array.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::string_view;
+using std::vector;
+using std::runtime_error;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+
+struct ArrayTest : public testing::Test
+{
+	Conn db;
+
+	ArrayTest() : db(":memory:")
+	{
+		Req req(db);
+		req.sql() << "create table t(id INTEGER PRIMARY KEY, name TEXT, score REAL);";
+		req.exec();
+		for (int i = 0; i < 1000; i++)
+		{
+			req.clear();
+			req.sql() << "insert into t values(?, ?, ?);";
+			req.bind(i, "name" + std::to_string(i), i*0.5);
+			req.exec();
+		}
+	}
+};
+
+TEST_F(ArrayTest, in_list)
+{
+	Req req(db);
+	req.sql() << "select count(*), sum(id) from t where id in carray(?);";
+
+	vector<int64_t> ids = {1, 5, 7, 2000};
+	req.bind_array(1, ids);
+	req.exec_select();
+	ASSERT_EQ(req.col_int(0), 3);
+	ASSERT_EQ(req.col_int(1), 13);
+
+	for (size_t n : {0, 10, 500})								// the same statement serves any size
+	{
+		req.reset();
+		ids.clear();
+		for (size_t i = 0; i < n; i++)
+		{
+			ids.push_back(i*2);
+		}
+		req.bind_array(1, ids);
+		req.exec_select();
+		ASSERT_EQ(req.col_int(0), n);
+	}
+
+	auto st = db.stmt_cache_stats();
+	cout << "cache hits: " << st.hits << " misses: " << st.misses << endl;
+}
+
+TEST_F(ArrayTest, types)
+{
+	Req req(db);
+	vector<double> scores = {0.5, 1.5, 2.25};
+	req.sql() << "select count(*) from t where score in carray(?);";
+	req.bind_array(1, scores);
+	req.exec_select();
+	ASSERT_EQ(req.col_int(0), 2);
+
+	vector<string> names = {"name3", "name30", "nosuch"};
+	vector<string_view> views(names.begin(), names.end());
+	req.clear();
+	req.sql() << "select id from t where name in carray(:names) order by id;";
+	req.bind_array(":names", views);
+	vector<int> found;
+	for (auto [id] : req.rows<int>())
+	{
+		found.push_back(id);
+	}
+	ASSERT_EQ(found, vector<int>({3, 30}));
+
+	req.clear();
+	req.sql() << "select value, rowid from carray(?);";			// the array can be selected directly
+	req.bind_array(1, views);
+	vector<string> vals;
+	for (auto [v, r] : req.rows<string, int>())
+	{
+		vals.push_back(v);
+		ASSERT_EQ(r, vals.size());
+	}
+	ASSERT_EQ(vals, names);
+}
+
+TEST_F(ArrayTest, errors)
+{
+	Req req(db);
+	req.sql() << "select count(*) from carray(?);";				// unbound array has no rows
+	req.exec_select();
+	ASSERT_EQ(req.col_int(0), 0);
+
+	req.clear();
+	req.sql() << "select count(*) from carray('1,2,3');";			// a pointer cannot be made in sql
+	req.exec_select();
+	ASSERT_EQ(req.col_int(0), 0);
+
+	req.clear();
+	req.sql() << "select count(*) from t where id in carray(?);";
+	vector<int64_t> ids = {1};
+	ASSERT_THROW(req.bind_array(2, ids), runtime_error);
+
+	db.reopen(":memory:");										// available after reopen
+	req.clear();
+	req.sql() << "select count(*) from carray(?);";
+	req.bind_array(1, ids);
+	req.exec_select();
+	ASSERT_EQ(req.col_int(0), 1);
+}
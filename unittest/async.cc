@@ -0,0 +1,198 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/async.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <coroutine>
+#include <future>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite asynchronous connection \file */
+/** \example unittest/async.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::tuple;
+using std::runtime_error;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::AsyncConn;
+
+/*
+	Minimal eagerly started coroutine, which signals completion.
+*/
+struct Task
+{
+	struct promise_type
+	{
+		std::promise<void> done;
+
+		Task get_return_object() { return Task{done.get_future()}; }
+		std::suspend_never initial_suspend() { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() { done.set_value(); }
+		void unhandled_exception() { done.set_exception(std::current_exception()); }
+	};
+
+	std::future<void> done;
+};
+
+struct AsyncTest : public testing::Test
+{
+	AsyncConn db;
+
+	AsyncTest()
+	{
+		db.exec("create table t(id INTEGER, name TEXT);").future().get();
+	}
+	virtual ~AsyncTest()
+	{
+		db.exec("drop table t;").future().get();
+	}
+};
+
+TEST_F(AsyncTest, future)
+{
+	string name("one");
+	auto f1 = db.exec("insert into t values(?, ?);", 1, name);
+	auto f2 = db.exec("insert into t values(?, ?);", 2, "two");
+	auto w1 = f1.future();
+	auto w2 = f2.future();
+	w1.get();
+	w2.get();
+
+	auto v = db.select<int, string>("select id, name from t where id >= ? order by id;", 1).future().get();
+	ASSERT_EQ(v.size(), 2);
+	ASSERT_EQ(v[0], tuple(1, "one"));
+	ASSERT_EQ(v[1], tuple(2, "two"));
+
+	auto bad = db.exec("insert into nosuch values(1);").future();
+	ASSERT_THROW(bad.get(), runtime_error);
+
+	auto tid = db.call([](Conn&) { return std::this_thread::get_id(); }).future().get();
+	ASSERT_NE(tid, std::this_thread::get_id());
+}
+
+TEST_F(AsyncTest, fifo)
+{
+	vector<int> order;			// only touched on the executor thread
+	vector<std::future<void>> fs;
+	for (int i = 0; i < 100; i++)
+	{
+		fs.push_back(db.call([&order, i](Conn& c)
+		{
+			Req req(c);
+			req.sql() << "insert into t values(" << i << ", 'x');";
+			req.exec();
+			order.push_back(i);
+		}).future());
+	}
+	for (auto& f : fs)
+	{
+		f.get();
+	}
+	ASSERT_EQ(order.size(), 100);
+	for (int i = 0; i < 100; i++)
+	{
+		ASSERT_EQ(order[i], i);
+	}
+}
+
+static Task insert_and_count(AsyncConn& db, int& count, string& err)
+{
+	co_await db.exec("insert into t values(?, ?);", 1, "one");
+	co_await db.exec("insert into t values(?, ?);", 2, "two");
+	auto v = co_await db.select<int>("select count(*) from t;");
+	count = std::get<0>(v[0]);
+
+	try
+	{
+		co_await db.exec("insert into nosuch values(1);");
+	}
+	catch (runtime_error& e)
+	{
+		err = e.what();
+	}
+}
+
+TEST_F(AsyncTest, coroutine)
+{
+	int count = 0;
+	string err;
+	auto t = insert_and_count(db, count, err);
+	t.done.get();
+	ASSERT_EQ(count, 2);
+	cout << "error: " << err << endl;
+	ASSERT_FALSE(err.empty());
+}
+
+TEST_F(AsyncTest, resume_hook)
+{
+	// resume coroutines on this thread, as an event loop would
+	std::mutex mx;
+	std::condition_variable cv;
+	vector<std::coroutine_handle<>> ready;
+	db.resume_with([&](std::coroutine_handle<> h)
+	{
+		std::lock_guard<std::mutex> lk(mx);
+		ready.push_back(h);
+		cv.notify_one();
+	});
+
+	int count = 0;
+	string err;
+	auto t = insert_and_count(db, count, err);
+
+	auto loop = std::this_thread::get_id();
+	int resumes = 0;
+	while (t.done.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		std::unique_lock<std::mutex> lk(mx);
+		cv.wait(lk, [&] { return !ready.empty(); });
+		auto h = ready.front();
+		ready.erase(ready.begin());
+		lk.unlock();
+		ASSERT_EQ(std::this_thread::get_id(), loop);
+		h.resume();
+		resumes++;
+	}
+	t.done.get();
+	ASSERT_EQ(resumes, 4);
+	ASSERT_EQ(count, 2);
+	db.resume_with(nullptr);
+}
@@ -0,0 +1,185 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/batch.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite columnar batch \file */
+/** \example unittest/batch.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::runtime_error;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::ColumnBatch;
+using scc::sqld::ColType;
+
+struct BatchTest : public testing::Test
+{
+	Conn db;
+
+	BatchTest()
+	{
+		Req req(db);
+		req.sql() << "create table t(id INT, name TEXT, score REAL, b BLOB);";
+		req.exec();
+		req.clear();
+		req.sql() << "insert into t values(?, ?, ?, ?);";
+		for (int i = 0; i < 25; i++)
+		{
+			req.reset();
+			if (i % 3)
+			{
+				req.bind(i, std::to_string(i), i*0.5, vector<char>(i, 'x'));
+			}
+			else
+			{
+				req.bind(i, nullptr, nullptr, nullptr);
+			}
+			req.exec();
+		}
+	}
+	virtual ~BatchTest()
+	{
+		Req req(db);
+		req.sql() << "drop table t;";
+		req.exec();
+	}
+};
+
+TEST_F(BatchTest, fetch)
+{
+	Req req(db);
+	req.sql() << "select id, name, score, b from t order by id;";
+
+	ColumnBatch batch;
+	vector<size_t> sizes;
+	int64_t ids = 0, nulls = 0;
+	size_t text = 0, blob = 0;
+	double score = 0;
+	while (size_t n = req.fetch_batch(batch, 10))
+	{
+		sizes.push_back(n);
+		ASSERT_EQ(batch.rows(), n);
+		ASSERT_EQ(batch.cols(), 4);
+		auto& c0 = batch.col(0);
+		auto& c1 = batch.col(1);
+		auto& c2 = batch.col(2);
+		auto& c3 = batch.col(3);
+		ASSERT_EQ(c0.type, ColType::integer);
+		ASSERT_EQ(c1.type, ColType::text);
+		ASSERT_EQ(c2.type, ColType::real);
+		ASSERT_EQ(c3.type, ColType::blob);
+		ASSERT_EQ(c1.name, "name");
+		for (size_t i = 0; i < n; i++)
+		{
+			ids += c0.ints[i];
+			score += c2.reals[i];
+			if (c1.is_null(i))
+			{
+				nulls++;
+				continue;
+			}
+			ASSERT_EQ(std::to_string(c0.ints[i]), c1.text(i));
+			text += c1.text(i).size();
+			blob += c3.blob(i).size();
+		}
+	}
+	ASSERT_EQ(sizes, vector<size_t>({10, 10, 5}));
+	ASSERT_EQ(ids, 300);
+	ASSERT_EQ(nulls, 9);
+	ASSERT_EQ(score, (300-(0+3+6+9+12+15+18+21+24))*0.5);
+	ASSERT_EQ(blob, 300-(0+3+6+9+12+15+18+21+24));
+	ASSERT_GT(text, 0);
+}
+
+TEST_F(BatchTest, types)
+{
+	Req req(db);
+	req.sql() << "select name, id from t where id > 0 order by id;";
+
+	ColumnBatch batch;
+	batch.types({ColType::integer, ColType::text});		// convert to these types
+	ASSERT_EQ(req.fetch_batch(batch, 100), 24);
+	ASSERT_EQ(batch.col(0).ints[0], 1);
+	ASSERT_EQ(batch.col(1).text(23), "24");
+
+	req.clear();
+	req.sql() << "select id from t;";
+	ASSERT_THROW(req.fetch_batch(batch, 100), runtime_error);		// wrong number of columns
+	batch.reset();
+	req.reset();
+	ASSERT_EQ(req.fetch_batch(batch, 100), 25);
+	ASSERT_EQ(req.fetch_batch(batch, 100), 0);
+}
+
+TEST_F(BatchTest, inferred)
+{
+	Req req(db);
+	req.sql() << "create table n(a, b NUMERIC, c REAL, d DATE); insert into n values(1, 1, 1, '2024-01-01'), (2.5, 2.5, 2, NULL);";
+	req.exec();
+	req.clear();
+	req.sql() << "select a, b, c, d, a*2, count(*) over () from n order by rowid;";
+
+	ColumnBatch batch;
+	ASSERT_EQ(req.fetch_batch(batch, 10), 2);
+	for (int i : {0, 1, 4})									// widened by the second row
+	{
+		ASSERT_EQ(batch.col(i).type, ColType::real);
+		ASSERT_EQ(batch.col(i).reals, vector<double>({i == 4 ? 2.0 : 1.0, i == 4 ? 5.0 : 2.5}));
+	}
+	ASSERT_EQ(batch.col(2).type, ColType::real);			// declared type
+	ASSERT_EQ(batch.col(2).reals[0], 1);
+	ASSERT_EQ(batch.col(3).type, ColType::text);			// from the first value
+	ASSERT_EQ(batch.col(3).text(0), "2024-01-01");
+	ASSERT_TRUE(batch.col(3).is_null(1));
+	ASSERT_EQ(batch.col(5).type, ColType::integer);
+	ASSERT_EQ(batch.col(5).ints[1], 2);
+
+	req.clear();
+	req.sql() << "select b from n order by rowid;";
+	ColumnBatch fixed;
+	fixed.types({ColType::integer});						// converted, not widened
+	ASSERT_EQ(req.fetch_batch(fixed, 10), 2);
+	ASSERT_EQ(fixed.col(0).type, ColType::integer);
+	ASSERT_EQ(fixed.col(0).ints[1], 2);
+
+	req.clear();
+	req.sql() << "drop table n;";
+	req.exec();
+}
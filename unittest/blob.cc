@@ -0,0 +1,154 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite/blob.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <span>
+#include <cstddef>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite incremental blob i/o \file */
+/** \example unittest/blob.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::runtime_error;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::BlobStream;
+
+struct BlobTest : public testing::Test
+{
+	Conn db;
+
+	BlobTest() : db(":memory:")
+	{
+		Req req(db);
+		req.sql() << "create table f(id INTEGER PRIMARY KEY, name TEXT, data BLOB);";
+		req.exec();
+	}
+
+	int64_t insert(const string& name, size_t sz)
+	{
+		Req req(db);
+		req.sql() << "insert into f(name, data) values(?, ?);";
+		req.bind_text(1, name);
+		req.bind_zeroblob(2, sz);
+		req.exec();
+		return db.last_insert_rowid();
+	}
+};
+
+TEST_F(BlobTest, stream)
+{
+	const size_t sz = 1024*1024+17, chunk = 64*1024;
+
+	int64_t id = insert("big", sz);
+	ASSERT_EQ(id, 1);
+
+	{
+		BlobStream bs(db, "f", "data", id, true);
+		ASSERT_EQ(bs.size(), sz);
+		ASSERT_EQ(bs.rowid(), id);
+
+		vector<char> buf(chunk);
+		for (size_t off = 0; off < sz; off += chunk)
+		{
+			size_t len = std::min(chunk, sz-off);
+			for (size_t i = 0; i < len; i++)
+			{
+				buf[i] = static_cast<char>((off+i) % 251);
+			}
+			bs.write(buf.data(), len, off);
+		}
+
+		ASSERT_THROW(bs.write(buf.data(), 2, sz-1), runtime_error);		// cannot grow
+	}
+
+	BlobStream rs(db, "f", "data", id);
+	vector<std::byte> buf(chunk);
+	size_t off = 0, bad = 0;
+	while (size_t got = rs.read(buf, off))
+	{
+		for (size_t i = 0; i < got; i++)
+		{
+			if (buf[i] != static_cast<std::byte>((off+i) % 251))
+			{
+				bad++;
+			}
+		}
+		off += got;
+	}
+	ASSERT_EQ(off, sz);
+	ASSERT_EQ(bad, 0);
+
+	char c;
+	ASSERT_THROW(rs.read(&c, 1, sz), runtime_error);
+	ASSERT_THROW(rs.write(&c, 1, 0), runtime_error);					// read-only
+
+	Req req(db);
+	req.sql() << "select length(data) from f where id = ?;";
+	req.bind(id);
+	req.exec_select();
+	ASSERT_EQ(req.col_int64(0), sz);
+}
+
+TEST_F(BlobTest, reopen)
+{
+	for (int i = 0; i < 10; i++)
+	{
+		int64_t id = insert("file" + std::to_string(i), i+1);
+		BlobStream bs(db, "f", "data", id, true);
+		char c = 'a'+i;
+		bs.write(&c, 1, i);
+	}
+
+	BlobStream bs(db, "f", "data", 1);
+	for (int i = 0; i < 10; i++)
+	{
+		bs.reopen(i+1);
+		ASSERT_EQ(bs.size(), i+1);
+		char c = 0;
+		bs.read(&c, 1, i);
+		ASSERT_EQ(c, 'a'+i);
+	}
+
+	ASSERT_THROW(bs.reopen(100), runtime_error);
+	ASSERT_THROW(BlobStream(db, "f", "data", 100), runtime_error);
+	ASSERT_THROW(BlobStream(db, "f", "nosuch", 1), runtime_error);
+}
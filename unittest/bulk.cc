@@ -0,0 +1,171 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/bulk.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite bulk inserter \file */
+/** \example unittest/bulk.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::runtime_error;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::BulkInserter;
+using scc::sqld::BulkOptions;
+
+struct BulkTest : public testing::Test
+{
+	Conn db;
+
+	BulkTest()
+	{
+		Req req(db);
+		req.sql() << "create table t(id INT, name TEXT, score REAL, b BLOB);";
+		req.exec();
+	}
+	virtual ~BulkTest()
+	{
+		Req req(db);
+		req.sql() << "drop table t;";
+		req.exec();
+	}
+
+	int64_t count()
+	{
+		Req req(db);
+		req.sql() << "select count(*) from t;";
+		req.exec_select();
+		return req.col_int64(0);
+	}
+};
+
+TEST_F(BulkTest, insert)
+{
+	BulkOptions opts;
+	opts.rows_per_stmt = 10;
+	opts.commit_rows = 100;
+
+	BulkInserter ins(db, "t", {"id", "name", "score", "b"}, opts);
+
+	for (int i = 0; i < 1005; i++)
+	{
+		if (i % 2)
+		{
+			ins.add(i, std::to_string(i), i*0.5, vector<char>{'a', 'b'});
+		}
+		else
+		{
+			ins.add(std::make_tuple(i, nullptr, std::optional<double>(), std::string_view("blob")));
+		}
+	}
+
+	auto st = ins.stats();
+	ASSERT_EQ(st.rows, 1000);			// 5 rows buffered
+	ASSERT_EQ(st.statements, 100);
+	ASSERT_EQ(st.commits, 10);
+	ASSERT_EQ(count(), 1000);
+
+	BulkInserter::Value row[] = {int64_t(2000), string("two thousand"), 1.5, nullptr};
+	ins.add_row(row);
+	ins.finish();
+
+	st = ins.stats();
+	cout << "rows: " << st.rows << " bytes: " << st.bytes << " rows/sec: " << st.rows_per_sec() << endl;
+	ASSERT_EQ(st.rows, 1006);
+	ASSERT_EQ(st.statements, 101);
+	ASSERT_EQ(st.commits, 11);
+	ASSERT_GT(st.rows_per_sec(), 0);
+	ASSERT_EQ(count(), 1006);
+
+	Req req(db);
+	req.sql() << "select sum(id), count(name), count(score), count(b) from t;";
+	ASSERT_EQ(req.exec_select(), 4);
+	ASSERT_EQ(req.col_int64(0), 1005*1004/2+2000);
+	ASSERT_EQ(req.col_int(1), 503);
+	ASSERT_EQ(req.col_int(2), 503);
+	ASSERT_EQ(req.col_int(3), 1005);
+
+	ASSERT_THROW(ins.add(1, 2), runtime_error);		// wrong number of values
+}
+
+TEST_F(BulkTest, rollback)
+{
+	{
+		BulkInserter ins(db, "t", {"id"});
+		for (int i = 0; i < 100; i++)
+		{
+			ins.add(i);
+		}
+		ASSERT_EQ(ins.stats().rows, 64);
+	}
+	ASSERT_EQ(count(), 0);		// not committed
+}
+
+TEST_F(BulkTest, constraint)
+{
+	Req req(db);
+	req.sql() << "create unique index t_id on t(id);";
+	req.exec();
+
+	BulkOptions opts;
+	opts.rows_per_stmt = 4;
+	BulkInserter ins(db, "t", {"id"}, opts);
+	for (int i = 0; i < 4; i++)
+	{
+		ins.add(i);
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		ins.add(i+10);
+	}
+	ASSERT_THROW(ins.add(0), runtime_error);		// duplicate, the batch of 4 is dropped
+	ASSERT_EQ(ins.stats().rows, 4);
+
+	for (int i = 0; i < 6; i++)						// the buffer is reused
+	{
+		ins.add(i+20);
+	}
+	ins.finish();
+	ASSERT_EQ(ins.stats().rows, 10);
+	ASSERT_EQ(count(), 10);
+
+	req.clear();
+	req.sql() << "drop index t_id;";
+	req.exec();
+}
@@ -0,0 +1,256 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite/change.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite change streams \file */
+/** \example unittest/change.cc */
+/** @} */
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::Trans;
+using scc::sqld::Savepoint;
+using scc::sqld::ChangeStream;
+using scc::sqld::Conflict;
+
+struct ChangeTest : public testing::Test
+{
+	Conn src, dst;
+
+	ChangeTest() : src(":memory:"), dst(":memory:")
+	{
+		for (auto c : {&src, &dst})
+		{
+			exec(*c, "create table kv(k INTEGER PRIMARY KEY, v TEXT); create table other(k INTEGER PRIMARY KEY);");
+		}
+	}
+
+	static void exec(Conn& c, const string& sql)
+	{
+		Req req(c);
+		req.sql() << sql;
+		req.exec();
+	}
+
+	static string dump(Conn& c)
+	{
+		string s;
+		Req req(c);
+		req.sql() << "select k, v from kv order by k;";
+		for (auto [k, v] : req.rows<int64_t, string>())
+		{
+			s += std::to_string(k) + "=" + v + ";";
+		}
+		return s;
+	}
+
+	void replicate(ChangeStream& cs, Conflict conflict = Conflict::abort)
+	{
+		vector<char> c;
+		while (cs.next(c))
+		{
+			ChangeStream::apply(dst, c, conflict);
+		}
+	}
+};
+
+TEST_F(ChangeTest, replicate)
+{
+	ChangeStream cs(src);
+	ASSERT_EQ(cs.pending(), 0);
+
+	Trans t(src);
+	t.begin();
+	exec(src, "insert into kv values(1, 'a'), (2, 'b'), (3, 'c');");
+	t.commit();
+	ASSERT_EQ(cs.pending(), 1);
+	ASSERT_GT(cs.pending_bytes(), 0);
+
+	t.begin();
+	exec(src, "update kv set v = 'B' where k = 2; delete from kv where k = 3; insert into kv values(4, 'd');");
+	t.commit();
+	ASSERT_EQ(cs.pending(), 2);
+
+	t.begin();										// read only transactions add nothing
+	ASSERT_EQ(dump(src), "1=a;2=B;4=d;");
+	t.commit();
+	ASSERT_EQ(cs.pending(), 2);
+
+	replicate(cs);
+	ASSERT_EQ(cs.pending(), 0);
+	ASSERT_EQ(cs.pending_bytes(), 0);
+	ASSERT_EQ(dump(dst), "1=a;2=B;4=d;");
+
+	vector<char> c;
+	ASSERT_FALSE(cs.next(c));
+}
+
+TEST_F(ChangeTest, rollback)
+{
+	ChangeStream cs(src);
+
+	Trans t(src);
+	t.begin();
+	exec(src, "insert into kv values(1, 'a');");
+	t.abort();
+	ASSERT_EQ(cs.pending(), 0);
+
+	t.begin();
+	exec(src, "insert into kv values(2, 'b');");
+	{
+		Savepoint sp(src);
+		exec(src, "insert into kv values(3, 'c');");
+		sp.rollback();
+	}
+	t.commit();
+	ASSERT_EQ(cs.pending(), 1);
+
+	replicate(cs);
+	ASSERT_EQ(dump(dst), "2=b;");
+}
+
+TEST_F(ChangeTest, flush)
+{
+	ChangeStream cs(src);
+
+	exec(src, "insert into kv values(1, 'a');");		// outside of a transaction
+	ASSERT_EQ(cs.pending(), 0);
+	cs.flush();
+	ASSERT_EQ(cs.pending(), 1);
+	cs.flush();										// nothing new
+	ASSERT_EQ(cs.pending(), 1);
+
+	exec(src, "insert into kv values(2, 'b');");
+	Trans t(src);
+	t.begin();
+	ASSERT_THROW(cs.flush(), runtime_error);
+	exec(src, "insert into kv values(3, 'c');");
+	t.commit();										// includes the earlier change
+	ASSERT_EQ(cs.pending(), 2);
+
+	replicate(cs);
+	ASSERT_EQ(dump(dst), "1=a;2=b;3=c;");
+}
+
+TEST_F(ChangeTest, reopen)
+{
+	ChangeStream cs(src);
+
+	Trans t(src);
+	t.begin();
+	exec(src, "insert into kv values(1, 'a');");
+	t.commit();
+
+	src.reopen(":memory:");								// the stream stops recording
+	exec(src, "create table kv(k INTEGER PRIMARY KEY, v TEXT);");
+	t.begin();
+	exec(src, "insert into kv values(2, 'b');");
+	t.commit();
+	ASSERT_EQ(cs.pending(), 1);
+	ASSERT_THROW(cs.flush(), runtime_error);
+
+	vector<char> c;
+	ASSERT_TRUE(cs.next(c));							// changes before the close are kept
+	ChangeStream::apply(dst, c);
+	ASSERT_EQ(dump(dst), "1=a;");
+	ASSERT_THROW(cs.next(c), runtime_error);
+}
+
+TEST_F(ChangeTest, tables)
+{
+	ChangeStream cs(src, {"other"});
+
+	Trans t(src);
+	t.begin();
+	exec(src, "insert into kv values(1, 'a'); insert into other values(7);");
+	t.commit();
+
+	replicate(cs);
+	ASSERT_EQ(dump(dst), "");
+	Req req(dst);
+	req.sql() << "select k from other;";
+	req.exec_select();
+	ASSERT_EQ(req.col_int(0), 7);
+}
+
+TEST_F(ChangeTest, conflict)
+{
+	exec(src, "insert into kv values(1, 'a');");
+	exec(dst, "insert into kv values(1, 'a');");
+
+	ChangeStream cs(src);
+	Trans t(src);
+	t.begin();
+	exec(src, "update kv set v = 'A' where k = 1; insert into kv values(2, 'b');");
+	t.commit();
+	vector<char> c;
+	ASSERT_TRUE(cs.next(c));
+
+	exec(dst, "update kv set v = 'x' where k = 1; insert into kv values(2, 'y');");
+
+	ASSERT_THROW(ChangeStream::apply(dst, c), runtime_error);
+	ASSERT_EQ(dump(dst), "1=x;2=y;");				// nothing applied
+
+	ChangeStream::apply(dst, c, Conflict::omit);
+	ASSERT_EQ(dump(dst), "1=x;2=y;");
+
+	exec(dst, "delete from kv where k = 1;");
+	ChangeStream::apply(dst, c, Conflict::replace);	// the update of the missing row is skipped
+	ASSERT_EQ(dump(dst), "2=b;");
+
+	ASSERT_THROW(ChangeStream::apply(dst, vector<char>{1, 2, 3}), runtime_error);
+}
+
+TEST_F(ChangeTest, patchset)
+{
+	exec(src, "insert into kv values(1, 'a long value which is left out of patchsets');");
+	exec(dst, "insert into kv values(1, 'a long value which is left out of patchsets');");
+
+	ChangeStream full(src), patch(src, {}, "main", true);
+	Trans t(src);
+	t.begin();
+	exec(src, "delete from kv where k = 1;");
+	t.commit();
+	ASSERT_LT(patch.pending_bytes(), full.pending_bytes());
+
+	replicate(patch);
+	ASSERT_EQ(dump(dst), "");
+}
@@ -0,0 +1,121 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite/config.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite process-level configuration \file */
+/** \example unittest/config.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::Config;
+using scc::sqld::AllocStats;
+
+struct ConfigTest : public testing::Test
+{
+	virtual ~ConfigTest()
+	{
+		Config().init();		// back to the defaults for other tests
+	}
+
+	AllocStats work()
+	{
+		Config::reset_alloc_stats();
+
+		Conn db(":memory:");
+		Req req(db);
+		req.sql() << "create table t(id INTEGER PRIMARY KEY, name TEXT);";
+		req.exec();
+
+		for (int i = 0; i < 200; i++)
+		{
+			req.clear();
+			req.sql() << "insert into t values(" << i << ", 'name " << i << "');";
+			req.exec();
+		}
+		req.clear();
+		req.sql() << "select count(*) from t;";
+		req.exec_select();
+		EXPECT_EQ(req.col_int(0), 200);
+		req.clear();
+
+		return Config::alloc_stats();
+	}
+};
+
+TEST_F(ConfigTest, allocator)
+{
+	Config cfg;
+	cfg.allocator = Config::Allocator::system;
+	cfg.memstatus = false;
+	cfg.init();
+	auto sys = work();
+	cout << "system allocs: " << sys.allocs << " system: " << sys.system_allocs << endl;
+	ASSERT_GT(sys.allocs, 0);
+	ASSERT_GT(sys.system_allocs, 0);
+
+	cfg.allocator = Config::Allocator::pool;
+	cfg.pagecache_pages = 100;
+	cfg.init();
+	auto pool = work();
+	cout << "pool allocs: " << pool.allocs << " system: " << pool.system_allocs << endl;
+	ASSERT_LT(pool.system_allocs*5, sys.system_allocs);	// blocks are reused
+
+	std::thread t([this]()
+	{
+		work();
+	});
+	t.join();
+	auto st = Config::alloc_stats();						// includes the exited thread
+	ASSERT_GT(st.allocs, pool.allocs/2);
+}
+
+TEST_F(ConfigTest, defaults)
+{
+	Config cfg;
+	cfg.lookaside_slots = 0;
+	cfg.init();
+	auto st = work();
+	ASSERT_EQ(st.allocs, 0);								// sqlite allocator is not counted
+
+	Conn db;
+	ASSERT_THROW(Config().init(), std::runtime_error);	// connection is open
+}
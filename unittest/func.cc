@@ -0,0 +1,229 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <vector>
+#include <stdexcept>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite user-defined functions \file */
+/** \example unittest/func.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::string_view;
+using std::optional;
+using std::vector;
+using std::runtime_error;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+
+struct FuncTest : public testing::Test
+{
+	Conn db;
+
+	FuncTest() : db(":memory:")
+	{
+		Req req(db);
+		req.sql() << "create table t(id INTEGER PRIMARY KEY, grp INTEGER, v REAL, name TEXT);";
+		req.exec();
+		for (int i = 1; i <= 10; i++)
+		{
+			req.clear();
+			req.sql() << "insert into t(grp, v, name) values(?, ?, ?);";
+			req.bind(i % 2, i*1.5, "name" + std::to_string(i));
+			req.exec();
+		}
+	}
+
+	template <typename T>
+	T one(const string& sql)
+	{
+		Req req(db);
+		req.sql() << sql;
+		for (auto [v] : req.rows<T>())
+		{
+			return v;
+		}
+		throw runtime_error("no row");
+	}
+};
+
+TEST_F(FuncTest, scalar)
+{
+	db.create_function("twice", [](int64_t v) { return v*2; });
+	db.create_function("weight", [](double v, double w) { return v*w; });
+	db.create_function("upper2", [](string_view s)
+	{
+		string r(s);
+		for (auto& c : r) c = toupper(c);
+		return r;
+	});
+	db.create_function("maybe", [](optional<int> v) -> optional<int>
+	{
+		if (!v || *v < 0) return std::nullopt;
+		return *v;
+	});
+
+	ASSERT_EQ(one<int64_t>("select twice(21);"), 42);
+	ASSERT_EQ(one<double>("select weight(2.5, 4);"), 10.0);
+	ASSERT_EQ(one<string>("select upper2('abc');"), "ABC");
+	ASSERT_EQ(one<optional<int>>("select maybe(5);"), 5);
+	ASSERT_EQ(one<optional<int>>("select maybe(-5);"), std::nullopt);
+	ASSERT_EQ(one<optional<int>>("select maybe(null);"), std::nullopt);
+	ASSERT_EQ(one<int64_t>("select count(*) from t where weight(v, 2) > 20;"), 4);
+
+	Req req(db);
+	req.sql() << "select twice(1, 2);";							// wrong number of arguments
+	ASSERT_THROW(req.exec(), runtime_error);
+}
+
+TEST_F(FuncTest, deterministic)
+{
+	db.create_function("bucket", [](int64_t id) { return id / 3; });
+	db.create_function("noisy", [](int64_t id) { return id / 3; }, false);
+
+	Req req(db);
+	req.sql() << "create index t_bucket on t(bucket(id));";		// deterministic functions can be indexed
+	req.exec();
+	ASSERT_EQ(one<int64_t>("select count(*) from t where bucket(id) = 1;"), 3);
+
+	req.clear();
+	req.sql() << "create index t_noisy on t(noisy(id));";
+	ASSERT_THROW(req.exec(), runtime_error);
+}
+
+TEST_F(FuncTest, error)
+{
+	db.create_function("fail", [](int v) -> int
+	{
+		if (v > 5)
+		{
+			throw runtime_error("value too large");
+		}
+		return v;
+	});
+
+	ASSERT_EQ(one<int>("select fail(1);"), 1);
+
+	Req req(db);
+	req.sql() << "select fail(id) from t;";
+	try
+	{
+		req.exec();
+		FAIL();
+	}
+	catch (const runtime_error& e)
+	{
+		cout << "error: " << e.what() << endl;
+		ASSERT_STREQ(e.what(), "value too large");
+	}
+
+	db.reopen(":memory:");										// functions must be registered again
+	req.clear();
+	req.sql() << "select fail(1);";
+	ASSERT_THROW(req.exec(), runtime_error);
+}
+
+struct Mean
+{
+	double sum = 0;
+	int64_t n = 0;
+	void step(double v) { sum += v; n++; }
+	optional<double> value() const { return n ? optional<double>(sum/n) : std::nullopt; }
+};
+
+struct Concat
+{
+	string sep;
+	string acc;
+	void step(string_view s)
+	{
+		if (!acc.empty()) acc += sep;
+		acc += s;
+	}
+	string value() const { return acc; }
+};
+
+struct Total
+{
+	int64_t sum = 0;
+	void step(int64_t v) { sum += v; }
+	void inverse(int64_t v) { sum -= v; }
+	int64_t value() const { return sum; }
+};
+
+TEST_F(FuncTest, aggregate)
+{
+	db.create_aggregate("mean", Mean());
+	db.create_aggregate("concat", Concat{"|", ""});
+
+	ASSERT_EQ(one<double>("select mean(v) from t;"), 8.25);
+	ASSERT_EQ(one<optional<double>>("select mean(v) from t where id > 100;"), std::nullopt);	// empty group
+	ASSERT_EQ(one<string>("select concat(name) from (select name from t where id <= 3 order by id);"), "name1|name2|name3");
+
+	Req req(db);
+	req.sql() << "select grp, mean(v) from t group by grp order by grp;";
+	vector<double> means;
+	for (auto [g, m] : req.rows<int, double>())
+	{
+		means.push_back(m);
+	}
+	ASSERT_EQ(means, vector<double>({9.0, 7.5}));
+}
+
+TEST_F(FuncTest, window)
+{
+	db.create_aggregate("total", Total());
+
+	ASSERT_EQ(one<int64_t>("select total(id) from t;"), 55);
+
+	Req req(db);
+	req.sql() << "select total(id) over (order by id rows between 1 preceding and current row) from t order by id;";
+	vector<int64_t> sums;
+	for (auto [s] : req.rows<int64_t>())
+	{
+		sums.push_back(s);
+	}
+	ASSERT_EQ(sums, vector<int64_t>({1, 3, 5, 7, 9, 11, 13, 15, 17, 19}));
+
+	db.create_aggregate("mean", Mean());						// no inverse, not a window function
+	req.clear();
+	req.sql() << "select mean(v) over (order by id rows between 1 preceding and current row) from t;";
+	ASSERT_THROW(req.exec(), runtime_error);
+}
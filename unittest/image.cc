@@ -0,0 +1,166 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite/image.h>
+#include <gtest/gtest.h>
+#include <util/fs.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite database images \file */
+/** \example unittest/image.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::system_error;
+using std::runtime_error;
+using fs = scc::util::Filesystem;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::MappedImage;
+
+struct ImageTest : public testing::Test
+{
+	string curdir;
+	Conn db;
+
+	ImageTest() : db(":memory:")
+	{
+		curdir = fs::get_current_dir();
+
+		system_error err;
+		fs::remove_all("sandbox", &err);
+		fs::create_dir("sandbox");
+		fs::change_dir("sandbox");
+
+		Req req(db);
+		req.sql() << "create table t(id INTEGER PRIMARY KEY, name TEXT);";
+		req.exec();
+		for (int i = 0; i < 100; i++)
+		{
+			req.clear();
+			req.sql() << "insert into t values(" << i << ", 'name " << i << "');";
+			req.exec();
+		}
+	}
+	virtual ~ImageTest()
+	{
+		fs::change_dir(curdir);
+		system_error err;
+		fs::remove_all("sandbox", &err);
+	}
+
+	int64_t count(Conn& c)
+	{
+		Req req(c);
+		req.sql() << "select count(*) from t;";
+		req.exec_select();
+		return req.col_int64(0);
+	}
+};
+
+TEST_F(ImageTest, copy)
+{
+	auto img = db.serialize();
+	cout << "image size: " << img.size() << endl;
+	ASSERT_GT(img.size(), 0);
+
+	Conn c(":memory:");
+	c.deserialize(img);
+	ASSERT_EQ(count(c), 100);
+
+	Req req(c);
+	req.sql() << "insert into t values(100, 'more');";		// the copy can be written
+	req.exec();
+	ASSERT_EQ(count(c), 101);
+	ASSERT_EQ(count(db), 100);
+
+	vector<char> junk(1000, 'x');
+	c.deserialize(junk);
+	ASSERT_THROW(count(c), runtime_error);					// not a database
+}
+
+TEST_F(ImageTest, mapped)
+{
+	db.backup_to("file:image.db?mode=rwc");
+
+	MappedImage img("image.db");
+	Conn c(":memory:");
+	c.deserialize(img.data(), true);
+	ASSERT_EQ(count(c), 100);
+
+	Req req(c);
+	req.sql() << "insert into t values(100, 'more');";
+	ASSERT_THROW(req.exec(), runtime_error);				// read-only
+
+	auto same = c.serialize();
+	ASSERT_EQ(same.size(), img.size());
+
+	ASSERT_THROW(MappedImage("nosuch.db"), system_error);
+}
+
+TEST_F(ImageTest, wal)
+{
+	vector<char> copy;
+	{
+		Conn w("file:wal.db?mode=rwc", Conn::Options::throughput());
+		Req req(w);
+		req.sql() << "PRAGMA journal_mode;";
+		req.exec_select();
+		ASSERT_EQ(req.col_text(0), "wal");
+		req.clear();
+		w.restore_from(db);
+		copy = w.serialize();
+	}												// the last close checkpoints the WAL
+
+	MappedImage img("wal.db");
+	Conn c(":memory:");
+	c.deserialize(img.data(), true);
+	ASSERT_EQ(count(c), 100);
+
+	Conn d(":memory:");
+	d.deserialize(copy);
+	ASSERT_EQ(count(d), 100);
+	ASSERT_THROW(d.deserialize(std::as_bytes(std::span(copy)), true), runtime_error);	// cannot be changed in place
+
+	Conn check("file:wal.db");						// the file is not changed
+	Req req(check);
+	req.sql() << "PRAGMA journal_mode;";
+	req.exec_select();
+	ASSERT_EQ(req.col_text(0), "wal");
+}
@@ -0,0 +1,264 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite/maint.h>
+#include <sqlite/pool.h>
+#include <gtest/gtest.h>
+#include <util/fs.h>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <system_error>
+#include <stdexcept>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite background maintenance \file */
+/** \example unittest/maint.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::system_error;
+using std::runtime_error;
+using fs = scc::util::Filesystem;
+using scc::sqld::Conn;
+using scc::sqld::ConnPool;
+using scc::sqld::Req;
+using scc::sqld::Trans;
+using scc::sqld::Maintenance;
+using scc::sqld::MaintenanceOptions;
+using scc::sqld::MaintenanceStats;
+
+static const char* uri = "file:maint.db?mode=rwc";
+
+struct MaintTest : public testing::Test
+{
+	string curdir;
+	MaintenanceOptions opts;
+
+	MaintTest()
+	{
+		curdir = fs::get_current_dir();
+
+		system_error err;
+		fs::remove_all("sandbox", &err);
+		fs::create_dir("sandbox");
+		fs::change_dir("sandbox");
+
+		opts.interval = std::chrono::milliseconds(5);
+		opts.wal_pages = 1000000000;				// tests enable what they need
+		opts.idle = std::chrono::milliseconds(0);
+		opts.optimize_interval = std::chrono::milliseconds(0);
+		opts.vacuum_interval = std::chrono::milliseconds(0);
+	}
+	virtual ~MaintTest()
+	{
+		fs::change_dir(curdir);
+		system_error err;
+		fs::remove_all("sandbox", &err);
+	}
+
+	static void exec(Conn& c, const string& sql)
+	{
+		Req req(c);
+		req.sql() << sql;
+		req.exec();
+	}
+
+	static int64_t value(Conn& c, const string& sql)
+	{
+		Req req(c);
+		req.sql() << sql;
+		req.exec_select();
+		return req.col_int64(0);
+	}
+
+	static void write(Conn& c, int n)						// each row takes a page
+	{
+		for (int i = 0; i < n; i++)
+		{
+			Trans t(c);
+			t.begin();
+			exec(c, "insert into t(data) values(randomblob(3000));");
+			t.commit();
+		}
+	}
+
+	static bool wait_for(Maintenance& m, std::function<bool(const MaintenanceStats&)> pred)
+	{
+		for (int i = 0; i < 1000; i++)
+		{
+			if (pred(m.stats()))
+			{
+				return true;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+		return false;
+	}
+};
+
+TEST_F(MaintTest, no_auto_checkpoint)
+{
+	Conn db(uri, Conn::Options::throughput());
+	exec(db, "create table t(id INTEGER PRIMARY KEY, data BLOB);");
+	{
+		Maintenance m(db, opts);
+		write(db, 1200);
+		auto st = m.stats();
+		cout << "wal pages " << st.wal_pages << endl;
+		ASSERT_GE(st.wal_pages, 1200);					// would have been checkpointed and restarted at 1000
+		ASSERT_EQ(st.wal_pages, st.max_wal_pages);
+		ASSERT_EQ(st.checkpoints, 0);
+	}
+	write(db, 1);
+	int64_t log = value(db, "PRAGMA wal_checkpoint(PASSIVE);");
+	ASSERT_EQ(log, 0);									// not busy
+	ASSERT_EQ(value(db, "PRAGMA wal_autocheckpoint;"), 1000);
+
+	exec(db, "PRAGMA wal_autocheckpoint=50;");
+	{
+		Maintenance m(db, opts);
+		ASSERT_EQ(value(db, "PRAGMA wal_autocheckpoint;"), 0);
+	}
+	ASSERT_EQ(value(db, "PRAGMA wal_autocheckpoint;"), 50);	// the previous setting
+}
+
+TEST_F(MaintTest, checkpoint)
+{
+	Conn db(uri, Conn::Options::throughput());
+	exec(db, "create table t(id INTEGER PRIMARY KEY, data BLOB);");
+
+	opts.wal_pages = 50;
+	Maintenance m(db, opts);
+	write(db, 60);
+	ASSERT_TRUE(wait_for(m, [](const MaintenanceStats& s) { return s.checkpoints > 0; }));
+	auto st = m.stats();
+	cout << "checkpoint " << st.last_checkpoint.count() << " ns, " << st.backfilled_pages << " pages" << endl;
+	ASSERT_EQ(st.escalations, 0);
+	ASSERT_GE(st.backfilled_pages, 50);
+	ASSERT_GT(st.total_checkpoint.count(), 0);
+	ASSERT_EQ(st.errors, 0);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));		// let the checkpoints catch up
+	st = m.stats();
+	write(db, 2);										// below the threshold
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_EQ(m.stats().checkpoints, st.checkpoints);
+	ASSERT_EQ(value(db, "select count(*) from t;"), 62);
+}
+
+TEST_F(MaintTest, idle_escalate)
+{
+	Conn db(uri, Conn::Options::throughput());
+	exec(db, "create table t(id INTEGER PRIMARY KEY, data BLOB);");
+
+	opts.idle = std::chrono::milliseconds(20);
+	opts.restart_pages = 5;
+	opts.truncate_pages = 20;
+	Maintenance m(db, opts);
+
+	write(db, 10);										// restart after idle
+	ASSERT_TRUE(wait_for(m, [](const MaintenanceStats& s) { return s.checkpoints > 0; }));
+	ASSERT_EQ(m.stats().escalations, 1);
+
+	Conn reader(uri, Conn::Options::throughput());
+	Trans t(reader);
+	t.begin();
+	ASSERT_EQ(value(reader, "select count(*) from t;"), 10);
+
+	write(db, 30);										// truncate cannot complete while the reader is open
+	ASSERT_TRUE(wait_for(m, [](const MaintenanceStats& s) { return s.incomplete > 0; }));
+	t.commit();
+	ASSERT_TRUE(wait_for(m, [](const MaintenanceStats& s) { return s.escalations > 2 && s.backfilled_pages == 0; }));
+
+	auto st = m.stats();
+	cout << "checkpoints " << st.checkpoints << " escalations " << st.escalations << " incomplete " << st.incomplete << endl;
+	Req req(db);
+	req.sql() << "PRAGMA wal_checkpoint(PASSIVE);";
+	req.exec_select();
+	ASSERT_EQ(req.col_int(1), 0);						// the WAL was truncated
+}
+
+TEST_F(MaintTest, optimize_vacuum)
+{
+	Conn db(uri);										// auto_vacuum is set before the database is written
+	exec(db, "PRAGMA auto_vacuum=INCREMENTAL; PRAGMA journal_mode=WAL;");
+	exec(db, "create table t(id INTEGER PRIMARY KEY, data BLOB); create index t_data on t(data);");
+	ASSERT_EQ(value(db, "PRAGMA auto_vacuum;"), 2);
+	write(db, 100);
+	exec(db, "delete from t where id > 10;");
+	ASSERT_GT(value(db, "PRAGMA freelist_count;"), 0);
+
+	opts.optimize_interval = std::chrono::milliseconds(10);
+	opts.vacuum_interval = std::chrono::milliseconds(10);
+	opts.vacuum_pages = 0;
+	Maintenance m(db, opts);
+	ASSERT_TRUE(wait_for(m, [](const MaintenanceStats& s) { return s.optimizes > 0 && s.vacuums > 0; }));
+
+	auto st = m.stats();
+	ASSERT_GT(st.vacuumed_pages, 0);
+	ASSERT_EQ(value(db, "PRAGMA freelist_count;"), 0);
+	ASSERT_EQ(value(db, "select count(*) from sqlite_stat1 where tbl = 't';"), 1);
+}
+
+TEST_F(MaintTest, pool)
+{
+	ConnPool pool("pool.db", 2);
+	{
+		auto w = pool.writer();
+		exec(*w, "create table t(id INTEGER PRIMARY KEY, data BLOB);");
+	}
+
+	opts.wal_pages = 20;
+	Maintenance m(pool, opts);
+	{
+		auto w = pool.writer();
+		write(*w, 30);
+	}
+	ASSERT_TRUE(wait_for(m, [](const MaintenanceStats& s) { return s.checkpoints > 0; }));
+	auto r = pool.reader();
+	ASSERT_EQ(value(*r, "select count(*) from t;"), 30);
+}
+
+TEST_F(MaintTest, errors)
+{
+	Conn mem(":memory:");
+	ASSERT_THROW(Maintenance m(mem), runtime_error);	// not a file
+
+	Conn db("file:delete.db?mode=rwc");
+	exec(db, "create table t(id INTEGER PRIMARY KEY);");
+	ASSERT_THROW(Maintenance m(db), runtime_error);		// not WAL
+}
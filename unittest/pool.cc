@@ -0,0 +1,179 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/pool.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <system_error>
+#include <util/fs.h>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite connection pool \file */
+/** \example unittest/pool.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::thread;
+using std::system_error;
+using std::runtime_error;
+using fs = scc::util::Filesystem;
+using scc::sqld::ConnPool;
+using scc::sqld::Req;
+using scc::sqld::Trans;
+
+struct PoolTest : public testing::Test
+{
+	string curdir;
+
+	PoolTest()
+	{
+		curdir = fs::get_current_dir();
+
+		system_error err;
+		fs::remove_all("sandbox", &err);
+		fs::create_dir("sandbox");
+		fs::change_dir("sandbox");
+	}
+	virtual ~PoolTest()
+	{
+		fs::change_dir(curdir);
+		system_error err;
+		fs::remove_all("sandbox", &err);
+	}
+};
+
+TEST_F(PoolTest, open)
+{
+	ConnPool pool("db?file", 2);				// uri characters are escaped
+	ASSERT_EQ(pool.readers(), 2);
+
+	auto fs = fs::scan_dir(".");
+	for (auto& d : fs)
+	{
+		cout << d.first << " " << d.second << endl;
+	}
+	ASSERT_EQ(fs.count("db?file"), 1);
+
+	auto r = pool.reader();
+	Req req(*r);
+	req.sql() << "PRAGMA journal_mode;";
+	ASSERT_EQ(req.exec_select(), 1);
+	ASSERT_EQ(req.col_text(0), "wal");
+
+	req.clear();
+	req.sql() << "create table t(a INT);";
+	ASSERT_THROW(req.exec(), runtime_error);		// readers are read-only
+}
+
+TEST_F(PoolTest, readers)
+{
+	ConnPool pool("dbfile", 4);
+
+	{
+		auto w = pool.writer();
+		Req req(*w);
+		Trans x(*w);
+		x.begin();
+		req.sql() << "create table t(a INT);";
+		req.exec();
+		req.clear();
+		req.sql() << "insert into t values(?);";
+		for (int i = 1; i <= 1000; i++)
+		{
+			req.reset();
+			req.bind_int(1, i);
+			req.exec();
+		}
+		req.clear();
+		x.commit();
+	}
+
+	std::atomic<int> ok(0);
+	vector<thread> th;
+	for (int i = 0; i < 8; i++)
+	{
+		th.emplace_back([&pool, &ok]()
+		{
+			for (int j = 0; j < 10; j++)
+			{
+				auto r = pool.reader();
+				Req req(*r);
+				req.sql() << "select sum(a) from t;";
+				if (req.exec_select() == 1 && req.col_int64(0) == 500500)
+				{
+					ok++;
+				}
+			}
+		});
+	}
+	for (auto& t : th)
+	{
+		t.join();
+	}
+	ASSERT_EQ(ok, 80);
+
+	auto st = pool.reader_stats();
+	cout << "leases: " << st.leases << " waits: " << st.waits << " wait ns: " << st.wait_time.count()
+		<< " utilization: " << st.utilization << endl;
+	ASSERT_EQ(st.leases, 80);
+	ASSERT_EQ(pool.writer_stats().leases, 1);
+}
+
+TEST_F(PoolTest, wait)
+{
+	ConnPool pool("dbfile", 1);
+
+	auto r = pool.reader();
+	ASSERT_EQ(pool.reader_stats().waits, 0);
+
+	thread th([&pool]()
+	{
+		auto r2 = pool.reader();		// must wait until main thread returns its lease
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	{
+		auto moved = std::move(r);		// lease is returned once
+	}
+	th.join();
+
+	auto st = pool.reader_stats();
+	ASSERT_EQ(st.leases, 2);
+	ASSERT_EQ(st.waits, 1);
+	ASSERT_GE(st.max_wait, std::chrono::milliseconds(10));
+	ASSERT_GT(st.utilization, 0.5);
+}
@@ -0,0 +1,148 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/queue.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <future>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite group commit write queue \file */
+/** \example unittest/queue.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::runtime_error;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::WriteQueue;
+using scc::sqld::WriteQueueOptions;
+
+struct QueueTest : public testing::Test
+{
+	Conn db;
+
+	QueueTest()
+	{
+		Req req(db);
+		req.sql() << "create table t(id INTEGER PRIMARY KEY, name TEXT);";
+		req.exec();
+	}
+	virtual ~QueueTest()
+	{
+		Req req(db);
+		req.sql() << "drop table t;";
+		req.exec();
+	}
+
+	int64_t count()
+	{
+		Req req(db);
+		req.sql() << "select count(*) from t;";
+		req.exec_select();
+		return req.col_int64(0);
+	}
+};
+
+TEST_F(QueueTest, group_commit)
+{
+	WriteQueueOptions opts;
+	opts.max_batch = 50;
+	opts.max_latency = std::chrono::milliseconds(5);
+	WriteQueue q(db, opts);
+
+	vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&q, t]()
+		{
+			vector<std::future<void>> fs;
+			for (int i = 0; i < 100; i++)
+			{
+				fs.push_back(q.submit("insert into t values(?, ?);", t*100+i, "name"));
+			}
+			for (auto& f : fs)
+			{
+				f.get();
+			}
+		});
+	}
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+
+	auto st = q.stats();
+	cout << "writes: " << st.writes << " batches: " << st.batches << " max batch: " << st.max_batch << endl;
+	ASSERT_EQ(st.writes, 400);
+	ASSERT_EQ(st.failed, 0);
+	ASSERT_LT(st.batches, 400);
+	ASSERT_LE(st.max_batch, 50);
+	ASSERT_EQ(count(), 400);
+}
+
+TEST_F(QueueTest, isolation)
+{
+	WriteQueueOptions opts;
+	opts.max_latency = std::chrono::milliseconds(50);		// all in one batch
+	WriteQueue q(db, opts);
+
+	auto f1 = q.submit("insert into t values(?, ?);", 1, "one");
+	auto f2 = q.submit("insert into t values(?, ?);", 1, "dup");		// constraint violation
+	auto f3 = q.submit([](Conn& c)
+	{
+		Req req(c);
+		req.sql() << "insert into t values(3, 'three');";
+		req.exec();
+		throw runtime_error("changed my mind");							// the insert is rolled back
+	});
+	auto f4 = q.submit("insert into t values(?, ?);", 4, "four");
+
+	f1.get();
+	ASSERT_THROW(f2.get(), runtime_error);
+	ASSERT_THROW(f3.get(), runtime_error);
+	f4.get();
+
+	auto st = q.stats();
+	ASSERT_EQ(st.batches, 1);
+	ASSERT_EQ(st.failed, 2);
+
+	Req req(db);
+	req.sql() << "select group_concat(id) from t order by id;";
+	req.exec_select();
+	ASSERT_EQ(req.col_text(0), "1,4");
+}
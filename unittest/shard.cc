@@ -0,0 +1,151 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/shard.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <future>
+#include <stdexcept>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite sharded connections \file */
+/** \example unittest/shard.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::runtime_error;
+using scc::sqld::Conn;
+using scc::sqld::ShardedConn;
+
+struct ShardTest : public testing::Test
+{
+	ShardedConn db;
+
+	ShardTest() : db({"file:shard0?mode=memory&cache=shared", "file:shard1?mode=memory&cache=shared",
+		"file:shard2?mode=memory&cache=shared"})
+	{
+		db.exec_all("create table t(id INTEGER PRIMARY KEY, grp TEXT, v INTEGER);");
+		vector<std::future<void>> fs;
+		for (int64_t id = 1; id <= 300; id++)
+		{
+			fs.push_back(db.exec(id, "insert into t values(?, ?, ?);", id, "g" + std::to_string(id % 4), 1).future());
+		}
+		for (auto& f : fs)
+		{
+			f.get();
+		}
+	}
+	virtual ~ShardTest()
+	{
+		db.exec_all("drop table t;");
+	}
+};
+
+TEST_F(ShardTest, route)
+{
+	auto rows = db.select_all<int64_t>("select id from t;");
+	ASSERT_EQ(rows.size(), 300);
+	for (size_t i = 0; i < db.size(); i++)
+	{
+		cout << "shard " << i << " rows: " << rows.parts()[i].size() << endl;
+		ASSERT_GT(rows.parts()[i].size(), 50);
+		for (auto& [id] : rows.parts()[i])
+		{
+			ASSERT_EQ(db.shard_of(id), i);
+		}
+	}
+
+	auto one = db.shard_for(42).select<string>("select grp from t where id = ?;", 42).future().get();
+	ASSERT_EQ(one.size(), 1);
+	ASSERT_EQ(std::get<0>(one[0]), "g2");
+
+	std::set<int64_t> seen;
+	for (const auto& [id] : rows)							// concatenated
+	{
+		seen.insert(id);
+	}
+	ASSERT_EQ(seen.size(), 300);
+}
+
+TEST_F(ShardTest, merge)
+{
+	auto rows = db.select_all<int64_t, string>("select id, grp from t where id > ? order by id;", 250);
+	int64_t expect = 251;
+	for (const auto& [id, grp] : rows.order_by<0>())
+	{
+		ASSERT_EQ(id, expect++);
+	}
+	ASSERT_EQ(expect, 301);
+
+	auto desc = db.select_all<int64_t>("select id from t order by id desc limit 5;");	// top 5 of each shard
+	vector<int64_t> top;
+	for (const auto& [id] : desc.order_by<0>(true))
+	{
+		if (top.size() < 5)
+		{
+			top.push_back(id);
+		}
+	}
+	ASSERT_EQ(top, vector<int64_t>({300, 299, 298, 297, 296}));
+}
+
+TEST_F(ShardTest, aggregate)
+{
+	auto total = db.select_all<int64_t, int64_t>("select count(*), max(id) from t;")
+		.combine([](auto& acc, const auto& r)
+		{
+			std::get<0>(acc) += std::get<0>(r);
+			std::get<1>(acc) = std::max(std::get<1>(acc), std::get<1>(r));
+		});
+	ASSERT_EQ(total.size(), 1);
+	ASSERT_EQ(std::get<0>(total[0]), 300);
+	ASSERT_EQ(std::get<1>(total[0]), 300);
+
+	auto groups = db.select_all<string, int64_t>("select grp, sum(v) from t group by grp order by grp;")
+		.order_by<0>()
+		.combine([](auto& acc, const auto& r) { std::get<1>(acc) += std::get<1>(r); });
+	ASSERT_EQ(groups.size(), 4);
+	for (auto& [grp, sum] : groups)
+	{
+		ASSERT_EQ(sum, 75);
+	}
+	ASSERT_EQ(std::get<0>(groups[0]), "g0");
+	ASSERT_EQ(std::get<0>(groups[3]), "g3");
+
+	ASSERT_THROW(db.select_all<int>("select * from nosuch;"), runtime_error);
+	ASSERT_THROW(ShardedConn(vector<string>()), runtime_error);
+}
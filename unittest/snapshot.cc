@@ -0,0 +1,183 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite/snapshot.h>
+#include <gtest/gtest.h>
+#include <util/fs.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <stdexcept>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite snapshots \file */
+/** \example unittest/snapshot.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::system_error;
+using std::runtime_error;
+using fs = scc::util::Filesystem;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::Trans;
+using scc::sqld::Snapshot;
+
+static const char* uri = "file:snap.db?mode=rwc";
+
+struct SnapshotTest : public testing::Test
+{
+	string curdir;
+	std::unique_ptr<Conn> db;
+
+	SnapshotTest()
+	{
+		curdir = fs::get_current_dir();
+
+		system_error err;
+		fs::remove_all("sandbox", &err);
+		fs::create_dir("sandbox");
+		fs::change_dir("sandbox");
+
+		db = std::make_unique<Conn>(uri, Conn::Options::throughput());
+		Req req(*db);
+		req.sql() << "create table t(id INTEGER PRIMARY KEY);";
+		req.exec();
+		insert(*db, 100);
+	}
+	virtual ~SnapshotTest()
+	{
+		db.reset();
+		fs::change_dir(curdir);
+		system_error err;
+		fs::remove_all("sandbox", &err);
+	}
+
+	static void insert(Conn& c, int n)
+	{
+		Trans t(c);
+		t.begin();
+		for (int i = 0; i < n; i++)
+		{
+			Req req(c);
+			req.sql() << "insert into t(id) values(null);";
+			req.exec();
+		}
+		t.commit();
+	}
+
+	static int count(Conn& c)
+	{
+		Req req(c);
+		req.sql() << "select count(*) from t;";
+		req.exec_select();
+		return req.col_int(0);
+	}
+};
+
+TEST_F(SnapshotTest, readers)
+{
+	Conn holder(uri, Conn::Options::throughput());
+	Trans keep(holder);								// keeps the snapshot available from checkpoints
+	keep.begin();
+	ASSERT_EQ(count(holder), 100);
+	Snapshot snap(holder);
+
+	insert(*db, 50);								// the writer continues
+	ASSERT_EQ(count(*db), 150);
+
+	vector<int> seen(4, 0);
+	vector<std::thread> readers;
+	for (size_t i = 0; i < seen.size(); i++)
+	{
+		readers.emplace_back([&snap, &seen, i]()
+		{
+			Conn reader(uri, Conn::Options::throughput());
+			Trans t(reader);
+			snap.open(t);
+			seen[i] = count(reader);
+			t.commit();
+		});
+	}
+	for (auto& t : readers)
+	{
+		t.join();
+	}
+	for (auto n : seen)
+	{
+		ASSERT_EQ(n, 100);
+	}
+	keep.commit();
+
+	Snapshot later(*db);							// captured outside of a transaction
+	ASSERT_LT(snap.compare(later), 0);
+	ASSERT_GT(later.compare(snap), 0);
+	ASSERT_EQ(later.compare(later), 0);
+
+	Conn reader(uri, Conn::Options::throughput());
+	Trans t(reader);
+	later.open(t);
+	ASSERT_EQ(count(reader), 150);
+	ASSERT_THROW(later.open(t), runtime_error);		// already active
+	t.commit();
+}
+
+TEST_F(SnapshotTest, errors)
+{
+	Conn mem(":memory:");
+	ASSERT_THROW(Snapshot snap(mem), runtime_error);	// not WAL
+
+	Snapshot snap(*db);
+	Conn other("file:other.db?mode=rwc", Conn::Options::throughput());
+	Req req(other);
+	req.sql() << "create table t(id INTEGER PRIMARY KEY);";
+	req.exec();
+	Trans t(other);
+	ASSERT_THROW(snap.open(t), runtime_error);		// different database
+	ASSERT_FALSE(t.is_active());
+
+	Conn reader(uri, Conn::Options::throughput());
+	for (auto mode : {Trans::Mode::immediate, Trans::Mode::exclusive})
+	{
+		Trans w(reader, mode);
+		ASSERT_THROW(snap.open(w), runtime_error);		// write transactions cannot read a snapshot
+		ASSERT_FALSE(w.is_active());
+	}
+	Trans r(reader);
+	snap.open(r);
+	r.commit();
+}
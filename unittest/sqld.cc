@@ -29,6 +29,8 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include <sqlite/sqld.h>
+#include <sqlite/batch.h>
+#include <sqlite3.h>
 #include <gtest/gtest.h>
 #include <string>
 #include <iostream>
@@ -51,6 +53,9 @@ using fs = scc::util::Filesystem;
 using scc::sqld::Conn;
 using scc::sqld::Req;
 using scc::sqld::Trans;
+using scc::sqld::Savepoint;
+using scc::sqld::Result;
+using scc::sqld::Error;
 
 struct SqliteTest : public testing::Test
 {
@@ -249,3 +254,954 @@ TEST_F(SqliteTest, two_conns_xact)
 	r2.sql()	<< "insert into t values(45678);";
 	ASSERT_THROW(r2.exec(), runtime_error);				// illegal for read-only db connection
 }
+
+TEST_F(SqliteTest, stmt_cache)
+{
+	db.stmt_cache_clear();
+
+	Req req(db);
+	req.sql() << "create table t(a INT) STRICT;";
+	req.exec();
+
+	for (int i = 0; i < 3; i++)
+	{
+		Req r(db);
+		r.sql() << "insert into t values(1);";
+		r.exec();
+	}
+
+	auto st = db.stmt_cache_stats();
+	cout << "hits: " << st.hits << " misses: " << st.misses << " size: " << st.size << endl;
+	ASSERT_EQ(st.hits, 2);				// the insert was compiled once
+	ASSERT_EQ(st.size, 1);				// insert statement, the create statement is kept by the request
+
+	req.clear();
+	req.sql() << "select count(*) from t;";
+	ASSERT_EQ(req.exec_select(), 1);
+	ASSERT_EQ(req.col_int(0), 3);
+	ASSERT_EQ(db.stmt_cache_stats().size, 2);	// checked out by the request
+
+	req.clear();
+	ASSERT_EQ(db.stmt_cache_stats().size, 3);	// returned by the request
+
+	Trans x(db);
+	x.begin();
+	x.commit();
+	x.begin();
+	x.commit();
+	st = db.stmt_cache_stats();
+	ASSERT_EQ(st.hits, 4);						// second begin and commit were reused
+}
+
+TEST_F(SqliteTest, stmt_cache_evict)
+{
+	db.stmt_cache_size(2);
+
+	Req req(db);
+	req.sql() << "select 1;";
+	req.exec();
+	req.clear();
+	req.sql() << "select 2;";
+	req.exec();
+	req.clear();
+	req.sql() << "select 3;";
+	req.exec();
+	req.clear();
+
+	auto st = db.stmt_cache_stats();
+	ASSERT_EQ(st.size, 2);
+	ASSERT_EQ(st.max_size, 2);
+	ASSERT_EQ(st.evictions, 1);
+
+	req.sql() << "select 1;";			// was evicted
+	req.exec();
+	req.clear();
+	ASSERT_EQ(db.stmt_cache_stats().hits, 0);
+
+	req.sql() << "  select 3;\n";		// whitespace is ignored
+	req.exec();
+	req.clear();
+	ASSERT_EQ(db.stmt_cache_stats().hits, 1);
+
+	db.stmt_cache_size(0);
+	st = db.stmt_cache_stats();
+	ASSERT_EQ(st.size, 0);
+	ASSERT_EQ(st.evictions, 4);
+}
+
+TEST_F(SqliteTest, bind)
+{
+	Req req(db);
+	req.sql() << "create table t(a INT, b TEXT, c REAL, d BLOB);";
+	req.exec();
+
+	req.clear();
+	req.sql() << "insert into t values(?, :b, ?, ?);";
+	req.bind_int(1, 1);
+	req.bind_text(":b", "one");
+	req.bind_real(3, 1.5);
+	req.bind_blob(4, vector<char>{'\x01', '\x02'});
+	req.exec();
+
+	for (int64_t i = 2; i <= 10; i++)
+	{
+		req.reset();					// reuse the statement with new bindings
+		req.bind(i << 40, std::to_string(i), nullptr, nullptr);
+		req.exec();
+	}
+	ASSERT_EQ(db.stmt_cache_stats().hits, 0);	// never recompiled
+
+	ASSERT_THROW(req.bind_int(1, 1), runtime_error);		// must reset() first
+	req.reset();
+	ASSERT_THROW(req.bind_int(":x", 1), runtime_error);	// no such parameter
+	ASSERT_THROW(req.bind_int(5, 1), runtime_error);		// out of range
+
+	req.clear();
+	req.sql() << "select a, b, c, d from t where a >= ?;";
+	req.bind_int64(1, int64_t(5) << 40);
+	int rows = 0;
+	for (int r = req.exec_select(); r; r = req.next_row())
+	{
+		rows++;
+		ASSERT_EQ(req.col_int64(0) >> 40, std::stoi(req.col_text(1)));
+	}
+	ASSERT_EQ(rows, 6);
+
+	req.reset();
+	req.bind_int(1, 1);
+	ASSERT_EQ(req.exec_select(), 4);
+	ASSERT_EQ(req.col_text(1), "one");
+	ASSERT_EQ(req.col_real(2), 1.5);
+	vector<char> v;
+	req.col_blob(3, v);
+	ASSERT_EQ(v, vector<char>({'\x01', '\x02'}));
+}
+
+TEST_F(SqliteTest, reset_multi)
+{
+	Req req(db);
+	req.sql()
+		<< "create table t(a INT);"
+		<< "insert into t values(1);"
+		<< "select count(*) from t;";
+
+	ASSERT_EQ(req.exec_select(), 1);
+	ASSERT_EQ(req.col_int(0), 1);
+	ASSERT_EQ(req.next_row(), 0);
+
+	req.reset();
+	ASSERT_THROW(req.exec_select(), runtime_error);		// table already exists
+
+	req.clear();
+	req.sql()
+		<< "insert into t values(?);"
+		<< "select count(*) from t;";
+	req.bind_int(1, 2);
+	ASSERT_EQ(req.exec_select(), 1);
+	ASSERT_EQ(req.col_int(0), 2);
+	req.reset();										// first statement is reused
+	ASSERT_EQ(req.exec_select(), 1);
+	ASSERT_EQ(req.col_int(0), 3);
+}
+
+TEST_F(SqliteTest, col_view)
+{
+	Req req(db);
+
+	req.sql()
+		<< "create table t(a TEXT, b BLOB);"
+		<< "insert into t values('hello', x'deadbeef');"
+		<< "insert into t values(NULL, NULL);"
+		<< "select * from t;";
+
+	ASSERT_EQ(req.exec_select(), 2);
+	ASSERT_EQ(req.col_text_view(0), "hello");
+	ASSERT_EQ(req.col_bytes(0), 5);
+
+	auto b = req.col_blob_view(1);
+	ASSERT_EQ(b.size(), 4);
+	ASSERT_EQ(req.col_bytes(1), 4);
+	ASSERT_EQ(b[0], std::byte{0xde});
+	ASSERT_EQ(b[3], std::byte{0xef});
+
+	ASSERT_EQ(req.next_row(), 2);
+	ASSERT_TRUE(req.col_text_view(0).empty());
+	ASSERT_EQ(req.col_text(0), "");
+	ASSERT_TRUE(req.col_blob_view(1).empty());
+	ASSERT_EQ(req.col_bytes(1), 0);
+
+	ASSERT_EQ(req.next_row(), 0);
+	ASSERT_THROW(req.col_text_view(0), runtime_error);
+}
+
+TEST_F(SqliteTest, compile)
+{
+	Req req(db);
+	req.sql()
+		<< "create table if not exists t(a INT);"
+		<< "insert into t values(1);"		// compiled after the table is created
+		<< "-- comments are ignored\n"
+		<< "insert into t values(2);"
+		<< "select count(*), sum(a) from t;";
+	req.compile();
+
+	req.sql().str("");						// the stream is no longer used
+
+	ASSERT_EQ(req.exec_select(), 2);
+	ASSERT_EQ(req.col_int(0), 2);
+	ASSERT_EQ(req.col_int(1), 3);
+	ASSERT_EQ(req.next_row(), 0);
+	ASSERT_EQ(req.exec_select(), 0);
+
+	for (int i = 2; i <= 10; i++)
+	{
+		req.reset();
+		req.exec();
+	}
+
+	req.reset();
+	ASSERT_EQ(req.exec_select(), 2);
+	ASSERT_EQ(req.col_int(0), 22);
+
+	req.clear();							// back to the stream
+	req.sql() << "select count(*) from t;";
+	ASSERT_EQ(req.exec_select(), 1);
+	ASSERT_EQ(req.col_int(0), 22);
+
+	req.clear();
+	req.sql() << "select 1; select from;";
+	req.compile();
+	ASSERT_EQ(req.exec_select(), 1);
+	ASSERT_EQ(req.next_row(), 0);
+	ASSERT_THROW(req.exec_select(), runtime_error);		// syntax error is found when reached
+}
+
+struct Rec
+{
+	int64_t id;
+	string name;
+};
+
+template <>
+struct scc::sqld::RowAdapter<Rec>
+{
+	using columns = std::tuple<int64_t, string>;
+	static Rec make(int64_t id, string name) { return Rec{id, std::move(name)}; }
+};
+
+TEST_F(SqliteTest, rows)
+{
+	Req req(db);
+	req.sql()
+		<< "create table t(id INT, name TEXT, score REAL, b BLOB);"
+		<< "insert into t values(1, 'one', 1.5, x'01');"
+		<< "insert into t values(2, 'two', 2.5, NULL);"
+		<< "insert into t values(3, NULL, 3.5, x'0303');";
+	req.exec();
+
+	req.clear();
+	req.sql() << "select id, name, score from t order by id;";
+	int64_t ids = 0;
+	double scores = 0;
+	string names;
+	for (auto [id, name, score] : req.rows<int64_t, std::string_view, double>())
+	{
+		ids += id;
+		names += name;
+		scores += score;
+	}
+	ASSERT_EQ(ids, 6);
+	ASSERT_EQ(names, "onetwo");
+	ASSERT_EQ(scores, 7.5);
+
+	vector<std::optional<string>> nv;
+	vector<std::optional<vector<char>>> bv;
+	req.clear();
+	req.sql() << "select name, b from t order by id;";
+	for (auto [name, b] : req.rows<std::optional<string>, std::optional<vector<char>>>())
+	{
+		nv.push_back(name);
+		bv.push_back(b);
+	}
+	ASSERT_EQ(nv.size(), 3);
+	ASSERT_EQ(*nv[0], "one");
+	ASSERT_FALSE(nv[2]);
+	ASSERT_FALSE(bv[1]);
+	ASSERT_EQ(bv[2]->size(), 2);
+
+	req.clear();
+	req.sql() << "select id, name from t where name is not null order by id;";
+	vector<Rec> recs;
+	for (const auto& r : req.rows<Rec>())
+	{
+		recs.push_back(r);
+	}
+	ASSERT_EQ(recs.size(), 2);
+	ASSERT_EQ(recs[1].id, 2);
+	ASSERT_EQ(recs[1].name, "two");
+
+	req.clear();
+	req.sql() << "select id, name from t;";
+	ASSERT_THROW(req.rows<int>().begin(), runtime_error);		// wrong number of columns
+
+	req.clear();
+	req.sql() << "select id from t where id > 10;";
+	for (auto [id] : req.rows<int>())
+	{
+		FAIL() << "unexpected row " << id;
+	}
+}
+
+TEST_F(SqliteTest, profile)
+{
+	db.enable_profiling();
+
+	Req req(db);
+	req.sql() << "create table t(a INT, b TEXT) STRICT;";
+	req.exec();
+
+	for (int i = 0; i < 10; i++)
+	{
+		Req r(db);
+		r.sql() << "insert into t values(" << i << ", 'x');";		// literals are normalized
+		r.exec();
+	}
+
+	req.clear();
+	req.sql() << "select a from t where b = 'x';";
+	for (int c = req.exec_select(); c; c = req.next_row())
+	{
+	}
+	req.reset();
+	for (int c = req.exec_select(); c; c = req.next_row())
+	{
+	}
+
+	auto st = db.stats();
+	for (auto& s : st)
+	{
+		cout << s.sql << ": calls " << s.calls << " total " << s.total.count() << " p50 " << s.p50.count()
+			<< " p99 " << s.p99.count() << " rows " << s.rows << " steps " << s.vm_steps << endl;
+	}
+	ASSERT_EQ(st.size(), 3);
+	for (size_t i = 1; i < st.size(); i++)
+	{
+		ASSERT_GE(st[i-1].total, st[i].total);
+	}
+
+	auto find = [&](const string& prefix) -> scc::sqld::StmtProfile*
+	{
+		for (auto& s : st)
+		{
+			if (s.sql.compare(0, prefix.size(), prefix) == 0)	return &s;
+		}
+		return nullptr;
+	};
+	auto ins = find("INSERT");
+	ASSERT_TRUE(ins);
+	ASSERT_EQ(ins->calls, 10);
+	ASSERT_EQ(ins->rows, 0);
+	ASSERT_LE(ins->p50, ins->p99);
+
+	auto sel = find("SELECT");
+	ASSERT_TRUE(sel);
+	ASSERT_EQ(sel->calls, 2);
+	ASSERT_EQ(sel->rows, 20);
+	ASSERT_GT(sel->fullscan_steps, 0);
+
+	db.enable_profiling(false);
+	req.reset();
+	for (int c = req.exec_select(); c; c = req.next_row())
+	{
+	}
+	ASSERT_EQ(db.stats().size(), 3);		// kept, but not updated
+	ASSERT_EQ(find("SELECT")->calls, 2);
+
+	db.reset_stats();
+	ASSERT_EQ(db.stats().size(), 0);
+}
+
+TEST_F(SqliteTest, result_cache_replace)
+{
+	db.reopen(":memory:");
+	Req req(db);
+	req.sql() << "create table cfg(k TEXT PRIMARY KEY, v INTEGER); insert into cfg values('a', 1);";
+	req.exec();
+	auto image = db.serialize();
+
+	Conn other(":memory:");
+	Req oreq(other);
+	oreq.sql() << "create table cfg(k TEXT PRIMARY KEY, v INTEGER); insert into cfg values('a', 1), ('b', 2);";
+	oreq.exec();
+
+	db.result_cache_size(1 << 20);
+	const char* sql = "select count(*) from cfg;";
+	ASSERT_EQ(db.select_cached(sql)->col(0).ints[0], 1);
+
+	db.restore_from(other);									// no update hooks, the cache is cleared
+	ASSERT_EQ(db.result_cache_stats().entries, 0);
+	ASSERT_EQ(db.select_cached(sql)->col(0).ints[0], 2);
+
+	db.deserialize(image);
+	ASSERT_EQ(db.result_cache_stats().entries, 0);
+	ASSERT_EQ(db.select_cached(sql)->col(0).ints[0], 1);
+
+	other.backup_to(db);									// the destination cache is cleared
+	ASSERT_EQ(db.result_cache_stats().entries, 0);
+	ASSERT_EQ(db.select_cached(sql)->col(0).ints[0], 2);
+	db.result_cache_size(0);
+}
+
+TEST_F(SqliteTest, memory)
+{
+	Req req(db);
+	req.sql() << "create table t(a INTEGER PRIMARY KEY, b TEXT);";
+	req.exec();
+	for (int i = 0; i < 1000; i++)
+	{
+		req.clear();
+		req.sql() << "insert into t values(?, ?);";
+		req.bind(i, string(100, 'x'));
+		req.exec();
+	}
+	db.result_cache_size(1<<20);
+	db.select_cached("select * from t;");
+	req.clear();
+
+	auto m = db.memory_usage();
+	cout << "cache " << m.cache << " schema " << m.schema << " statements " << m.statements << " results " << m.results
+		<< " lookaside " << m.lookaside << " max " << m.lookaside_max << " hits " << m.cache_hits << endl;
+	ASSERT_GT(m.cache, 0);
+	ASSERT_GT(m.schema, 0);
+	ASSERT_GT(m.statements, 0);							// the statement cache
+	ASSERT_GT(m.results, 0);
+	ASSERT_GT(m.cache_hits, 0);
+
+	auto released = db.release_memory();
+	auto after = db.memory_usage();
+	ASSERT_GT(released, 0);
+	ASSERT_LT(after.statements, m.statements);
+	ASSERT_EQ(after.results, 0);
+	ASSERT_EQ(db.stmt_cache_stats().size, 0);
+
+	req.sql() << "select count(*) from t;";				// the connection still works
+	req.exec_select();
+	ASSERT_EQ(req.col_int(0), 1000);
+	db.result_cache_size(0);
+}
+
+TEST_F(SqliteTest, slow_query_log)
+{
+	vector<scc::sqld::SlowQuery> sunk;
+	scc::sqld::SlowQueryOptions opts;
+	opts.threshold = std::chrono::hours(1);		// only scans are recorded
+	opts.capacity = 3;
+	opts.sink = [&sunk](const scc::sqld::SlowQuery& q) { sunk.push_back(q); };
+	db.enable_slow_query_log(opts);
+
+	Req req(db);
+	req.sql() << "create table t(a INTEGER PRIMARY KEY, b TEXT);";
+	req.exec();
+	for (int i = 0; i < 10; i++)
+	{
+		req.clear();
+		req.sql() << "insert into t values(?, ?);";
+		req.bind(i, "x" + std::to_string(i));
+		req.exec();
+	}
+
+	req.clear();
+	req.sql() << "select a from t where a = ?;";		// primary key lookup
+	req.bind(3);
+	req.exec_select();
+	ASSERT_EQ(req.col_int(0), 3);
+	req.reset();
+	ASSERT_EQ(db.slow_queries().size(), 0);
+
+	req.clear();
+	req.sql() << "select a from t where b = ?;";		// full scan
+	req.bind("x4");
+	for (int c = req.exec_select(); c; c = req.next_row())
+	{
+		ASSERT_EQ(req.col_int(0), 4);
+	}
+
+	auto log = db.slow_queries();
+	ASSERT_EQ(log.size(), 1);
+	for (auto& l : log[0].plan)
+	{
+		cout << "plan: " << l << endl;
+	}
+	ASSERT_EQ(log[0].sql, "select a from t where b = ?;");
+	ASSERT_EQ(log[0].expanded, "select a from t where b = 'x4';");
+	ASSERT_EQ(log[0].rows, 1);
+	ASSERT_GT(log[0].fullscan_steps, 0);
+	ASSERT_EQ(log[0].plan.size(), 1);
+	ASSERT_EQ(log[0].plan[0].find("SCAN t"), 0);
+	ASSERT_EQ(sunk.size(), 1);
+	ASSERT_EQ(sunk[0].expanded, log[0].expanded);
+
+	opts.threshold = std::chrono::nanoseconds(0);	// everything is recorded
+	opts.sink = [](const scc::sqld::SlowQuery&) { throw runtime_error("sink failed"); };		// ignored
+	db.enable_slow_query_log(opts);
+	db.enable_profiling();
+	for (int i = 0; i < 5; i++)
+	{
+		req.clear();
+		req.sql() << "select count(*) from t where a > ?;";
+		req.bind(i);
+		req.exec_select();
+		ASSERT_EQ(req.col_int(0), 9-i);
+		req.reset();
+	}
+	log = db.slow_queries();
+	ASSERT_EQ(log.size(), 3);						// the oldest are dropped
+	ASSERT_EQ(log[2].expanded, "select count(*) from t where a > 4;");
+	ASSERT_EQ(log[2].plan[0].find("SEARCH t"), 0);
+	ASSERT_EQ(sunk.size(), 1);
+
+	db.disable_slow_query_log();
+	req.reset();
+	req.exec_select();
+	req.reset();
+	ASSERT_EQ(db.slow_queries().size(), 3);			// kept, but not updated
+	bool found = false;
+	for (auto& s : db.stats())						// profiling continues
+	{
+		if (s.sql.find("count") != string::npos)
+		{
+			ASSERT_EQ(s.calls, 6);
+			found = true;
+		}
+	}
+	ASSERT_TRUE(found);
+
+	db.clear_slow_queries();
+	ASSERT_EQ(db.slow_queries().size(), 0);
+	db.enable_profiling(false);
+}
+
+TEST_F(SqliteTest, options)
+{
+	auto pragma = [this](const string& name) -> string
+	{
+		Req req(db);
+		req.sql() << "PRAGMA " << name << ";";
+		req.exec_select();
+		return req.col_text(0);
+	};
+
+	auto opts = Conn::Options::throughput();
+	opts.page_size = 8192;
+	db.reopen("file:opts.db?mode=rwc", opts);
+	ASSERT_EQ(pragma("page_size"), "8192");
+	ASSERT_EQ(pragma("journal_mode"), "wal");
+	ASSERT_EQ(pragma("synchronous"), "1");			// normal
+	ASSERT_EQ(pragma("cache_size"), "-65536");
+	ASSERT_EQ(pragma("mmap_size"), "268435456");
+	ASSERT_EQ(pragma("temp_store"), "2");			// memory
+	ASSERT_EQ(db.busy_policy().kind, scc::sqld::BusyPolicy::Kind::fixed);
+	ASSERT_EQ(db.busy_policy().timeout.count(), 5000);
+
+	Req req(db);
+	req.sql() << "create table t(a INT);";
+	req.exec();
+	req.clear();
+
+	db.reopen("file:opts.db?mode=rwc");				// same options
+	ASSERT_EQ(pragma("page_size"), "8192");
+	ASSERT_EQ(pragma("mmap_size"), "268435456");
+
+	opts.page_size = 4096;
+	ASSERT_THROW(db.reopen("file:opts.db?mode=rwc", opts), runtime_error);		// database has tables
+
+	Conn::Options bad;
+	bad.journal_mode = "wal; drop table t";
+	ASSERT_THROW(Conn("file:opts.db?mode=rwc", bad), runtime_error);
+
+	auto dur = Conn::Options::durable();
+	Conn c("file:opts.db?mode=rwc", dur);
+	Req r(c);
+	r.sql() << "PRAGMA synchronous;";
+	r.exec_select();
+	ASSERT_EQ(r.col_int(0), 2);						// full
+
+	Conn::Options nomutex;
+	nomutex.flags = SQLITE_OPEN_NOMUTEX;				// read/write/create is added
+	Conn nm("file:nomutex.db", nomutex);
+	Req nr(nm);
+	nr.sql() << "create table t(a INT); insert into t values(1);";
+	nr.exec();
+
+	Conn::Options ro;
+	ro.flags = SQLITE_OPEN_READONLY;
+	Conn rc("file:nomutex.db", ro);
+	Req rr(rc);
+	rr.sql() << "insert into t values(2);";
+	ASSERT_THROW(rr.exec(), runtime_error);			// access mode is kept
+
+	db.reopen("file:mem?mode=memory&cache=shared", Conn::Options());
+}
+
+TEST_F(SqliteTest, backup)
+{
+	Req req(db);
+	req.sql() << "create table t(a INT, b TEXT);";
+	req.exec();
+	req.clear();
+	{
+		Trans x(db);
+		x.begin();
+		req.sql() << "insert into t values(?, ?);";
+		string pad(500, 'x');
+		for (int i = 0; i < 1000; i++)
+		{
+			req.reset();
+			req.bind(i, pad);
+			req.exec();
+		}
+		req.clear();
+		x.commit();
+	}
+
+	scc::sqld::BackupOptions opts;
+	opts.pages_per_step = 10;
+	opts.pause = std::chrono::milliseconds(0);
+	int steps = 0;
+	opts.progress = [&steps](int, int)
+	{
+		steps++;
+		return true;
+	};
+	ASSERT_TRUE(db.backup_to("file:backup.db?mode=rwc", opts));
+	cout << "backup steps: " << steps << endl;
+	ASSERT_GT(steps, 10);
+
+	{
+		Conn locker("file:backup.db");
+		Req lr(locker);
+		lr.sql() << "BEGIN EXCLUSIVE;";
+		lr.exec();
+		scc::sqld::BackupOptions busy;
+		busy.busy_timeout = std::chrono::milliseconds(20);
+		ASSERT_THROW(db.backup_to("file:backup.db", busy), runtime_error);		// destination is locked
+		lr.clear();
+		lr.sql() << "COMMIT;";
+		lr.exec();
+	}
+
+	opts.progress = [](int remaining, int total)
+	{
+		return remaining > total/2;				// cancel half way
+	};
+	Conn part(":memory:");
+	ASSERT_FALSE(db.backup_to(part, opts));
+	Req pr(part);
+	pr.sql() << "select count(*) from sqlite_schema;";
+	pr.exec_select();
+	ASSERT_EQ(pr.col_int(0), 0);				// destination is unchanged
+	pr.clear();
+
+	Conn mem(":memory:");
+	ASSERT_TRUE(mem.restore_from("file:backup.db"));
+	Req r(mem);
+	r.sql() << "select count(*), sum(a) from t;";
+	r.exec_select();
+	ASSERT_EQ(r.col_int(0), 1000);
+	ASSERT_EQ(r.col_int(1), 999*1000/2);
+	r.clear();
+
+	ASSERT_THROW(mem.restore_from("file:nosuch.db"), runtime_error);
+
+	req.sql() << "drop table t;";
+	req.exec();
+}
+
+TEST_F(SqliteTest, trans_mode)
+{
+	reopen("file:dbfile?mode=rwc");
+
+	Req r(db);
+	r.sql() << "create table t(a INT);";
+	r.exec();
+	r.clear();
+
+	Conn db2("file:dbfile?mode=rw");
+	Trans x2(db2, Trans::Mode::immediate);
+	ASSERT_EQ(x2.mode(), Trans::Mode::immediate);
+	x2.begin();											// takes the write lock
+
+	Trans x(db, Trans::Mode::immediate);
+	ASSERT_THROW(x.begin(), runtime_error);				// busy, before any work is done
+	ASSERT_FALSE(x.is_active());
+
+	Trans d(db);
+	d.begin();											// deferred takes no lock
+	r.sql() << "select count(*) from t;";
+	ASSERT_EQ(r.exec_select(), 1);
+	r.clear();
+	d.commit();
+
+	x2.commit();
+	x.begin();
+	r.sql() << "insert into t values(1);";
+	r.exec();
+	r.clear();
+	x.commit();
+}
+
+TEST_F(SqliteTest, savepoint)
+{
+	Req r(db);
+	r.sql() << "create table t(a INT);";
+	r.exec();
+
+	auto count = [this]()
+	{
+		Req r(db);
+		r.sql() << "select count(*) from t;";
+		r.exec_select();
+		return r.col_int(0);
+	};
+	auto insert = [this](int i)
+	{
+		Req r(db);
+		r.sql() << "insert into t values(?);";
+		r.bind(i);
+		r.exec();
+	};
+
+	Trans x(db);
+	x.begin();
+	insert(1);
+	{
+		Savepoint sp(db);
+		insert(2);
+		{
+			Savepoint inner(db);
+			insert(3);
+			inner.release();
+		}
+		{
+			Savepoint inner(db);
+			insert(4);
+		}												// rolled back
+		ASSERT_EQ(count(), 3);
+		sp.rollback();									// also undoes the released inner savepoint
+		ASSERT_THROW(sp.release(), runtime_error);
+	}
+	ASSERT_EQ(count(), 1);
+	ASSERT_TRUE(x.is_active());
+	x.commit();
+
+	{
+		Savepoint sp(db);								// outside of a transaction
+		insert(5);
+		sp.release();									// committed
+	}
+	ASSERT_EQ(count(), 2);
+
+	r.clear();
+	r.sql() << "drop table t;";
+	r.exec();
+}
+
+TEST_F(SqliteTest, busy)
+{
+	using namespace std::chrono;
+	using scc::sqld::BusyPolicy;
+
+	reopen("file:dbfile?mode=rwc");
+
+	Conn db2("file:dbfile?mode=rw");
+	Trans x2(db2, Trans::Mode::immediate);
+	x2.begin();											// holds the write lock
+
+	Trans x(db, Trans::Mode::immediate);
+	ASSERT_THROW(x.begin(), runtime_error);				// default fails at once
+	auto st = db.busy_stats();
+	ASSERT_EQ(st.events, 1);
+	ASSERT_EQ(st.retries, 0);
+	ASSERT_EQ(st.failures, 1);
+
+	db.reset_busy_stats();
+	db.busy_policy(BusyPolicy::backoff(milliseconds(50)));
+	auto start = steady_clock::now();
+	ASSERT_THROW(x.begin(), runtime_error);
+	auto elapsed = steady_clock::now()-start;
+	st = db.busy_stats();
+	cout << "retries: " << st.retries << " total wait: " << st.total_wait.count() << " max wait: " << st.max_wait.count() << endl;
+	ASSERT_GE(elapsed, milliseconds(50));
+	ASSERT_EQ(st.events, 1);
+	ASSERT_GT(st.retries, 1);
+	ASSERT_EQ(st.failures, 1);
+	ASSERT_GE(st.max_wait, milliseconds(40));
+
+	db.reset_busy_stats();
+	db.busy_policy(BusyPolicy::fixed(milliseconds(5000)));
+	std::thread t([&x2]()
+	{
+		std::this_thread::sleep_for(milliseconds(20));
+		x2.commit();									// releases the lock while the other connection waits
+	});
+	x.begin();
+	t.join();
+	x.commit();
+	st = db.busy_stats();
+	ASSERT_EQ(st.events, 1);
+	ASSERT_EQ(st.failures, 0);
+	ASSERT_GE(st.total_wait, milliseconds(10));
+
+	x2.begin();
+	int calls = 0;
+	db.busy_policy(BusyPolicy::custom([&calls](int count)
+	{
+		calls++;
+		return count < 3;
+	}));
+	ASSERT_THROW(x.begin(), runtime_error);
+	ASSERT_EQ(calls, 4);
+	x2.commit();
+}
+
+TEST_F(SqliteTest, try_api)
+{
+	const int constraint = 19, constraint_primarykey = 19 | (6<<8), range = 25, misuse = 21;	// sqlite result codes
+
+	Req req(db);
+	ASSERT_TRUE((req.sql() << "CREATE TABLE t (id INTEGER PRIMARY KEY, v TEXT);", req.try_exec()));
+
+	req.clear();
+	req.sql() << "INSERT INTO t VALUES (?, ?);";
+	ASSERT_TRUE(req.try_bind(1, "one"));
+	ASSERT_TRUE(req.try_exec());
+
+	req.reset();
+	ASSERT_TRUE(req.try_bind(1, "again"));
+	auto r = req.try_exec();
+	ASSERT_FALSE(r);
+	cout << "constraint: " << r.error().what << endl;
+	ASSERT_EQ(r.error().code, constraint);
+	ASSERT_EQ(r.error().extended, constraint_primarykey);
+	ASSERT_EQ(r.error().what, "UNIQUE constraint failed: t.id");
+	ASSERT_THROW(r.value(), runtime_error);
+	req.reset();
+	try
+	{
+		req.exec();
+		FAIL() << "exec() did not throw";
+	}
+	catch (const runtime_error& ex)
+	{
+		ASSERT_EQ(r.error().what, ex.what());			// same message as the throwing api
+	}
+
+	req.reset();
+	auto b = req.try_bind(1, "x", 3);				// too many arguments
+	ASSERT_FALSE(b);
+	ASSERT_EQ(b.error().code, range);
+
+	req.clear();
+	req.sql() << "SELECT id, v FROM t;";
+	auto s = req.try_exec_select();
+	ASSERT_TRUE(s);
+	ASSERT_EQ(*s, 2);
+	ASSERT_EQ(req.col_text(1), "one");
+
+	auto e = req.try_exec();						// still have row data
+	ASSERT_FALSE(e);
+	ASSERT_EQ(e.error().code, misuse);
+	ASSERT_THROW(req.exec(), runtime_error);
+
+	auto n = req.try_next_row();
+	ASSERT_TRUE(n);
+	ASSERT_EQ(*n, 0);
+
+	n = req.try_next_row();							// no row data
+	ASSERT_FALSE(n);
+	ASSERT_EQ(n.error().code, misuse);
+
+	req.clear();
+	req.sql() << "SELECT * FROM missing;";
+	s = req.try_exec_select();
+	ASSERT_FALSE(s);
+	cout << "prepare: " << s.error().what << endl;
+	ASSERT_EQ(s.error().code, 1);
+	ASSERT_EQ(s.error().what, "no such table: missing");
+}
+
+TEST_F(SqliteTest, result_cache)
+{
+	db.reopen(":memory:");
+	Req req(db);
+	req.sql() << "create table cfg(k TEXT PRIMARY KEY, v INTEGER);"
+		<< "create table other(a INTEGER);"
+		<< "insert into cfg values('a', 1), ('b', 2), ('c', 3);";
+	req.exec();
+
+	const char* sql = "select k, v from cfg where v >= ? order by k;";
+
+	auto b = db.select_cached(sql, 2);						// disabled
+	ASSERT_EQ(b->rows(), 2);
+	ASSERT_EQ(db.result_cache_stats().entries, 0);
+
+	db.result_cache_size(1 << 20);
+	b = db.select_cached(sql, 2);
+	auto b2 = db.select_cached(sql, 2);
+	ASSERT_EQ(b.get(), b2.get());							// same result, sqlite is not used
+	ASSERT_EQ(b->col(0).text(0), "b");
+	auto b3 = db.select_cached(sql, 3);						// parameters are part of the key
+	ASSERT_EQ(b3->rows(), 1);
+	auto st = db.result_cache_stats();
+	ASSERT_EQ(st.hits, 1);
+	ASSERT_EQ(st.misses, 3);
+	ASSERT_EQ(st.entries, 2);
+	ASSERT_GT(st.bytes, 0);
+
+	req.clear();
+	req.sql() << "insert into other values(1);";			// other tables do not invalidate
+	req.exec();
+	ASSERT_EQ(db.select_cached(sql, 2).get(), b.get());
+
+	req.clear();
+	req.sql() << "update cfg set v = 10 where k = 'a';";
+	req.exec();
+	b2 = db.select_cached(sql, 2);
+	ASSERT_NE(b2.get(), b.get());
+	ASSERT_EQ(b2->rows(), 3);
+	ASSERT_EQ(db.result_cache_stats().invalidations, 1);
+
+	req.clear();
+	req.sql() << "delete from cfg;";						// not truncated, so the update hook sees it
+	req.exec();
+	ASSERT_EQ(db.select_cached(sql, 2)->rows(), 0);
+
+	Trans t(db);											// uncommitted changes are not cached
+	t.begin();
+	req.clear();
+	req.sql() << "insert into cfg values('x', 5);";
+	req.exec();
+	ASSERT_EQ(db.select_cached(sql, 2)->rows(), 1);
+	t.abort();
+	ASSERT_EQ(db.select_cached(sql, 2)->rows(), 0);
+
+	req.clear();
+	req.sql() << "insert into cfg values('y', 7);";
+	req.exec();
+	auto keep = db.select_cached(sql, 2);
+	ASSERT_EQ(keep->rows(), 1);
+	req.clear();
+	req.sql() << "drop table cfg;";
+	req.exec();
+	ASSERT_EQ(keep->rows(), 1);								// results are kept while referenced
+	ASSERT_THROW(db.select_cached(sql, 2), runtime_error);
+
+	ASSERT_THROW(db.select_cached("insert into other values(2);"), runtime_error);
+	ASSERT_THROW(db.select_cached("select 1; select 2;"), runtime_error);
+
+	db.result_cache_size(1);									// everything evicted
+	st = db.result_cache_stats();
+	ASSERT_EQ(st.entries, 0);
+	ASSERT_EQ(st.bytes, 0);
+	db.result_cache_size(0);
+}
@@ -0,0 +1,163 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite/stmt.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <stdexcept>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite prepared statements \file */
+/** \example unittest/stmt.cc */
+/** @} */
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+using scc::sqld::Conn;
+using scc::sqld::Stmt;
+
+static_assert(std::is_nothrow_move_constructible_v<Stmt>);
+static_assert(sizeof(Stmt) == sizeof(void*));
+
+struct StmtTest : public testing::Test
+{
+	Conn db;
+
+	StmtTest() : db(":memory:")
+	{
+		Stmt(db, "create table t(id INTEGER PRIMARY KEY, name TEXT, score REAL, data BLOB);").exec();
+	}
+};
+
+static Stmt make_select(Conn& db)
+{
+	return Stmt(db, "select name from t where id = ?;");
+}
+
+TEST_F(StmtTest, exec_step)
+{
+	Stmt ins(db, "insert into t(id, name, score, data) values(?, ?, ?, ?);");
+	ASSERT_TRUE(ins);
+	ASSERT_EQ(ins.sql(), "insert into t(id, name, score, data) values(?, ?, ?, ?);");
+	for (int i = 0; i < 10; i++)
+	{
+		ins.bind(i, "n" + std::to_string(i), i/2.0, vector<char>{'x', static_cast<char>(i)});
+		ins.exec();
+	}
+	ins.bind(10, nullptr, nullptr, nullptr);
+	ins.exec();
+
+	Stmt sel(db, "select id, name, score, data from t where id >= :min order by id;");
+	ASSERT_EQ(sel.columns(), 4);
+	sel.bind_int(sel.bind_index(":min"), 8);
+	vector<int> ids;
+	while (sel.step())
+	{
+		ids.push_back(sel.col_int(0));
+		if (sel.col_int(0) == 9)
+		{
+			ASSERT_EQ(sel.col_text_view(1), "n9");
+			ASSERT_EQ(sel.col_real(2), 4.5);
+			ASSERT_EQ(sel.col_blob_view(3).size(), 2);
+			ASSERT_EQ(static_cast<int>(sel.col_blob_view(3)[1]), 9);
+		}
+		if (sel.col_int(0) == 10)
+		{
+			ASSERT_TRUE(sel.col_null(1));
+			ASSERT_EQ(sel.col_text_view(1), "");
+		}
+	}
+	ASSERT_EQ(ids, vector<int>({8, 9, 10}));
+	ASSERT_THROW(sel.col_int(0), runtime_error);		// no row
+
+	sel.reset();										// bindings are kept
+	ASSERT_TRUE(sel.step());
+	ASSERT_EQ(sel.col_int64(0), 8);
+	sel.reset();
+	sel.clear_bindings();
+	ASSERT_FALSE(sel.step());							// id >= NULL
+}
+
+TEST_F(StmtTest, move)
+{
+	Stmt(db, "insert into t(id, name) values(1, 'one'), (2, 'two');").exec();
+
+	vector<Stmt> v;
+	for (int i = 0; i < 4; i++)
+	{
+		v.push_back(make_select(db));					// returned from a factory, and moved as the vector grows
+	}
+	for (auto& s : v)
+	{
+		s.bind(2);
+		ASSERT_TRUE(s.step());
+		ASSERT_EQ(s.col_text_view(0), "two");
+		s.reset();
+	}
+
+	Stmt a = std::move(v[0]);
+	ASSERT_FALSE(v[0]);
+	ASSERT_TRUE(a);
+	a = std::move(v[1]);								// the first statement is finalized
+	ASSERT_FALSE(v[1]);
+	a.bind(1);
+	ASSERT_TRUE(a.step());
+	ASSERT_EQ(a.col_text_view(0), "one");
+	a.reset();
+	v.clear();
+
+	Stmt empty;
+	ASSERT_FALSE(empty);
+	ASSERT_EQ(empty.sql(), "");
+	ASSERT_THROW(empty.step(), runtime_error);
+	ASSERT_THROW(empty.bind(1), runtime_error);
+}
+
+TEST_F(StmtTest, errors)
+{
+	ASSERT_THROW(Stmt(db, "select * from nosuch;"), runtime_error);
+	ASSERT_THROW(Stmt(db, "select 1; select 2;"), runtime_error);
+	ASSERT_THROW(Stmt(db, "  "), runtime_error);
+	Stmt ok(db, "select 1;  \n");
+
+	Stmt ins(db, "insert into t(id) values(?);");
+	ins.bind(1);
+	ins.exec();
+	ASSERT_THROW(ins.exec(), runtime_error);			// duplicate key, and the statement is reset
+	ins.bind(2);
+	ins.exec();
+	ASSERT_THROW(ins.bind_index(":nosuch"), runtime_error);
+	ASSERT_THROW(ins.bind_int(5, 1), runtime_error);	// out of range
+}
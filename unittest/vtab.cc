@@ -0,0 +1,168 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/sqld.h>
+#include <sqlite/vtab.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <optional>
+#include <stdexcept>
+#include <iostream>
+
+/** \addtogroup sqlite
+	@{ */
+/** Tests for \ref sqlite virtual tables \file */
+/** \example unittest/vtab.cc */
+/** @} */
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::optional;
+using std::runtime_error;
+using scc::sqld::Conn;
+using scc::sqld::Req;
+using scc::sqld::VectorTable;
+
+struct Item
+{
+	int64_t id;
+	string name;
+	double score;
+	optional<int> extra;
+};
+
+using VT = VectorTable<Item>;
+
+struct VTabTest : public testing::Test
+{
+	Conn db;
+	vector<Item> items;
+
+	VTabTest() : db(":memory:")
+	{
+		for (int i = 0; i < 1000; i++)
+		{
+			items.push_back({i*2, "name" + std::to_string(i), i*0.5, i % 10 ? optional<int>() : optional<int>(i)});
+		}
+		VT(items, {
+			VT::column("id", &Item::id),
+			VT::column("name", &Item::name),
+			VT::column("score", &Item::score),
+			VT::column("extra", &Item::extra),
+			VT::column("upper", [](const Item& r) { return r.name.size(); }),
+		}, "id").install(db, "items");
+	}
+
+	int64_t count(const string& where)
+	{
+		Req req(db);
+		req.sql() << "select count(*) from items where " << where << ";";
+		req.exec_select();
+		return req.col_int64(0);
+	}
+
+	string plan(const string& sql)
+	{
+		Req req(db);
+		req.sql() << "explain query plan " << sql;
+		string s;
+		for (auto [id, parent, notused, detail] : req.rows<int, int, int, string>())
+		{
+			s += detail + ";";
+		}
+		return s;
+	}
+};
+
+TEST_F(VTabTest, scan)
+{
+	Req req(db);
+	req.sql() << "select id, name, score, extra, upper from items where name = 'name10';";
+	req.exec_select();
+	ASSERT_EQ(req.col_int64(0), 20);
+	ASSERT_EQ(req.col_text(1), "name10");
+	ASSERT_EQ(req.col_real(2), 5.0);
+	ASSERT_EQ(req.col_int(3), 10);
+	ASSERT_EQ(req.col_int(4), 6);
+	ASSERT_EQ(req.next_row(), 0);
+
+	ASSERT_EQ(count("1"), 1000);
+	ASSERT_EQ(count("extra is not null"), 100);
+}
+
+TEST_F(VTabTest, key)
+{
+	ASSERT_EQ(count("id = 100"), 1);
+	ASSERT_EQ(count("id = 101"), 0);
+	ASSERT_EQ(count("id > 1990"), 4);
+	ASSERT_EQ(count("id >= 1990"), 5);
+	ASSERT_EQ(count("id < 10"), 5);
+	ASSERT_EQ(count("id <= 10"), 6);
+	ASSERT_EQ(count("id > 100 and id <= 200"), 50);
+	ASSERT_EQ(count("id = null"), 0);
+
+	ASSERT_EQ(count("id > 99.5 and id < 100.5"), 1);		// mixed types are compared as sqlite does
+	ASSERT_EQ(count("id = '100'"), 1);
+	ASSERT_EQ(count("id < 'abc'"), 1000);
+
+	cout << plan("select * from items where id = 10;") << endl;
+	cout << plan("select * from items order by id;") << endl;
+	ASSERT_EQ(plan("select * from items order by id;").find("ORDER BY"), string::npos);	// no sort needed
+
+	Req req(db);
+	req.sql() << "create table o(rec_id INTEGER, qty INTEGER);";
+	req.sql() << "insert into o values(10, 1), (20, 2), (21, 3);";
+	req.exec();
+	req.clear();
+	req.sql() << "select r.name, o.qty from o join items r on r.id = o.rec_id order by o.qty;";
+	vector<string> names;
+	for (auto [n, q] : req.rows<string, int>())
+	{
+		names.push_back(n);
+	}
+	ASSERT_EQ(names, vector<string>({"name5", "name10"}));
+}
+
+TEST_F(VTabTest, errors)
+{
+	vector<Item> unsorted = {{2, "b", 0, {}}, {1, "a", 0, {}}};
+	ASSERT_THROW(VT(unsorted, {VT::column("id", &Item::id)}, "id").install(db, "bad"), runtime_error);
+	ASSERT_THROW(VT(unsorted, {VT::column("id", &Item::id)}, "nosuch"), runtime_error);
+	ASSERT_THROW(VT(unsorted, {VT::column("extra", &Item::extra)}, "extra"), runtime_error);	// cannot be a key
+
+	VT(unsorted, {VT::column("id", &Item::id), VT::column("name", &Item::name)}).install(db, "unkeyed");
+	Req req(db);
+	req.sql() << "select name from unkeyed where id = 1;";
+	req.exec_select();
+	ASSERT_EQ(req.col_text(0), "a");
+}
@@ -0,0 +1,413 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2022, Stable Cloud Computing, Inc.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <sqlite/vtab.h>
+#include <sqlite/sqld.h>
+#include <sqlite3.h>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+/** \addtogroup sqlite
+	@{ */
+/** \ref sqlite virtual table implementation \file */
+/** @} */
+
+using namespace scc::sqld;
+
+VTab::VTab(std::vector<VTabColumn> cols, const std::string& key) : m_cols(std::move(cols)), m_key(-1)
+{
+	if (key.empty())
+	{
+		return;
+	}
+	for (size_t i = 0; i < m_cols.size(); i++)
+	{
+		if (m_cols[i].name == key)
+		{
+			m_key = i;
+		}
+	}
+	if (m_key < 0)
+	{
+		throw std::runtime_error("virtual table key column not found");
+	}
+	auto& c = m_cols[m_key];
+	if (!c.int_key && !c.real_key && !c.text_key)
+	{
+		throw std::runtime_error("virtual table column cannot be a key");
+	}
+}
+
+std::string VTab::schema() const
+{
+	std::string s = "CREATE TABLE x(";
+	for (size_t i = 0; i < m_cols.size(); i++)
+	{
+		if (i)
+		{
+			s += ", ";
+		}
+		s += "\"" + m_cols[i].name + "\" " + m_cols[i].type;
+	}
+	s += ");";
+	return s;
+}
+
+namespace
+{
+
+struct Table
+{
+	sqlite3_vtab base;			// must be first
+	const VTab* tab;
+};
+
+struct Cursor
+{
+	sqlite3_vtab_cursor base;	// must be first
+	const VTab* tab;
+	size_t pos;
+	size_t end;
+};
+
+/*
+	Filter plan flags, arguments are passed in this order.
+*/
+enum
+{
+	plan_eq = 1,
+	plan_gt = 2,
+	plan_ge = 4,
+	plan_lt = 8,
+	plan_le = 16,
+};
+
+/*
+	Compare the key of a row with a constraint value: < 0 if the key is less, 0 if equal, > 0 if greater.
+
+	Sets usable false if the value has a different storage class (sqlite then applies the column affinity and
+	compares itself), or is NULL (no rows match).
+*/
+int compare(const VTabColumn& c, const void* row, sqlite3_value* v, bool& usable)
+{
+	int t = sqlite3_value_numeric_type(v);
+	usable = true;
+	if (c.text_key)
+	{
+		if (t != SQLITE_TEXT)
+		{
+			usable = false;
+			return 0;
+		}
+		std::string_view k = c.text_key(row);
+		std::string_view a(reinterpret_cast<const char*>(sqlite3_value_text(v)), sqlite3_value_bytes(v));
+		return k.compare(a);
+	}
+	if (t == SQLITE_INTEGER && c.int_key)
+	{
+		int64_t k = c.int_key(row), a = sqlite3_value_int64(v);
+		return k < a ? -1 : (k > a ? 1 : 0);
+	}
+	if (t == SQLITE_INTEGER || t == SQLITE_FLOAT)
+	{
+		double k = c.int_key ? static_cast<double>(c.int_key(row)) : c.real_key(row), a = sqlite3_value_double(v);
+		return k < a ? -1 : (k > a ? 1 : 0);
+	}
+	usable = false;
+	return 0;
+}
+
+/*
+	First row whose key is not less than (or, if upper is true, greater than) the value.
+*/
+size_t bound(const VTab* tab, sqlite3_value* v, bool upper, bool& usable)
+{
+	auto& c = tab->columns()[tab->key()];
+	size_t lo = 0, hi = tab->size();
+	usable = true;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi-lo)/2;
+		int r = compare(c, tab->row(mid), v, usable);
+		if (!usable)
+		{
+			return 0;
+		}
+		if (r < 0 || (upper && r == 0))
+		{
+			lo = mid+1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+int x_connect(sqlite3* db, void* aux, int, const char* const*, sqlite3_vtab** pp, char**)
+{
+	auto tab = static_cast<const VTab*>(aux);
+	int r = sqlite3_declare_vtab(db, tab->schema().c_str());
+	if (r != SQLITE_OK)
+	{
+		return r;
+	}
+	auto t = new Table();
+	t->tab = tab;
+	*pp = &t->base;
+	return SQLITE_OK;
+}
+
+int x_disconnect(sqlite3_vtab* p)
+{
+	delete reinterpret_cast<Table*>(p);
+	return SQLITE_OK;
+}
+
+int x_best_index(sqlite3_vtab* p, sqlite3_index_info* info)
+{
+	auto tab = reinterpret_cast<Table*>(p)->tab;
+	double n = std::max<double>(tab->size(), 1);
+	int key = tab->key();
+
+	int eq = -1, lower = -1, upper = -1;
+	int plan = 0;
+	for (int i = 0; key >= 0 && i < info->nConstraint; i++)
+	{
+		auto& c = info->aConstraint[i];
+		if (!c.usable || c.iColumn != key)
+		{
+			continue;
+		}
+		if (tab->columns()[key].text_key && std::strcmp(sqlite3_vtab_collation(info, i), "BINARY") != 0)
+		{
+			continue;			// keys are sorted by byte value
+		}
+		if (c.op == SQLITE_INDEX_CONSTRAINT_EQ && eq < 0)
+		{
+			eq = i;
+			plan |= plan_eq;
+		}
+		else if ((c.op == SQLITE_INDEX_CONSTRAINT_GT || c.op == SQLITE_INDEX_CONSTRAINT_GE) && lower < 0)
+		{
+			lower = i;
+			plan |= c.op == SQLITE_INDEX_CONSTRAINT_GT ? plan_gt : plan_ge;
+		}
+		else if ((c.op == SQLITE_INDEX_CONSTRAINT_LT || c.op == SQLITE_INDEX_CONSTRAINT_LE) && upper < 0)
+		{
+			upper = i;
+			plan |= c.op == SQLITE_INDEX_CONSTRAINT_LT ? plan_lt : plan_le;
+		}
+	}
+
+	// constraints only narrow the range of rows, sqlite checks them again (omit is not set)
+	int arg = 1;
+	for (int i : {eq, lower, upper})
+	{
+		if (i >= 0)
+		{
+			info->aConstraintUsage[i].argvIndex = arg++;
+		}
+	}
+	info->idxNum = plan;
+
+	double rows = n;
+	if (eq >= 0)
+	{
+		rows = 1;
+	}
+	else if (lower >= 0 && upper >= 0)
+	{
+		rows = n/16;
+	}
+	else if (lower >= 0 || upper >= 0)
+	{
+		rows = n/4;
+	}
+	info->estimatedRows = std::max<double>(rows, 1);
+	info->estimatedCost = (plan ? std::log2(n) : 0) + info->estimatedRows;
+
+	if (key >= 0 && info->nOrderBy == 1 && info->aOrderBy[0].iColumn == key && !info->aOrderBy[0].desc)
+	{
+		info->orderByConsumed = 1;
+	}
+	return SQLITE_OK;
+}
+
+int x_open(sqlite3_vtab* p, sqlite3_vtab_cursor** pp)
+{
+	auto c = new Cursor();
+	c->tab = reinterpret_cast<Table*>(p)->tab;
+	*pp = &c->base;
+	return SQLITE_OK;
+}
+
+int x_close(sqlite3_vtab_cursor* p)
+{
+	delete reinterpret_cast<Cursor*>(p);
+	return SQLITE_OK;
+}
+
+int x_filter(sqlite3_vtab_cursor* p, int plan, const char*, int, sqlite3_value** argv)
+{
+	auto c = reinterpret_cast<Cursor*>(p);
+	size_t lo = 0, hi = c->tab->size();
+	int arg = 0;
+
+	auto narrow = [&](sqlite3_value* v, bool set_lo, bool upper)
+	{
+		bool usable;
+		if (sqlite3_value_type(v) == SQLITE_NULL)		// comparison with NULL is never true
+		{
+			hi = lo;
+			return;
+		}
+		size_t b = bound(c->tab, v, upper, usable);
+		if (!usable)
+		{
+			return;
+		}
+		if (set_lo)
+		{
+			lo = std::max(lo, b);
+		}
+		else
+		{
+			hi = std::min(hi, b);
+		}
+	};
+
+	if (plan & plan_eq)
+	{
+		narrow(argv[arg], true, false);
+		narrow(argv[arg++], false, true);
+	}
+	if (plan & (plan_gt | plan_ge))
+	{
+		narrow(argv[arg++], true, plan & plan_gt);
+	}
+	if (plan & (plan_lt | plan_le))
+	{
+		narrow(argv[arg++], false, plan & plan_le);
+	}
+
+	c->pos = lo;
+	c->end = std::max(lo, hi);
+	return SQLITE_OK;
+}
+
+int x_next(sqlite3_vtab_cursor* p)
+{
+	reinterpret_cast<Cursor*>(p)->pos++;
+	return SQLITE_OK;
+}
+
+int x_eof(sqlite3_vtab_cursor* p)
+{
+	auto c = reinterpret_cast<Cursor*>(p);
+	return c->pos >= c->end;
+}
+
+int x_column(sqlite3_vtab_cursor* p, sqlite3_context* ctx, int col)
+{
+	auto c = reinterpret_cast<Cursor*>(p);
+	FuncCall fc(ctx, 0, nullptr);
+	try
+	{
+		c->tab->columns()[col].get(c->tab->row(c->pos), fc);
+	}
+	catch (const std::exception& e)
+	{
+		fc.result_error(e.what());
+		return SQLITE_ERROR;
+	}
+	return SQLITE_OK;
+}
+
+int x_rowid(sqlite3_vtab_cursor* p, sqlite3_int64* rowid)
+{
+	*rowid = reinterpret_cast<Cursor*>(p)->pos;
+	return SQLITE_OK;
+}
+
+void x_destroy(void* aux)
+{
+	delete static_cast<VTab*>(aux);
+}
+
+sqlite3_module make_module()
+{
+	sqlite3_module m{};
+	m.xConnect = x_connect;				// no xCreate, the table is eponymous only
+	m.xBestIndex = x_best_index;
+	m.xDisconnect = x_disconnect;
+	m.xDestroy = x_disconnect;
+	m.xOpen = x_open;
+	m.xClose = x_close;
+	m.xFilter = x_filter;
+	m.xNext = x_next;
+	m.xEof = x_eof;
+	m.xColumn = x_column;
+	m.xRowid = x_rowid;
+	return m;
+}
+
+const sqlite3_module vtab_module = make_module();
+
+}	// namespace
+
+void VTab::install(Conn& conn, const std::string& name) const
+{
+	if (m_key >= 0)
+	{
+		auto& c = m_cols[m_key];
+		for (size_t i = 1; i < size(); i++)
+		{
+			bool sorted = c.int_key ? c.int_key(row(i-1)) <= c.int_key(row(i))
+				: c.real_key ? c.real_key(row(i-1)) <= c.real_key(row(i))
+				: c.text_key(row(i-1)) <= c.text_key(row(i));
+			if (!sorted)
+			{
+				throw std::runtime_error("virtual table is not sorted by key");
+			}
+		}
+	}
+
+	int r = sqlite3_create_module_v2(conn.m_db, name.c_str(), &vtab_module, clone(), x_destroy);	// x_destroy is also called on failure
+	if (r != SQLITE_OK)
+	{
+		throw std::runtime_error(sqlite3_errmsg(conn.m_db));
+	}
+}